@@ -0,0 +1,1129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "alloc_trace.h"
+#include "buddy_cache.h"
+#include "tlsf_alloc.h"
+#include "mem_alloc.h"
+
+/*
+ * Allocator benchmark.
+ *
+ * Replays an allocation trace, recorded with the mem_alloc LD_PRELOAD
+ * shim or generated from one of the synthetic workloads, against each
+ * allocator.  Every allocator runs in a child process of its own.
+ * For each allocator it reports the throughput, the p50/p99/p999
+ * latency of each call, the peak RSS and the fragmentation.
+ *
+ * The peak RSS is the growth of the child's resident set over the
+ * replay: the high-water mark is reset and a baseline taken after
+ * the trace, the replay bookkeeping and the replay threads are in
+ * memory, and file-backed pages faulted in on the way (code) are
+ * left out.  What is left is what the allocator took from the
+ * system, headers, free blocks, caches and all.  Every object is
+ * written in full, so its pages count.
+ *
+ * Internal fragmentation is 1 - requested / usable bytes at the
+ * largest live usable size seen.  External fragmentation is
+ * 1 - that usable size / the peak RSS, the same measure for every
+ * allocator.
+ *
+ *   gcc -O2 -o alloc_bench alloc_bench.c alloc_trace.c buddy_alloc.c \
+ *       buddy_cache.c tlsf_alloc.c mem_alloc.c -lpthread
+ *   ./alloc_bench -w trie -n 2000000
+ *   ./alloc_bench -w jobs -T 4
+ *   ./alloc_bench -w churn -a buddy-eager; ./alloc_bench -w churn -a buddy-lazy
+ *   MEM_ALLOC_TRACE=app.trc LD_PRELOAD=./libmem_alloc.so ./app
+ *   ./alloc_bench -t app.trc
+ */
+
+#define  BENCH_MAX_THREADS     64
+#define  BENCH_FAILED          ((void *) 1)
+
+/*
+ * a replayable event, objects are numbered densely.
+ */
+typedef struct _bench_event_st {
+    uint8_t       op;          /* alloc_trace_op_e */
+    uint32_t      thread;
+    uint32_t      id;
+    uint64_t      size;
+} bench_event_st;
+
+typedef struct _bench_workload_st {
+    bench_event_st  *events;
+    uint64_t         nevents;
+    uint32_t         nobjects;
+    uint32_t         nthreads;
+} bench_workload_st;
+
+/*
+ * the common interface every allocator is driven through.
+ */
+typedef struct _bench_alloc_st {
+    const char   *name;
+    int         (*init) ();
+    void       *(*alloc) (size_t size);
+    void        (*dealloc) (void *ptr, size_t size);
+    void       *(*realloc) (void *ptr, size_t old_size, size_t size);
+    size_t      (*usable) (void *ptr, size_t size);
+} bench_alloc_st;
+
+typedef struct _bench_lat_st {
+    uint32_t     *ns;
+    uint64_t      count;
+} bench_lat_st;
+
+typedef struct _bench_result_st {
+    char          name[32];
+    int           ok;
+    uint64_t      ops;
+    double        seconds;
+    uint32_t      pct[3][3];   /* [op][p50, p99, p999] */
+    uint64_t      peak_requested;
+    uint64_t      peak_usable;
+    long          rss_kb;      /* peak RSS over the baseline */
+} bench_result_st;
+
+typedef struct _bench_thread_st {
+    pthread_t       thread_id;
+    uint32_t        num;
+    uint64_t       *events;    /* indexes into the workload */
+    uint64_t        nevents;
+    bench_lat_st    lat[3];
+} bench_thread_st;
+
+/*
+ * replay state, shared by the replay threads of one child.
+ */
+static bench_workload_st   workload_g;
+static bench_alloc_st     *alloc_g;
+static void * volatile    *objects_g;
+static uint64_t           *object_sizes_g;
+static uint64_t            arena_bytes_g = 1024ULL * 1024 * 1024;
+
+static volatile uint64_t   live_requested_g;
+static volatile uint64_t   live_usable_g;
+static volatile uint64_t   peak_usable_g;
+static bench_result_st     result_g;
+static pthread_mutex_t     sample_lock_g = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t   start_g;    /* the replay threads and main */
+
+/* ------------------------------------------------------------------ */
+/* Allocators                                                          */
+/* ------------------------------------------------------------------ */
+
+static int
+glibc_init ()
+{
+    return (0);
+}
+
+static void *
+glibc_alloc (size_t size)
+{
+    return (malloc (size));
+}
+
+static void
+glibc_dealloc (void *ptr, size_t size)
+{
+    free (ptr);
+}
+
+static void *
+glibc_realloc (void *ptr, size_t old_size, size_t size)
+{
+    return (realloc (ptr, size));
+}
+
+static size_t
+glibc_usable (void *ptr, size_t size)
+{
+    return (malloc_usable_size (ptr));
+}
+
+static int
+mem_init ()
+{
+    return (0);
+}
+
+static void
+mem_dealloc (void *ptr, size_t size)
+{
+    mem_free (ptr);
+}
+
+static void *
+mem_bench_realloc (void *ptr, size_t old_size, size_t size)
+{
+    return (mem_realloc (ptr, size));
+}
+
+static size_t
+mem_usable (void *ptr, size_t size)
+{
+    return (mem_usable_size (ptr));
+}
+
+static int
+buddy_bench_init ()
+{
+    if (buddy_alloc_init () != 0 ||
+        buddy_alloc_arena (arena_bytes_g, 0) != 0 ||
+        buddy_cache_init (NULL) != 0)
+        return (-1);
+    return (0);
+}
+
+static void *
+buddy_bench_alloc (size_t size)
+{
+    return (buddy_cache_alloc (size));
+}
+
+static void
+buddy_bench_dealloc (void *ptr, size_t size)
+{
+    buddy_cache_dealloc ((uchar *) ptr, size);
+}
+
+static void *
+buddy_bench_realloc (void *ptr, size_t old_size, size_t size)
+{
+    void  *p;
+
+    if (buddy_get_order (old_size) == buddy_get_order (size))
+        return (ptr);
+    p = buddy_bench_alloc (size);
+    if (p) {
+        memcpy (p, ptr, old_size < size ? old_size : size);
+        buddy_cache_dealloc ((uchar *) ptr, old_size);
+    }
+    return (p);
+}
+
+static size_t
+buddy_usable (void *ptr, size_t size)
+{
+    return (BLOCKSIZE(buddy_get_order (size)));
+}
+
+/*
+ * The buddy arena without the magazines, under a lock, coalescing
+ * on every free or lazily.
+ */
+extern buddy_arena_st    buddy_arena_g;
+static pthread_mutex_t  buddy_lock_g = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+buddy_eager_init ()
+{
+    if (buddy_alloc_init () != 0 ||
+        buddy_alloc_arena (arena_bytes_g, 0) != 0)
+        return (-1);
+    return (0);
+}
+
+static int
+buddy_lazy_init ()
+{
+    if (buddy_eager_init () != 0)
+        return (-1);
+    buddy_set_lazy (BUDDY_LAZY_WATERMARK);
+    return (0);
+}
+
+static void *
+buddy_locked_alloc (size_t size)
+{
+    void  *p;
+
+    pthread_mutex_lock (&buddy_lock_g);
+    p = buddy_alloc (size);
+    pthread_mutex_unlock (&buddy_lock_g);
+    return (p);
+}
+
+static void
+buddy_locked_dealloc (void *ptr, size_t size)
+{
+    pthread_mutex_lock (&buddy_lock_g);
+    buddy_dealloc ((uchar *) ptr, size);
+    pthread_mutex_unlock (&buddy_lock_g);
+}
+
+static void *
+buddy_locked_realloc (void *ptr, size_t old_size, size_t size)
+{
+    void  *p;
+
+    pthread_mutex_lock (&buddy_lock_g);
+    p = buddy_realloc ((uchar *) ptr, size);
+    pthread_mutex_unlock (&buddy_lock_g);
+    return (p);
+}
+
+/*
+ * TLSF is single threaded, it runs under a lock.
+ */
+static pthread_mutex_t  tlsf_lock_g = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+tlsf_bench_init ()
+{
+    void  *mem;
+
+    mem = mmap (NULL, arena_bytes_g, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+        return (-1);
+    return (tlsf_alloc_init (mem, arena_bytes_g));
+}
+
+static void *
+tlsf_bench_alloc (size_t size)
+{
+    uchar  *p;
+
+    pthread_mutex_lock (&tlsf_lock_g);
+    p = tlsf_alloc (size);
+    pthread_mutex_unlock (&tlsf_lock_g);
+    return (p);
+}
+
+static void
+tlsf_bench_dealloc (void *ptr, size_t size)
+{
+    pthread_mutex_lock (&tlsf_lock_g);
+    tlsf_dealloc ((uchar *) ptr);
+    pthread_mutex_unlock (&tlsf_lock_g);
+}
+
+static void *
+tlsf_bench_realloc (void *ptr, size_t old_size, size_t size)
+{
+    uchar  *p;
+
+    pthread_mutex_lock (&tlsf_lock_g);
+    p = tlsf_realloc ((uchar *) ptr, size);
+    pthread_mutex_unlock (&tlsf_lock_g);
+    return (p);
+}
+
+static size_t
+tlsf_usable (void *ptr, size_t size)
+{
+    return (tlsf_block_size ((uchar *) ptr));
+}
+
+static bench_alloc_st  allocators_g[] = {
+    { "glibc", glibc_init, glibc_alloc, glibc_dealloc, glibc_realloc,
+      glibc_usable },
+    { "mem_alloc", mem_init, mem_malloc, mem_dealloc, mem_bench_realloc,
+      mem_usable },
+    { "buddy", buddy_bench_init, buddy_bench_alloc, buddy_bench_dealloc,
+      buddy_bench_realloc, buddy_usable },
+    { "buddy-eager", buddy_eager_init, buddy_locked_alloc, buddy_locked_dealloc,
+      buddy_locked_realloc, buddy_usable },
+    { "buddy-lazy", buddy_lazy_init, buddy_locked_alloc, buddy_locked_dealloc,
+      buddy_locked_realloc, buddy_usable },
+    { "tlsf", tlsf_bench_init, tlsf_bench_alloc, tlsf_bench_dealloc,
+      tlsf_bench_realloc, tlsf_usable },
+};
+
+#define  NUM_ALLOCATORS  (sizeof(allocators_g) / sizeof(allocators_g[0]))
+
+/* ------------------------------------------------------------------ */
+/* Workloads                                                           */
+/* ------------------------------------------------------------------ */
+
+static void
+workload_add (bench_workload_st *w, uint64_t *cap, uint8_t op,
+              uint32_t thread, uint32_t id, uint64_t size)
+{
+    bench_event_st  *ev;
+
+    if (w->nevents == *cap) {
+        *cap = *cap ? *cap * 2 : 4096;
+        w->events = (bench_event_st *) realloc (w->events,
+                        *cap * sizeof(bench_event_st));
+        if (!w->events) {
+            perror ("realloc");
+            exit (1);
+        }
+    }
+    ev = &w->events[w->nevents++];
+    ev->op = op;
+    ev->thread = thread;
+    ev->id = id;
+    ev->size = size;
+    if (thread + 1 > w->nthreads)
+        w->nthreads = thread + 1;
+}
+
+/*
+ * workload_trie
+ *
+ * Trie node churn, every thread inserts and deletes addresses.  An
+ * insert allocates a node, a key and an address, sometimes a second
+ * node and key for the split; a delete frees one of the live entries.
+ */
+static void
+workload_trie (bench_workload_st *w, uint64_t nevents, uint32_t nthreads)
+{
+    typedef struct { uint32_t ids[5]; int n; } entry_t;
+    entry_t    *live[BENCH_MAX_THREADS];
+    uint64_t    nlive[BENCH_MAX_THREADS], cap;
+    uint32_t    t, next_id;
+    entry_t    *e;
+    uint64_t    k;
+    int         i;
+
+    static const uint64_t sizes[5] = { 32, 12, 4, 32, 12 };
+
+    memset (w, 0, sizeof(*w));
+    cap = 0;
+    next_id = 0;
+    for (t = 0; t < nthreads; t++) {
+        live[t] = (entry_t *) malloc ((nevents / nthreads + 1) * sizeof(entry_t));
+        nlive[t] = 0;
+    }
+
+    while (w->nevents < nevents) {
+        for (t = 0; t < nthreads; t++) {
+            if (nlive[t] > 0 && rand () % 100 < 40) {
+                k = rand () % nlive[t];
+                e = &live[t][k];
+                for (i = 0; i < e->n; i++)
+                    workload_add (w, &cap, ALLOC_TRACE_FREE, t, e->ids[i], 0);
+                live[t][k] = live[t][--nlive[t]];
+            } else {
+                e = &live[t][nlive[t]++];
+                e->n = (rand () % 4 == 0) ? 5 : 3;
+                for (i = 0; i < e->n; i++) {
+                    e->ids[i] = next_id++;
+                    workload_add (w, &cap, ALLOC_TRACE_ALLOC, t, e->ids[i],
+                                  sizes[i]);
+                }
+            }
+        }
+    }
+
+    /*
+     * tear down what is left.
+     */
+    for (t = 0; t < nthreads; t++) {
+        for (k = 0; k < nlive[t]; k++) {
+            for (i = 0; i < live[t][k].n; i++)
+                workload_add (w, &cap, ALLOC_TRACE_FREE, t, live[t][k].ids[i], 0);
+        }
+        free (live[t]);
+    }
+    w->nobjects = next_id;
+}
+
+/*
+ * workload_churn
+ *
+ * Bursts of one size class: every thread allocates a burst of
+ * objects and frees them all again in random order, so the arena
+ * keeps going back to empty.
+ */
+static void
+workload_churn (bench_workload_st *w, uint64_t nevents, uint32_t nthreads)
+{
+    uint32_t   burst[64], t, next_id, k, j, tmp;
+    uint64_t   cap;
+
+    memset (w, 0, sizeof(*w));
+    cap = 0;
+    next_id = 0;
+
+    while (w->nevents < nevents) {
+        for (t = 0; t < nthreads; t++) {
+            for (k = 0; k < 64; k++) {
+                burst[k] = next_id;
+                workload_add (w, &cap, ALLOC_TRACE_ALLOC, t, next_id++, 64);
+            }
+            for (k = 63; k > 0; k--) {
+                j = rand () % (k + 1);
+                tmp = burst[k];
+                burst[k] = burst[j];
+                burst[j] = tmp;
+            }
+            for (k = 0; k < 64; k++)
+                workload_add (w, &cap, ALLOC_TRACE_FREE, t, burst[k], 0);
+        }
+    }
+    w->nobjects = next_id;
+}
+
+/*
+ * workload_jobs
+ *
+ * Job queue churn, thread 0 dispatches: it allocates a job element
+ * that a worker frees, and frees the channel element the worker
+ * allocated when it became ready.  Up to a queue depth of jobs
+ * are pending.
+ */
+static void
+workload_jobs (bench_workload_st *w, uint64_t nevents, uint32_t nthreads)
+{
+    uint32_t   pending[256], worker, id;
+    uint64_t   cap, n;
+    int        head, depth;
+
+    memset (w, 0, sizeof(*w));
+    cap = 0;
+    id = 0;
+    head = depth = 0;
+
+    for (n = 0; w->nevents < nevents; n++) {
+        worker = nthreads > 1 ? 1 + n % (nthreads - 1) : 0;
+
+        /*
+         * the worker is ready, the dispatcher takes its channel.
+         */
+        workload_add (w, &cap, ALLOC_TRACE_ALLOC, worker, id, 16);
+        workload_add (w, &cap, ALLOC_TRACE_FREE, 0, id++, 0);
+
+        /*
+         * the dispatcher queues a job, the oldest one runs.
+         */
+        workload_add (w, &cap, ALLOC_TRACE_ALLOC, 0, id, 16);
+        pending[(head + depth++) % 256] = id++;
+        if (depth == 256 || rand () % 2) {
+            workload_add (w, &cap, ALLOC_TRACE_FREE, worker, pending[head], 0);
+            head = (head + 1) % 256;
+            depth--;
+        }
+    }
+    while (depth--) {
+        workload_add (w, &cap, ALLOC_TRACE_FREE, 0, pending[head], 0);
+        head = (head + 1) % 256;
+    }
+    w->nobjects = id;
+}
+
+/*
+ * id_map_st
+ *
+ * open addressing map from a recorded address to its live object.
+ */
+typedef struct _id_map_st {
+    uint64_t     *keys;
+    uint32_t     *ids;
+    uint64_t      mask;
+} id_map_st;
+
+static uint64_t *
+id_map_slot (id_map_st *m, uint64_t addr, boolean *found)
+{
+    uint64_t  h;
+
+    h = (addr >> 4) * 0x9E3779B97F4A7C15ULL;
+    for (h &= m->mask; m->keys[h]; h = (h + 1) & m->mask) {
+        if (m->keys[h] == addr) {
+            *found = 1;
+            return (&m->keys[h]);
+        }
+    }
+    *found = 0;
+    return (&m->keys[h]);
+}
+
+/*
+ * id_map_delete
+ *
+ * Removes a slot and re-inserts the rest of its cluster.
+ */
+static void
+id_map_delete (id_map_st *m, uint64_t *slot)
+{
+    uint64_t  i, j, key;
+    uint32_t  id;
+    boolean   found;
+    uint64_t *s;
+
+    i = slot - m->keys;
+    m->keys[i] = 0;
+    for (j = (i + 1) & m->mask; m->keys[j]; j = (j + 1) & m->mask) {
+        key = m->keys[j];
+        id = m->ids[j];
+        m->keys[j] = 0;
+        s = id_map_slot (m, key, &found);
+        *s = key;
+        m->ids[s - m->keys] = id;
+    }
+}
+
+/*
+ * workload_load
+ *
+ * Reads a recorded trace, numbers the objects and the threads.
+ */
+static int
+workload_load (bench_workload_st *w, const char *path)
+{
+    alloc_trace_header_st  hdr;
+    alloc_trace_event_st   ev;
+    id_map_st              map;
+    uint32_t               tids[BENCH_MAX_THREADS], ntids, t, id;
+    uint64_t               cap, *slot, *old_slot;
+    boolean                found, old_found;
+    FILE                  *fp;
+
+    fp = fopen (path, "r");
+    if (!fp) {
+        perror (path);
+        return (-1);
+    }
+    if (fread (&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != ALLOC_TRACE_MAGIC || hdr.version != ALLOC_TRACE_VERSION) {
+        fprintf (stderr, "%s: not an allocation trace\n", path);
+        fclose (fp);
+        return (-1);
+    }
+
+    memset (w, 0, sizeof(*w));
+    map.mask = (1 << 22) - 1;
+    map.keys = (uint64_t *) calloc (map.mask + 1, sizeof(uint64_t));
+    map.ids = (uint32_t *) calloc (map.mask + 1, sizeof(uint32_t));
+    cap = 0;
+    ntids = 0;
+
+    while (fread (&ev, sizeof(ev), 1, fp) == 1) {
+        for (t = 0; t < ntids && tids[t] != ev.thread; t++)
+            ;
+        if (t == ntids) {
+            if (ntids == BENCH_MAX_THREADS)
+                t = ntids - 1;
+            else
+                tids[ntids++] = ev.thread;
+        }
+
+        switch (ev.op) {
+        case ALLOC_TRACE_ALLOC:
+            if (!ev.addr)
+                break;
+            slot = id_map_slot (&map, ev.addr, &found);
+            *slot = ev.addr;
+            map.ids[slot - map.keys] = w->nobjects;
+            workload_add (w, &cap, ALLOC_TRACE_ALLOC, t, w->nobjects++, ev.size);
+            break;
+
+        case ALLOC_TRACE_FREE:
+            slot = id_map_slot (&map, ev.addr, &found);
+            if (!found)
+                break;     /* allocated before the trace started */
+            workload_add (w, &cap, ALLOC_TRACE_FREE, t,
+                          map.ids[slot - map.keys], 0);
+            id_map_delete (&map, slot);
+            break;
+
+        case ALLOC_TRACE_REALLOC:
+            old_found = 0;
+            if (ev.old_addr) {
+                old_slot = id_map_slot (&map, ev.old_addr, &old_found);
+                if (old_found) {
+                    id = map.ids[old_slot - map.keys];
+                    id_map_delete (&map, old_slot);
+                }
+            }
+            if (!old_found) {
+                id = w->nobjects++;
+                if (!ev.addr)
+                    break;
+                workload_add (w, &cap, ALLOC_TRACE_ALLOC, t, id, ev.size);
+            } else if (!ev.addr) {
+                workload_add (w, &cap, ALLOC_TRACE_FREE, t, id, 0);
+                break;
+            } else {
+                workload_add (w, &cap, ALLOC_TRACE_REALLOC, t, id, ev.size);
+            }
+            slot = id_map_slot (&map, ev.addr, &found);
+            *slot = ev.addr;
+            map.ids[slot - map.keys] = id;
+            break;
+        }
+    }
+
+    fclose (fp);
+    free (map.keys);
+    free (map.ids);
+    return (0);
+}
+
+/*
+ * workload_save
+ *
+ * Writes a workload out as a trace, object ids stand in for
+ * the addresses.
+ */
+static int
+workload_save (bench_workload_st *w, const char *path)
+{
+    alloc_trace_header_st  hdr;
+    alloc_trace_event_st   ev;
+    bench_event_st        *e;
+    uint64_t               i;
+    FILE                  *fp;
+
+    fp = fopen (path, "w");
+    if (!fp) {
+        perror (path);
+        return (-1);
+    }
+    hdr.magic = ALLOC_TRACE_MAGIC;
+    hdr.version = ALLOC_TRACE_VERSION;
+    fwrite (&hdr, sizeof(hdr), 1, fp);
+
+    memset (&ev, 0, sizeof(ev));
+    for (i = 0; i < w->nevents; i++) {
+        e = &w->events[i];
+        ev.op = e->op;
+        ev.thread = e->thread + 1;
+        ev.size = e->size;
+        ev.addr = (uint64_t) e->id + 1;
+        ev.old_addr = e->op == ALLOC_TRACE_REALLOC ? ev.addr : 0;
+        fwrite (&ev, sizeof(ev), 1, fp);
+    }
+    fclose (fp);
+    return (0);
+}
+
+/* ------------------------------------------------------------------ */
+/* Replay                                                              */
+/* ------------------------------------------------------------------ */
+
+static inline uint64_t
+now_ns ()
+{
+    struct timespec  ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * rss_kb
+ *
+ * The resident set now, or its high-water mark, from /proc.
+ */
+static long
+rss_kb (const char *field)
+{
+    char   line[128];
+    long   kb;
+    FILE  *fp;
+
+    kb = 0;
+    fp = fopen ("/proc/self/status", "r");
+    if (!fp)
+        return (0);
+    while (fgets (line, sizeof(line), fp)) {
+        if (strncmp (line, field, strlen (field)) == 0) {
+            kb = atol (line + strlen (field));
+            break;
+        }
+    }
+    fclose (fp);
+    return (kb);
+}
+
+/*
+ * reset_peak_rss
+ *
+ * Starts a new RSS high-water mark, Linux 4.0 and later.  On older
+ * kernels the mark includes what was resident before.
+ */
+static void
+reset_peak_rss ()
+{
+    FILE  *fp;
+
+    fp = fopen ("/proc/self/clear_refs", "w");
+    if (!fp)
+        return;
+    fputs ("5", fp);
+    fclose (fp);
+}
+
+/*
+ * add_live
+ *
+ * Counts an object in the live sizes, and records the sizes when
+ * the usable size reaches a new high.  The lock is only taken then.
+ */
+static inline void
+add_live (uint64_t requested, uint64_t usable)
+{
+    __sync_fetch_and_add (&live_requested_g, requested);
+    usable = __sync_add_and_fetch (&live_usable_g, usable);
+    if (usable <= peak_usable_g)
+        return;
+
+    pthread_mutex_lock (&sample_lock_g);
+    usable = live_usable_g;
+    if (usable > peak_usable_g) {
+        peak_usable_g = usable;
+        result_g.peak_usable = usable;
+        result_g.peak_requested = live_requested_g;
+    }
+    pthread_mutex_unlock (&sample_lock_g);
+}
+
+/*
+ * wait_for_object
+ *
+ * An object freed by another thread than the one that allocated
+ * it may not be there yet.
+ */
+static inline void *
+wait_for_object (uint32_t id)
+{
+    void  *p;
+
+    while ((p = objects_g[id]) == NULL)
+        sched_yield ();
+    return (p);
+}
+
+static void *
+replay_thread (void *arg)
+{
+    bench_thread_st  *th;
+    bench_event_st   *ev;
+    uint64_t          i, t0, t1, usable;
+    void             *p, *q;
+
+    th = (bench_thread_st *) arg;
+    pthread_barrier_wait (&start_g);
+    for (i = 0; i < th->nevents; i++) {
+        ev = &workload_g.events[th->events[i]];
+
+        switch (ev->op) {
+        case ALLOC_TRACE_ALLOC:
+            t0 = now_ns ();
+            p = alloc_g->alloc (ev->size);
+            t1 = now_ns ();
+            th->lat[0].ns[th->lat[0].count++] = (uint32_t) (t1 - t0);
+            if (!p) {
+                objects_g[ev->id] = BENCH_FAILED;
+                break;
+            }
+            memset (p, 0xA5, ev->size);
+            object_sizes_g[ev->id] = ev->size;
+            add_live (ev->size, alloc_g->usable (p, ev->size));
+            objects_g[ev->id] = p;
+            break;
+
+        case ALLOC_TRACE_FREE:
+            p = wait_for_object (ev->id);
+            if (p == BENCH_FAILED)
+                break;
+            usable = alloc_g->usable (p, object_sizes_g[ev->id]);
+            __sync_fetch_and_sub (&live_requested_g, object_sizes_g[ev->id]);
+            __sync_fetch_and_sub (&live_usable_g, usable);
+            t0 = now_ns ();
+            alloc_g->dealloc (p, object_sizes_g[ev->id]);
+            t1 = now_ns ();
+            th->lat[1].ns[th->lat[1].count++] = (uint32_t) (t1 - t0);
+            break;
+
+        case ALLOC_TRACE_REALLOC:
+            p = wait_for_object (ev->id);
+            if (p == BENCH_FAILED)
+                break;
+            usable = alloc_g->usable (p, object_sizes_g[ev->id]);
+            t0 = now_ns ();
+            q = alloc_g->realloc (p, object_sizes_g[ev->id], ev->size);
+            t1 = now_ns ();
+            th->lat[2].ns[th->lat[2].count++] = (uint32_t) (t1 - t0);
+            __sync_fetch_and_sub (&live_requested_g, object_sizes_g[ev->id]);
+            __sync_fetch_and_sub (&live_usable_g, usable);
+            if (!q) {
+                objects_g[ev->id] = BENCH_FAILED;
+                break;
+            }
+            memset (q, 0xA5, ev->size);
+            object_sizes_g[ev->id] = ev->size;
+            add_live (ev->size, alloc_g->usable (q, ev->size));
+            objects_g[ev->id] = q;
+            break;
+        }
+    }
+    return (NULL);
+}
+
+static int
+cmp_u32 (const void *a, const void *b)
+{
+    uint32_t  x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x < y ? -1 : x > y);
+}
+
+/*
+ * percentiles
+ *
+ * Merges the per thread latencies of one call and sorts them.
+ */
+static void
+percentiles (bench_thread_st *threads, uint32_t nthreads, int op,
+             uint32_t pct[3])
+{
+    uint32_t  *all, t;
+    uint64_t   n;
+
+    for (n = 0, t = 0; t < nthreads; t++)
+        n += threads[t].lat[op].count;
+    pct[0] = pct[1] = pct[2] = 0;
+    if (n == 0)
+        return;
+
+    all = (uint32_t *) malloc (n * sizeof(uint32_t));
+    for (n = 0, t = 0; t < nthreads; t++) {
+        memcpy (all + n, threads[t].lat[op].ns,
+                threads[t].lat[op].count * sizeof(uint32_t));
+        n += threads[t].lat[op].count;
+    }
+    qsort (all, n, sizeof(uint32_t), cmp_u32);
+    pct[0] = all[n * 50 / 100];
+    pct[1] = all[n * 99 / 100];
+    pct[2] = all[n * 999 / 1000];
+    free (all);
+}
+
+/*
+ * replay
+ *
+ * Runs the workload against one allocator, in the child.  Only
+ * the replay threads touch the allocator under test, the replay
+ * bookkeeping is set up and written before with malloc, and is in
+ * the RSS baseline.
+ */
+static void
+replay (bench_alloc_st *a)
+{
+    bench_thread_st  *threads;
+    uint64_t          i, t0;
+    uint32_t          t;
+    long              base_kb, file_kb;
+    int               op;
+
+    memset (&result_g, 0, sizeof(result_g));
+    strncpy (result_g.name, a->name, sizeof(result_g.name) - 1);
+    alloc_g = a;
+
+    threads = (bench_thread_st *) calloc (workload_g.nthreads,
+                                          sizeof(bench_thread_st));
+    objects_g = (void * volatile *) calloc (workload_g.nobjects + 1,
+                                           sizeof(void *));
+    object_sizes_g = (uint64_t *) calloc (workload_g.nobjects + 1,
+                                          sizeof(uint64_t));
+
+    for (i = 0; i < workload_g.nevents; i++)
+        threads[workload_g.events[i].thread].nevents++;
+    for (t = 0; t < workload_g.nthreads; t++) {
+        threads[t].num = t;
+        threads[t].events = (uint64_t *) malloc (
+                (threads[t].nevents + 1) * sizeof(uint64_t));
+        for (op = 0; op < 3; op++)
+            threads[t].lat[op].ns = (uint32_t *) malloc (
+                    (threads[t].nevents + 1) * sizeof(uint32_t));
+        threads[t].nevents = 0;
+    }
+    for (i = 0; i < workload_g.nevents; i++) {
+        t = workload_g.events[i].thread;
+        threads[t].events[threads[t].nevents++] = i;
+    }
+
+    /*
+     * the bookkeeping is written now so that its pages are in the
+     * baseline, and glibc gives back what it has free.
+     */
+    for (t = 0; t < workload_g.nthreads; t++) {
+        for (op = 0; op < 3; op++)
+            memset (threads[t].lat[op].ns, 0,
+                    (threads[t].nevents + 1) * sizeof(uint32_t));
+    }
+    memset ((void *) objects_g, 0, (workload_g.nobjects + 1) * sizeof(void *));
+    memset (object_sizes_g, 0, (workload_g.nobjects + 1) * sizeof(uint64_t));
+    malloc_trim (0);
+
+    if (a->init () != 0) {
+        fprintf (stderr, "%s: init failed\n", a->name);
+        return;
+    }
+
+    /*
+     * the threads are started before the baseline, and wait for it.
+     */
+    pthread_barrier_init (&start_g, NULL, workload_g.nthreads + 1);
+    for (t = 0; t < workload_g.nthreads; t++)
+        pthread_create (&threads[t].thread_id, NULL, replay_thread, &threads[t]);
+    reset_peak_rss ();
+    base_kb = rss_kb ("VmRSS:");
+    file_kb = rss_kb ("RssFile:");
+    t0 = now_ns ();
+    pthread_barrier_wait (&start_g);
+    for (t = 0; t < workload_g.nthreads; t++)
+        pthread_join (threads[t].thread_id, NULL);
+    result_g.seconds = (now_ns () - t0) / 1e9;
+    result_g.rss_kb = rss_kb ("VmHWM:") - base_kb -
+                      (rss_kb ("RssFile:") - file_kb);
+
+    for (t = 0; t < workload_g.nthreads; t++) {
+        for (op = 0; op < 3; op++)
+            result_g.ops += threads[t].lat[op].count;
+    }
+    for (op = 0; op < 3; op++)
+        percentiles (threads, workload_g.nthreads, op, result_g.pct[op]);
+    result_g.ok = 1;
+}
+
+/*
+ * run_allocator
+ *
+ * Forks a child to replay against one allocator and collects its
+ * result.
+ */
+static int
+run_allocator (bench_alloc_st *a, bench_result_st *res)
+{
+    int            fds[2], status;
+    pid_t          pid;
+
+    if (pipe (fds) != 0)
+        return (-1);
+
+    pid = fork ();
+    if (pid == 0) {
+        close (fds[0]);
+        replay (a);
+        if (write (fds[1], &result_g, sizeof(result_g)) != sizeof(result_g))
+            _exit (1);
+        _exit (0);
+    }
+    close (fds[1]);
+    memset (res, 0, sizeof(*res));
+    if (read (fds[0], res, sizeof(*res)) != sizeof(*res))
+        res->ok = 0;
+    close (fds[0]);
+
+    if (waitpid (pid, &status, 0) < 0)
+        return (-1);
+    return (res->ok ? 0 : -1);
+}
+
+static void
+print_result (bench_result_st *r)
+{
+    static const char *ops[3] = { "alloc", "free", "realloc" };
+    double  internal, external;
+    int     op;
+
+    internal = r->peak_usable ?
+               1.0 - (double) r->peak_requested / r->peak_usable : 0.0;
+    external = ((uint64_t) r->rss_kb * 1024 > r->peak_usable) ?
+               1.0 - (double) r->peak_usable / ((uint64_t) r->rss_kb * 1024) :
+               0.0;
+
+    printf ("%-10s %12.0f ops/s  rss %8ld KB  frag int %5.1f%% ext %5.1f%%\n",
+            r->name, r->ops / r->seconds, r->rss_kb,
+            internal * 100, external * 100);
+    for (op = 0; op < 3; op++) {
+        if (!r->pct[op][0] && !r->pct[op][2])
+            continue;
+        printf ("           %-8s p50 %6u ns  p99 %6u ns  p999 %7u ns\n",
+                ops[op], r->pct[op][0], r->pct[op][1], r->pct[op][2]);
+    }
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf (stderr,
+        "usage: %s [-w trie|jobs|churn | -t trace] [-n events] [-T threads]\n"
+        "          [-a allocator] [-m arena_mb] [-o save_trace] [-s seed]\n",
+        prog);
+    exit (1);
+}
+
+int
+main (int argc, char **argv)
+{
+    bench_result_st   res;
+    const char       *wname, *trace, *only, *save;
+    uint64_t          nevents;
+    uint32_t          nthreads;
+    size_t            i;
+    int               c;
+
+    wname = "trie";
+    trace = only = save = NULL;
+    nevents = 1000000;
+    nthreads = 1;
+    srand (1);
+
+    while ((c = getopt (argc, argv, "w:t:n:T:a:m:o:s:")) != -1) {
+        switch (c) {
+        case 'w': wname = optarg; break;
+        case 't': trace = optarg; break;
+        case 'n': nevents = strtoull (optarg, NULL, 0); break;
+        case 'T': nthreads = atoi (optarg); break;
+        case 'a': only = optarg; break;
+        case 'm': arena_bytes_g = strtoull (optarg, NULL, 0) << 20; break;
+        case 'o': save = optarg; break;
+        case 's': srand (atoi (optarg)); break;
+        default: usage (argv[0]);
+        }
+    }
+    if (nthreads < 1 || nthreads > BENCH_MAX_THREADS)
+        usage (argv[0]);
+
+    if (trace) {
+        if (workload_load (&workload_g, trace) != 0)
+            return (1);
+        wname = trace;
+    } else if (strcmp (wname, "trie") == 0) {
+        workload_trie (&workload_g, nevents, nthreads);
+    } else if (strcmp (wname, "jobs") == 0) {
+        workload_jobs (&workload_g, nevents, nthreads);
+    } else if (strcmp (wname, "churn") == 0) {
+        workload_churn (&workload_g, nevents, nthreads);
+    } else {
+        usage (argv[0]);
+    }
+
+    if (save && workload_save (&workload_g, save) != 0)
+        return (1);
+
+    printf ("workload %s: %" PRIu64 " events, %u objects, %u threads\n",
+            wname, workload_g.nevents, workload_g.nobjects,
+            workload_g.nthreads);
+
+    for (i = 0; i < NUM_ALLOCATORS; i++) {
+        if (only && strcmp (only, allocators_g[i].name) != 0)
+            continue;
+        if (run_allocator (&allocators_g[i], &res) != 0) {
+            fprintf (stderr, "%s: replay failed\n", allocators_g[i].name);
+            continue;
+        }
+        print_result (&res);
+    }
+    return (0);
+}
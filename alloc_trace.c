@@ -0,0 +1,110 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "alloc_trace.h"
+
+/*
+ * The recorder runs inside malloc, so it must not allocate.
+ * Events are buffered in a static array and written out with
+ * write(2) when it fills up.
+ */
+#define  TRACE_BUF_EVENTS     4096
+
+static alloc_trace_event_st  trace_buf_g[TRACE_BUF_EVENTS];
+static uint32_t              trace_count_g;
+static int                   trace_fd_g = -1;
+static pthread_mutex_t       trace_lock_g = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread uint32_t     trace_tid;
+
+/*
+ * trace_flush
+ *
+ * Writes out the buffered events, the lock is held.
+ */
+static void
+trace_flush ()
+{
+    char     *p;
+    size_t    left;
+    ssize_t   n;
+
+    p = (char *) trace_buf_g;
+    left = trace_count_g * sizeof(alloc_trace_event_st);
+    while (left > 0) {
+        n = write (trace_fd_g, p, left);
+        if (n <= 0)
+            break;
+        p += n;
+        left -= n;
+    }
+    trace_count_g = 0;
+}
+
+/*
+ * alloc_trace_open
+ *
+ * Starts recording to path.
+ */
+int
+alloc_trace_open (const char *path)
+{
+    alloc_trace_header_st  hdr;
+
+    trace_fd_g = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd_g < 0)
+        return (-1);
+
+    hdr.magic = ALLOC_TRACE_MAGIC;
+    hdr.version = ALLOC_TRACE_VERSION;
+    if (write (trace_fd_g, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        close (trace_fd_g);
+        trace_fd_g = -1;
+        return (-1);
+    }
+    return (0);
+}
+
+void
+alloc_trace_record (alloc_trace_op_e op, uint64_t size,
+                    void *addr, void *old_addr)
+{
+    alloc_trace_event_st  *ev;
+
+    if (trace_fd_g < 0)
+        return;
+
+    if (!trace_tid)
+        trace_tid = (uint32_t) syscall (SYS_gettid);
+
+    pthread_mutex_lock (&trace_lock_g);
+    ev = &trace_buf_g[trace_count_g++];
+    ev->op = (uint8_t) op;
+    ev->pad[0] = ev->pad[1] = ev->pad[2] = 0;
+    ev->thread = trace_tid;
+    ev->size = size;
+    ev->addr = (uint64_t) (uintptr_t) addr;
+    ev->old_addr = (uint64_t) (uintptr_t) old_addr;
+    if (trace_count_g == TRACE_BUF_EVENTS)
+        trace_flush ();
+    pthread_mutex_unlock (&trace_lock_g);
+}
+
+/*
+ * alloc_trace_close
+ *
+ * Flushes what is left and stops recording.
+ */
+void
+alloc_trace_close ()
+{
+    pthread_mutex_lock (&trace_lock_g);
+    if (trace_fd_g >= 0) {
+        trace_flush ();
+        close (trace_fd_g);
+        trace_fd_g = -1;
+    }
+    pthread_mutex_unlock (&trace_lock_g);
+}
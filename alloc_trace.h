@@ -0,0 +1,45 @@
+#ifndef __ALLOC_TRACE_H__
+#define __ALLOC_TRACE_H__
+
+/*
+ * Allocation traces.
+ * A trace file is a header followed by fixed size events in the
+ * order the calls happened.  An object's lifetime runs from the
+ * event that returned its address to the event that freed it.
+ *
+ * The LD_PRELOAD shim (mem_alloc_preload.c) records a trace of the
+ * program it runs when MEM_ALLOC_TRACE names the output file, and
+ * alloc_bench replays it against each allocator.
+ */
+
+#include <stdint.h>
+
+#define  ALLOC_TRACE_MAGIC     0x43525441     /* "ATRC" */
+#define  ALLOC_TRACE_VERSION   1
+
+typedef enum {
+    ALLOC_TRACE_ALLOC = 1,
+    ALLOC_TRACE_FREE,
+    ALLOC_TRACE_REALLOC
+} alloc_trace_op_e;
+
+typedef struct _alloc_trace_header_st {
+    uint32_t      magic;
+    uint32_t      version;
+} alloc_trace_header_st;
+
+typedef struct _alloc_trace_event_st {
+    uint8_t       op;          /* alloc_trace_op_e */
+    uint8_t       pad[3];
+    uint32_t      thread;      /* tid of the caller */
+    uint64_t      size;        /* requested, 0 for a free */
+    uint64_t      addr;        /* returned or freed */
+    uint64_t      old_addr;    /* realloc'd from */
+} alloc_trace_event_st;
+
+int alloc_trace_open (const char *path);
+void alloc_trace_record (alloc_trace_op_e op, uint64_t size,
+                         void *addr, void *old_addr);
+void alloc_trace_close ();
+
+#endif
@@ -1,10 +1,19 @@
+
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include "buddy_alloc.h"
+#include "fls.h"
 
-/* 
+#ifndef MIN
+#define MIN(a, b)    ((a) < (b) ? (a) : (b))
+#endif
+
+/*
  * global memory manager data
  */
-dlist_st    freelists_g[MAX_BLOCK_SIZE];
-boolean     mem_init_g;
+buddy_arena_st  buddy_arena_g;
+boolean         mem_init_g;
 
 /*
  * get_real_size
@@ -12,10 +21,10 @@ boolean     mem_init_g;
  * Adjusts the size of the chunk by adding
  * the overhead and alignment and return the real size.
  */
-uint 
-get_real_size (uint chunk)
+uint64_t
+get_real_size (uint64_t chunk)
 {
-    uint  new_size;
+    uint64_t  new_size;
 
     if (chunk < MIN_SIZE_REQUIRED)
         chunk = MIN_SIZE_REQUIRED;
@@ -23,6 +32,30 @@ get_real_size (uint chunk)
     return (new_size);
 }
 
+/*
+ * get_order
+ *
+ * the least integer i such that 2^i >= size.
+ */
+static inline uint
+get_order (uint64_t size)
+{
+    if (size <= 1)
+        return (0);
+    return (TLSF_fls64 (size - 1) + 1);
+}
+
+/*
+ * buddy_get_order
+ *
+ * The order of the block that serves a request of size bytes.
+ */
+uint
+buddy_get_order (uint64_t size)
+{
+    return (get_order (get_real_size (size)));
+}
+
 /*
  * log_error
  *
@@ -34,18 +67,238 @@ log_error (char *err_msg)
     fprintf (stderr, "%s\n", err_msg);
 }
 
+/*
+ * in_arena
+ *
+ * Checks that a block of size 2^i lies entirely inside the arena.
+ */
+static inline boolean
+in_arena (buddy_arena_st *arena, uchar *block, uint i)
+{
+    return (block >= arena->base &&
+            (uint64_t) (block - arena->base) + BLOCKSIZE(i) <= arena->size);
+}
+
+/*
+ * block_index
+ *
+ * The bit number of a block of size 2^i in freemaps[i].
+ */
+static inline uint64_t
+block_index (buddy_arena_st *arena, uchar *block, uint i)
+{
+    return ((uint64_t) (block - arena->base) >> i);
+}
+
+#ifndef BUDDY_NO_STATS
+/*
+ * stats_alloc
+ *
+ * Accounts for a block of order i handed out for a request
+ * that get_real_size() made real bytes.
+ */
+static inline void
+stats_alloc (buddy_arena_st *arena, uint i, uint64_t real)
+{
+    buddy_stats_st        *st;
+    buddy_order_stats_st  *os;
+
+    st = &arena->stats;
+    os = &st->orders[i];
+    os->allocs++;
+    if (++os->in_use > os->in_use_high)
+        os->in_use_high = os->in_use;
+
+    st->bytes_in_use += BLOCKSIZE(i);
+    st->bytes_requested += real;
+    st->rounding_waste += BLOCKSIZE(i) - real;
+    if (st->bytes_in_use > st->bytes_in_use_high)
+        st->bytes_in_use_high = st->bytes_in_use;
+    if (st->rounding_waste > st->rounding_waste_high)
+        st->rounding_waste_high = st->rounding_waste;
+}
+
+/*
+ * stats_free
+ *
+ * Accounts for a block of order i given back.
+ */
+static inline void
+stats_free (buddy_arena_st *arena, uint i, uint64_t real)
+{
+    buddy_stats_st        *st;
+    buddy_order_stats_st  *os;
+
+    st = &arena->stats;
+    os = &st->orders[i];
+    os->frees++;
+    os->in_use--;
+
+    st->bytes_in_use -= BLOCKSIZE(i);
+    st->bytes_requested -= real;
+    st->rounding_waste -= BLOCKSIZE(i) - real;
+}
+#endif
+
+/*
+ * mark_alloc
+ *
+ * Records a block of order i allocated for size bytes in the
+ * order map.
+ */
+static inline void
+mark_alloc (buddy_arena_st *arena, uchar *block, uint i, uint64_t size)
+{
+    uchar     *m;
+    uint64_t   real, slack, span, k;
+
+    real = get_real_size (size);
+    if (real > BLOCKSIZE(i))
+        real = BLOCKSIZE(i);
+    m = &arena->ordermap[(uint64_t) (block - arena->base) >> arena->min_order];
+    m[0] = (uchar) (i + 1);
+    slack = (BLOCKSIZE(i) - real) >> 3;
+    span = BLOCKSIZE(i - arena->min_order);
+    for (k = 1; slack && k < span; k++) {
+        m[k] = ORDERMAP_SLACK | (slack & 0x7f);
+        slack >>= 7;
+    }
+    BUDDY_STAT(stats_alloc (arena, i, real));
+}
+
+/*
+ * lookup_alloc
+ *
+ * The order and real size of the allocated block at block,
+ * -1 if no allocated block starts there.
+ */
+static int
+lookup_alloc (buddy_arena_st *arena, uchar *block, uint *order,
+              uint64_t *real)
+{
+    uchar     *m;
+    uint64_t   off, slack, span, k;
+    uint       i;
+
+    off = (uint64_t) (block - arena->base);
+    if (block < arena->base || off >= arena->size ||
+        (off & (BLOCKSIZE(arena->min_order) - 1)))
+        return (-1);
+
+    m = &arena->ordermap[off >> arena->min_order];
+    if (m[0] == 0 || m[0] > MAX_BLOCK_SIZE)
+        return (-1);
+    i = m[0] - 1;
+    if (i < arena->min_order || i > arena->top_order ||
+        (off & (BLOCKSIZE(i) - 1)) || off + BLOCKSIZE(i) > arena->size)
+        return (-1);
+
+    slack = 0;
+    span = BLOCKSIZE(i - arena->min_order);
+    for (k = 1; k < span && k < 10 && (m[k] & ORDERMAP_SLACK); k++)
+        slack |= (uint64_t) (m[k] & 0x7f) << (7 * (k - 1));
+
+    *order = i;
+    *real = BLOCKSIZE(i) - (slack << 3);
+    return (0);
+}
+
+/*
+ * mark_free
+ *
+ * Takes an allocated block of order i out of the order map.
+ */
+static inline void
+mark_free (buddy_arena_st *arena, uchar *block, uint i, uint64_t real)
+{
+    uchar     *m;
+    uint64_t   span, k;
+
+    m = &arena->ordermap[(uint64_t) (block - arena->base) >> arena->min_order];
+    m[0] = 0;
+    span = BLOCKSIZE(i - arena->min_order);
+    for (k = 1; k < span && (m[k] & ORDERMAP_SLACK); k++)
+        m[k] = 0;
+    BUDDY_STAT(stats_free (arena, i, real));
+}
+
+/*
+ * lazy_taken
+ *
+ * A block left freelists[i].  Deferred frees go on the head, so
+ * one taken from the head most likely was one.  Either way there
+ * cannot be more deferred frees than blocks on the list.
+ */
+static inline void
+lazy_taken (buddy_arena_st *arena, uint i, boolean head)
+{
+    if (arena->lazy_count[i] &&
+        (head || arena->lazy_count[i] > arena->freelists[i].count)) {
+        arena->lazy_count[i]--;
+        arena->lazy_pending--;
+    }
+}
+
+/*
+ * trim_range
+ *
+ * The pages of a free block of order i that a trim releases:
+ * the whole pages past its free list node.  Returns their length.
+ */
+static inline uint64_t
+trim_range (buddy_arena_st *arena, uchar *block, uint i, uchar **start)
+{
+    uintptr_t  page, lo, hi;
+
+    page = (arena->flags & BUDDY_ARENA_HUGETLB) ? BUDDY_HUGE_PAGE_SIZE :
+           (uintptr_t) getpagesize ();
+    lo = ((uintptr_t) block + MIN_SIZE_REQUIRED + page - 1) & ~(page - 1);
+    hi = ((uintptr_t) block + BLOCKSIZE(i)) & ~(page - 1);
+    *start = (uchar *) lo;
+    return (hi > lo ? (uint64_t) (hi - lo) : 0);
+}
+
+/*
+ * trim_taken
+ *
+ * A block left freelists[i], if it was trimmed its pages are
+ * about to be used again.
+ */
+static inline void
+trim_taken (buddy_arena_st *arena, uchar *block, uint i)
+{
+    uchar  *m, *start;
+
+    if (!arena->trimmed || i < BUDDY_TRIM_MIN_ORDER)
+        return;
+    m = &arena->ordermap[(uint64_t) (block - arena->base) >> arena->min_order];
+    if (*m == ORDERMAP_TRIMMED) {
+        *m = 0;
+        arena->trimmed -= trim_range (arena, block, i, &start);
+    }
+}
+
 /*
  * get_free_block
  *
  * returns a free block of size 2^i from the freelists
  */
 uchar *
-get_free_block (uint i)
+get_free_block (buddy_arena_st *arena, uint i)
 {
-    dlist_st  *dlist;
+    clist_st  *list;
+    uchar     *block;
 
-    dlist = &freelists_g[i];
-    return ((uchar *) dlist_dequeue_head(dlist));
+    list = &arena->freelists[i];
+    block = (uchar *) clist_pop_head (list);
+    if (block) {
+        BITMAP_CLEAR(arena->freemaps[i], block_index(arena, block, i));
+        if (list->count == 0)
+            arena->avail_mask &= ~BLOCKSIZE(i);
+        lazy_taken (arena, i, TRUE);
+        trim_taken (arena, block, i);
+    }
+    return (block);
 }
 
 /*
@@ -54,14 +307,12 @@ get_free_block (uint i)
  * puts a free block into the doubly linked freelist.
  */
 int
-put_free_block(uchar *buddy, uint i)
+put_free_block (buddy_arena_st *arena, uchar *buddy, uint i)
 {
-    dlist_st  *dlist;
-    node_st   *node;
-
-    dlist = &freelists_g[i];
-    node = (node_st *) buddy;
-    return (dlist_enqueue (dlist, node));
+    BITMAP_SET(arena->freemaps[i], block_index(arena, buddy, i));
+    arena->avail_mask |= BLOCKSIZE(i);
+    clist_push_head (&arena->freelists[i], (node_st *) buddy);
+    return (0);
 }
 
 /*
@@ -71,162 +322,973 @@ put_free_block(uchar *buddy, uint i)
  * Most likely we are coalescing 2 buddies.
  */
 int
-delete_free_block (uchar *buddy, uint i)
+delete_free_block (buddy_arena_st *arena, uchar *buddy, uint i)
 {
-    dlist_st  *dlist;
-    node_st   *node;
+    clist_st  *list;
 
-    dlist = &freelists_g[i];
-    node = (node_st *) buddy;
-    return (dlist_dequeue (dlist, node));
+    list = &arena->freelists[i];
+    BITMAP_CLEAR(arena->freemaps[i], block_index(arena, buddy, i));
+    clist_unlink (list, (node_st *) buddy);
+    if (list->count == 0)
+        arena->avail_mask &= ~BLOCKSIZE(i);
+    lazy_taken (arena, i, FALSE);
+    trim_taken (arena, buddy, i);
+    return (0);
 }
 
 /*
  * is_available
  *
- * Walks the free list and checks to see if a block of memory is available.
+ * Checks the free bitmap to see if a block of memory is available.
  */
 int
-is_available (uchar *buddy, uint i)
+is_available (buddy_arena_st *arena, uchar *buddy, uint i)
 {
-    dlist_st  *dlist;
-    node_st   *node;
+    if (!in_arena(arena, buddy, i))
+        return (0);
+    return (BITMAP_TEST(arena->freemaps[i], block_index(arena, buddy, i)));
+}
+
+/*
+ * free_freemaps
+ *
+ * Releases the per order free bitmaps and the order map.
+ */
+static void
+free_freemaps (buddy_arena_st *arena)
+{
+    uint   i;
 
-    dlist = &freelists_g[i];
-    node = (node_st *) buddy;
-    return (dlist_find_node (dlist, dlist_ptr_cmp, node) != NULL);
+    for (i = 0; i < MAX_BLOCK_SIZE; i++) {
+        free (arena->freemaps[i]);
+        arena->freemaps[i] = NULL;
+    }
+    if (arena->ordermap)
+        munmap (arena->ordermap, arena->ordermap_len);
+    arena->ordermap = NULL;
+    arena->ordermap_len = 0;
 }
 
 /*
- * buddy_alloc_init
+ * alloc_freemaps
  *
- * Initialize the buddy allocation system.
+ * Allocates a free bitmap per order covering the whole arena,
+ * and the order map.  The order map is mmap'd, only the pages
+ * that blocks were allocated from get memory.
+ */
+static int
+alloc_freemaps (buddy_arena_st *arena)
+{
+    uint   i;
+
+    arena->ordermap_len = (arena->size >> arena->min_order) + 1;
+    arena->ordermap = (uchar *) mmap (NULL, arena->ordermap_len,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+            -1, 0);
+    if (arena->ordermap == MAP_FAILED) {
+        arena->ordermap = NULL;
+        return (-1);
+    }
+
+    for (i = 0; i <= arena->top_order; i++) {
+        arena->freemaps[i] = (uint64_t *) calloc (
+                BITMAP_WORDS((arena->size >> i) + 1), sizeof(uint64_t));
+        if (!arena->freemaps[i]) {
+            free_freemaps (arena);
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+/*
+ * buddy_arena_init_mem
+ *
+ * Puts a pool of memory under buddy management.  The pool is
+ * carved into the largest blocks that are aligned to their size
+ * relative to the start of the pool.  The pool stays the caller's,
+ * buddy_arena_destroy() does not free it.
  */
 int
-buddy_alloc_init ()
+buddy_arena_init_mem (buddy_arena_st *arena, uchar *buf, uint64_t size)
 {
+    uint64_t   offset;
     uint       i;
-    dlist_st  *dlist_i;
+
+    if (!arena || !buf)
+        return (-1);
+
+    size &= ~((uint64_t) MIN_SIZE_REQUIRED - 1);
+    if (size < MIN_SIZE_REQUIRED)
+        return (-1);
+
+    arena->base = buf;
+    arena->size = size;
+    arena->top_order = TLSF_fls64 (size);
+    arena->min_order = buddy_get_order (1);
+    arena->avail_mask = 0;
+    arena->lazy_watermark = 0;
+    arena->lazy_pending = 0;
+    memset (arena->lazy_count, 0, sizeof(arena->lazy_count));
+    arena->trimmed = 0;
+    arena->flags = 0;
+    arena->map_addr = NULL;
+    arena->map_len = 0;
+    memset (&arena->stats, 0, sizeof(arena->stats));
+    arena->stats.size = size;
+    arena->stats.top_order = arena->top_order;
 
     for (i = 0; i < MAX_BLOCK_SIZE; i++) {
-        dlist_i = &(freelists_g[i]);
-        dlist_init (&dlist_i, NULL, NULL);
+        clist_init (&arena->freelists[i]);
+        arena->freemaps[i] = NULL;
+    }
+    arena->ordermap = NULL;
+
+    if (alloc_freemaps (arena) != 0)
+        return (-1);
+
+    /*
+     * the offset of each block is a multiple of its size, the
+     * largest such block always comes first.
+     */
+    for (offset = 0; size - offset >= MIN_SIZE_REQUIRED; ) {
+        i = TLSF_fls64 (size - offset);
+        if (offset)
+            i = MIN(i, (uint) TLSF_ffs64 (offset));
+        put_free_block (arena, buf + offset, i);
+        offset += BLOCKSIZE(i);
     }
-    mem_init_g = 1;
     return (0);
 }
 
-int 
-buddy_alloc_chunk (uint chunk_size)
+/*
+ * map_arena
+ *
+ * Reserves size bytes with mmap, aligned to align.  The unaligned
+ * head and tail of the reservation are given back.
+ */
+static uchar *
+map_arena (uint64_t size, uint64_t align, uint flags)
+{
+    uchar     *addr, *aligned, *p;
+    uint64_t   len;
+    int        mflags;
+
+    len = size + align;
+    addr = (uchar *) mmap (NULL, len, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED)
+        return (NULL);
+
+    aligned = (uchar *) (((uintptr_t) addr + align - 1) & ~(align - 1));
+    if (aligned != addr)
+        munmap (addr, aligned - addr);
+    if (aligned + size != addr + len)
+        munmap (aligned + size, (addr + len) - (aligned + size));
+
+    mflags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED;
+#ifdef MAP_HUGETLB
+    if (flags & BUDDY_ARENA_HUGETLB) {
+        p = (uchar *) mmap (aligned, size, PROT_READ | PROT_WRITE,
+                mflags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return (p);
+        log_error ("MAP_HUGETLB failed, falling back to regular pages");
+    }
+#endif
+
+    p = (uchar *) mmap (aligned, size, PROT_READ | PROT_WRITE, mflags, -1, 0);
+    if (p == MAP_FAILED) {
+        munmap (aligned, size);
+        return (NULL);
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (flags & (BUDDY_ARENA_THP | BUDDY_ARENA_HUGETLB))
+        madvise (p, size, MADV_HUGEPAGE);
+#endif
+    return (p);
+}
+
+/*
+ * buddy_map_arena
+ *
+ * Maps a pool for an arena of *size bytes, aligned to its top
+ * order.  With BUDDY_ARENA_HUGETLB *size is rounded up to whole
+ * huge pages.
+ */
+uchar *
+buddy_map_arena (uint64_t *size, uint flags)
 {
-    uint   real_size, i;
-    uchar *buf;
+    uint64_t   align;
 
-    real_size = get_real_size (chunk_size);
-    buf = (uchar *) malloc (real_size * sizeof(uchar));
+    if (flags & BUDDY_ARENA_HUGETLB)
+        *size = (*size + BUDDY_HUGE_PAGE_SIZE - 1) &
+                ~((uint64_t) BUDDY_HUGE_PAGE_SIZE - 1);
+
+    align = BLOCKSIZE(TLSF_fls64 (*size));
+    if (align < (uint64_t) getpagesize ())
+        align = getpagesize ();
+
+    return (map_arena (*size, align, flags));
+}
+
+/*
+ * buddy_arena_init
+ *
+ * Reserve an arena of size bytes with mmap, aligned to its top
+ * order, and put it under buddy management.
+ */
+int
+buddy_arena_init (buddy_arena_st *arena, uint64_t size, uint flags)
+{
+    uchar     *buf;
+
+    if (!arena || size < MIN_SIZE_REQUIRED)
+        return (-1);
+
+    buf = buddy_map_arena (&size, flags);
     if (!buf) {
+        log_error ("unable to map the buddy arena");
         return (-1);
     }
 
-    for (i = 0; BLOCKSIZE(i) < real_size; i++) {
-        ;
+    if (buddy_arena_init_mem (arena, buf, size) != 0) {
+        munmap (buf, size);
+        return (-1);
     }
-    put_free_block(buf, i);
+    arena->flags = flags;
+    arena->map_addr = buf;
+    arena->map_len = size;
     return (0);
 }
 
-unsigned char* 
-buddy_alloc (int size)
+/*
+ * buddy_arena_destroy
+ *
+ * Gives the pool back, all the blocks of the arena become invalid.
+ */
+void
+buddy_arena_destroy (buddy_arena_st *arena)
 {
-    uint   i, real_size;
-    uchar *block, *buddy;
+    if (!arena || !arena->base)
+        return;
 
-    real_size = get_real_size(size);
+    if (arena->flags & BUDDY_ARENA_MALLOC)
+        free (arena->map_addr);
+    else if (arena->map_addr)
+        munmap (arena->map_addr, arena->map_len);
 
-    /* 
-     * compute i as the least integer such that i >= log2(size) 
-     */
-    for (i = 0; BLOCKSIZE(i) < real_size; i++);
+    free_freemaps (arena);
+    memset (arena, 0, sizeof(buddy_arena_st));
+}
+
+/*
+ * buddy_arena_alloc
+ *
+ * Finds the smallest non-empty free list that fits the request
+ * and splits it down to the right size.
+ */
+unsigned char*
+buddy_arena_alloc (buddy_arena_st *arena, uint64_t size)
+{
+    uint       i, j;
+    uint64_t   avail;
+    uchar     *block, *buddy;
 
-    if (i >= MAX_BLOCK_SIZE) {
+    /*
+     * compute i as the least integer such that i >= log2(size)
+     */
+    i = buddy_get_order (size);
+    if (i > arena->top_order) {
+        BUDDY_STAT(arena->stats.failed_allocs++);
         log_error ( "no space available" );
         return (NULL);
-    } else if (freelists_g[i].count != 0) {
-
-        /* 
-         * we already have the right size block on hand 
-         */
-        block = get_free_block(i);
-        return (block);
-
-    } else {
-
-        /* 
-         * we need to split a bigger block 
-         */ 
-        block = buddy_alloc(BLOCKSIZE(i + 1));
+    }
 
-        if (block != NULL) {
+    /*
+     * the first order >= i that has a free block.
+     */
+    avail = arena->avail_mask & ~(BLOCKSIZE(i) - 1);
+    if (!avail && arena->lazy_pending) {
+        buddy_arena_coalesce (arena);
+        avail = arena->avail_mask & ~(BLOCKSIZE(i) - 1);
+    }
+    if (!avail) {
+        BUDDY_STAT(arena->stats.failed_allocs++);
+        log_error ( "no space available" );
+        return (NULL);
+    }
+    j = TLSF_ffs64 (avail);
+    block = get_free_block (arena, j);
 
-            /* 
-             * split and put extra on a free list 
-             */ 
-             buddy = BUDDYOF(block, i);
-             put_free_block(buddy, i);
-        }
-        return (block);
+    /*
+     * split and put the upper halves on the free lists
+     */
+    while (j > i) {
+        BUDDY_STAT(arena->stats.orders[j].splits++);
+        j--;
+        buddy = BUDDYOF(arena->base, block, j);
+        put_free_block (arena, buddy, j);
     }
+    mark_alloc (arena, block, i, size);
+    return (block);
 }
 
 /*
  * coalesce
  *
  * In the buddy system coalesce returns the pointer
- * that is bigger. The 2 buddies join to become a bigger
- * size block.
+ * that is smaller. The 2 buddies join to become a bigger
+ * size block starting at the lower address.
  */
 uchar *
 coalesce(uchar *buddy_a, uchar *buddy_b)
 {
-    if (buddy_a > buddy_b)
+    if (buddy_a < buddy_b)
         return (buddy_a);
     return (buddy_b);
 }
 
+/*
+ * valid_block
+ *
+ * Checks that block is a block of order i of the arena.
+ */
+static inline boolean
+valid_block (buddy_arena_st *arena, uchar *block, uint i)
+{
+    return (in_arena(arena, block, i) &&
+            !((uint64_t) (block - arena->base) & (BLOCKSIZE(i) - 1)));
+}
+
+/*
+ * free_order
+ *
+ * Coalesces a free block of order i with its free buddies
+ * and puts the result on its free list.  In lazy mode the block
+ * just goes on the free list of its order.
+ */
+static int
+free_order (buddy_arena_st *arena, uchar *block, uint i)
+{
+    uchar *buddy;
+
+    if (arena->lazy_count[i] < arena->lazy_watermark) {
+        arena->lazy_count[i]++;
+        arena->lazy_pending++;
+        return (put_free_block(arena, block, i));
+    }
+
+    while (i < arena->top_order) {
+
+        /*
+         * get its buddy, if it is not free we are done.
+         */
+        buddy = BUDDYOF(arena->base, block, i);
+        if (!is_available(arena, buddy, i))
+            break;
+
+        /* buddy found, remove it from its free list */
+        delete_free_block(arena, buddy, i);
+
+        /* and continue with the block and its buddy as one block */
+        block = coalesce(block, buddy);
+        i++;
+        BUDDY_STAT(arena->stats.orders[i].coalesces++);
+    }
+
+    return (put_free_block(arena, block, i));
+}
+
+/*
+ * buddy_arena_coalesce
+ *
+ * Merges every pair of free buddies, from the smallest order up,
+ * so the blocks merged at one order are looked at again at the
+ * next.  Nothing is deferred afterwards.  Returns the number of
+ * merges.
+ */
+uint64_t
+buddy_arena_coalesce (buddy_arena_st *arena)
+{
+    clist_st  *list;
+    node_st   *node, *next;
+    uchar     *block, *buddy;
+    uint64_t   merges;
+    uint       i;
+
+    merges = 0;
+    for (i = 0; i < arena->top_order; i++) {
+        list = &arena->freelists[i];
+        for (node = list->sentinel.next; node != CLIST_END(list); node = next) {
+            next = node->next;
+            block = (uchar *) node;
+            buddy = BUDDYOF(arena->base, block, i);
+            if (!is_available(arena, buddy, i))
+                continue;
+
+            if ((node_st *) buddy == next)
+                next = next->next;
+            delete_free_block (arena, block, i);
+            delete_free_block (arena, buddy, i);
+            put_free_block (arena, coalesce(block, buddy), i + 1);
+            BUDDY_STAT(arena->stats.orders[i + 1].coalesces++);
+            merges++;
+        }
+    }
+    memset (arena->lazy_count, 0, sizeof(arena->lazy_count));
+    arena->lazy_pending = 0;
+    BUDDY_STAT(arena->stats.coalesce_passes++);
+    return (merges);
+}
+
+/*
+ * buddy_arena_set_lazy
+ *
+ * Turns lazy coalescing on with a watermark, or off with 0.
+ * Turning it off coalesces what was deferred.
+ */
+void
+buddy_arena_set_lazy (buddy_arena_st *arena, uint64_t watermark)
+{
+    arena->lazy_watermark = watermark;
+    if (!watermark && arena->lazy_pending)
+        buddy_arena_coalesce (arena);
+}
+
+/*
+ * buddy_arena_trim
+ *
+ * Gives the pages of the free blocks of BUDDY_TRIM_MIN_ORDER and up
+ * back to the kernel, after coalescing any deferred frees so they
+ * add up to such blocks.  Returns the bytes released by this pass.
+ */
+uint64_t
+buddy_arena_trim (buddy_arena_st *arena)
+{
+    node_st   *node;
+    uchar     *block, *start, *m;
+    uint64_t   released, len;
+    uint       i;
+    int        advice;
+
+    if (arena->lazy_pending)
+        buddy_arena_coalesce (arena);
+
+    advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+    if (arena->flags & BUDDY_ARENA_MADV_FREE)
+        advice = MADV_FREE;
+#endif
+
+    released = 0;
+    for (i = BUDDY_TRIM_MIN_ORDER; i <= arena->top_order; i++) {
+        CLIST_FOREACH(&arena->freelists[i], node) {
+            block = (uchar *) node;
+            m = &arena->ordermap[(uint64_t) (block - arena->base) >>
+                                 arena->min_order];
+            if (*m == ORDERMAP_TRIMMED)
+                continue;
+            len = trim_range (arena, block, i, &start);
+            if (!len || madvise (start, len, advice) != 0)
+                continue;
+            *m = ORDERMAP_TRIMMED;
+            arena->trimmed += len;
+            released += len;
+        }
+    }
+    BUDDY_STAT(arena->stats.bytes_released += released);
+    BUDDY_STAT(arena->stats.trim_passes++);
+    return (released);
+}
+
 /*
  * De-allocating a block of memory.
  * Coalesce with its buddy
  * Return to the appropriate free list.
  */
-int 
-buddy_dealloc (uchar *block, int size)
+int
+buddy_arena_dealloc (buddy_arena_st *arena, uchar *block, uint64_t size)
 {
-    uint   i;
-    uchar *p, *buddy;
+    uint       i, order;
+    uint64_t   real;
 
-    /* 
-     * compute i as the least integer such that i >= log2(size) 
-     */ 
-    for (i = 0; BLOCKSIZE(i) < size; i++);
+    /*
+     * compute i as the least integer such that i >= log2(size)
+     */
+    i = buddy_get_order (size);
+
+    if (!valid_block(arena, block, i)) {
+        log_error ( "block does not belong to the arena" );
+        return (-1);
+    }
+    if (lookup_alloc(arena, block, &order, &real) != 0 || order != i) {
+        log_error ( "block is not allocated" );
+        return (-1);
+    }
+    mark_free (arena, block, i, real);
+
+    return (free_order(arena, block, i));
+}
+
+/*
+ * put_free_range
+ *
+ * Puts the free range [start, end) of the arena on the free lists
+ * as the largest aligned blocks it holds.  end is aligned to a
+ * block larger than the range, so none of these blocks has a free
+ * buddy.
+ */
+static void
+put_free_range (buddy_arena_st *arena, uint64_t start, uint64_t end)
+{
+    uint   i, a;
+
+    while (start < end) {
+        i = TLSF_fls64 (end - start);
+        a = TLSF_ffs64 (start);
+        if (start && a < i)
+            i = a;
+        put_free_block (arena, arena->base + start, i);
+        start += BLOCKSIZE(i);
+    }
+}
+
+/*
+ * buddy_arena_alloc_bulk
+ *
+ * Allocates up to n blocks for requests of size bytes into out[]
+ * and returns how many it got.  The free blocks of the right order
+ * are used first.  Then a larger block is carved into as many
+ * adjacent blocks as are still needed, and only what is left of it
+ * goes back on the free lists.  So a split chain is walked once per
+ * large block, not once per allocation.
+ */
+uint
+buddy_arena_alloc_bulk (buddy_arena_st *arena, uint64_t size, uint n,
+                        uchar **out)
+{
+    uint       i, j, got;
+    uint64_t   avail, start, take, k;
+    uchar     *block;
 
-    /* 
-     * get its buddy 
+    i = buddy_get_order (size);
+    if (i > arena->top_order || n == 0)
+        return (0);
+
+    for (got = 0; got < n; got++) {
+        block = get_free_block (arena, i);
+        if (!block)
+            break;
+        out[got] = block;
+        mark_alloc (arena, block, i, size);
+    }
+
+    while (got < n) {
+        avail = arena->avail_mask & ~(BLOCKSIZE(i + 1) - 1);
+        if (!avail && arena->lazy_pending) {
+            buddy_arena_coalesce (arena);
+            avail = arena->avail_mask & ~(BLOCKSIZE(i + 1) - 1);
+        }
+        if (!avail) {
+            BUDDY_STAT(arena->stats.failed_allocs++);
+            break;
+        }
+        j = TLSF_ffs64 (avail);
+        block = get_free_block (arena, j);
+        start = (uint64_t) (block - arena->base);
+
+        take = BLOCKSIZE(j - i);
+        if (take > n - got)
+            take = n - got;
+        for (k = 0; k < take; k++) {
+            out[got] = block + (k << i);
+            mark_alloc (arena, out[got++], i, size);
+        }
+        put_free_range (arena, start + (take << i), start + BLOCKSIZE(j));
+
+#ifndef BUDDY_NO_STATS
+        /*
+         * a block of order l was split if it held one we took.
+         */
+        for (k = j; k > i; k--)
+            arena->stats.orders[k].splits +=
+                ((take << i) + BLOCKSIZE(k) - 1) >> k;
+#endif
+    }
+    return (got);
+}
+
+static int
+cmp_block (const void *a, const void *b)
+{
+    uchar  *x = *(uchar * const *) a, *y = *(uchar * const *) b;
+
+    return (x < y ? -1 : x > y);
+}
+
+/*
+ * buddy_arena_dealloc_bulk
+ *
+ * Frees n blocks that were all allocated for requests of size
+ * bytes.  blocks[] is sorted in place.  Buddies that are both in
+ * the batch are merged in the array, order by order, without
+ * touching the free lists.  Only what cannot be merged there goes
+ * through the free lists and their coalescing.
+ */
+int
+buddy_arena_dealloc_bulk (buddy_arena_st *arena, uchar **blocks, uint n,
+                          uint64_t size)
+{
+    uint       i, r, w, order;
+    uint64_t   real;
+    int        status;
+    uchar     *block;
+
+    i = buddy_get_order (size);
+    status = 0;
+
+    /*
+     * drop what does not belong to the arena.
      */
-    buddy = BUDDYOF(block, i);
+    for (r = w = 0; r < n; r++) {
+        if (!valid_block(arena, blocks[r], i)) {
+            log_error ( "block does not belong to the arena" );
+            status = -1;
+            continue;
+        }
+        if (lookup_alloc(arena, blocks[r], &order, &real) != 0 || order != i) {
+            log_error ( "block is not allocated" );
+            status = -1;
+            continue;
+        }
+        mark_free (arena, blocks[r], i, real);
+        blocks[w++] = blocks[r];
+    }
+    n = w;
+    qsort (blocks, n, sizeof(uchar *), cmp_block);
+
+    while (n > 0) {
+        for (r = w = 0; r < n; r++) {
+            block = blocks[r];
+            if (i < arena->top_order && r + 1 < n &&
+                !((uint64_t) (block - arena->base) & BLOCKSIZE(i)) &&
+                blocks[r + 1] == BUDDYOF(arena->base, block, i)) {
+                blocks[w++] = block;
+                BUDDY_STAT(arena->stats.orders[i + 1].coalesces++);
+                r++;
+                continue;
+            }
+            free_order (arena, block, i);
+        }
+        n = w;
+        i++;
+    }
+    return (status);
+}
+
+/*
+ * buddy_arena_free
+ *
+ * Frees a block without its size, the order map knows it.
+ */
+int
+buddy_arena_free (buddy_arena_st *arena, uchar *block)
+{
+    uint       i;
+    uint64_t   real;
 
-    /* 
-     * see if this block's buddy is free. 
-     * buddy not free, put block on its free list 
-     */ 
-    if (!is_available(buddy, i)) {
-        put_free_block(buddy, i);
-        return 0;
+    if (lookup_alloc(arena, block, &i, &real) != 0) {
+        log_error ( "block is not allocated" );
+        return (-1);
     }
+    mark_free (arena, block, i, real);
+    return (free_order(arena, block, i));
+}
+
+/*
+ * buddy_arena_usable_size
+ *
+ * The size of the block, 0 if it is not allocated.
+ */
+uint64_t
+buddy_arena_usable_size (buddy_arena_st *arena, uchar *block)
+{
+    uint       i;
+    uint64_t   real;
+
+    if (lookup_alloc(arena, block, &i, &real) != 0)
+        return (0);
+    return (BLOCKSIZE(i));
+}
+
+/*
+ * can_grow
+ *
+ * A block of order i can grow to order j in place when it is the
+ * lower half at every order in between and all the upper halves
+ * are free.
+ */
+static boolean
+can_grow (buddy_arena_st *arena, uchar *block, uint i, uint j)
+{
+    uint64_t   off;
 
-    /* buddy found, remove it from its free list */
-    delete_free_block(buddy, i);
+    off = (uint64_t) (block - arena->base);
+    if (j > arena->top_order || (off & (BLOCKSIZE(j) - 1)) ||
+        off + BLOCKSIZE(j) > arena->size)
+        return (0);
 
-    /* deallocate the block and its buddy as one block */
-    return (buddy_dealloc (coalesce(block, buddy), BLOCKSIZE(i+1)));
+    for (; i < j; i++) {
+        if (!is_available(arena, block + BLOCKSIZE(i), i))
+            return (0);
+    }
+    return (1);
 }
 
+/*
+ * buddy_arena_realloc
+ *
+ * Resizes a block.  A block that shrinks gives its upper halves
+ * back.  A block that grows takes its free upper buddies, order by
+ * order.  Only when they are not free is the block moved.
+ */
+unsigned char*
+buddy_arena_realloc (buddy_arena_st *arena, uchar *block, uint64_t size)
+{
+    uint       i, j, k;
+    uint64_t   real;
+    uchar     *new_block;
+
+    if (!block)
+        return (buddy_arena_alloc (arena, size));
+    if (size == 0) {
+        buddy_arena_free (arena, block);
+        return (NULL);
+    }
+
+    if (lookup_alloc(arena, block, &i, &real) != 0) {
+        log_error ( "block is not allocated" );
+        return (NULL);
+    }
+    j = buddy_get_order (size);
+
+    if (j <= i) {
+        mark_free (arena, block, i, real);
+        for (k = i; k > j; k--) {
+            BUDDY_STAT(arena->stats.orders[k].splits++);
+            put_free_block (arena, block + BLOCKSIZE(k - 1), k - 1);
+        }
+        mark_alloc (arena, block, j, size);
+        return (block);
+    }
+
+    if (can_grow(arena, block, i, j)) {
+        mark_free (arena, block, i, real);
+        for (k = i; k < j; k++) {
+            delete_free_block (arena, block + BLOCKSIZE(k), k);
+            BUDDY_STAT(arena->stats.orders[k + 1].coalesces++);
+        }
+        mark_alloc (arena, block, j, size);
+        return (block);
+    }
+
+    new_block = buddy_arena_alloc (arena, size);
+    if (!new_block)
+        return (NULL);
+    memcpy (new_block, block, real);
+    buddy_arena_free (arena, block);
+    return (new_block);
+}
+
+/*
+ * buddy_arena_block_of
+ *
+ * Returns the start of the block of size 2^i that contains ptr.
+ */
+uchar *
+buddy_arena_block_of (buddy_arena_st *arena, uchar *ptr, uint i)
+{
+    return (arena->base +
+            ((uint64_t) (ptr - arena->base) & ~(BLOCKSIZE(i) - 1)));
+}
+
+/*
+ * buddy_arena_stats
+ *
+ * Takes a snapshot of the arena's statistics, with the free
+ * block counts filled in from the free lists.  The counting
+ * itself costs a few increments per call, everything else is
+ * only done here.  The caller holds whatever lock serializes
+ * the arena.
+ */
+void
+buddy_arena_stats (buddy_arena_st *arena, buddy_stats_st *snap)
+{
+    uint   i;
+
+    memcpy (snap, &arena->stats, sizeof(buddy_stats_st));
+    snap->deferred = arena->lazy_pending;
+    snap->bytes_trimmed = arena->trimmed;
+    snap->bytes_free = 0;
+    for (i = 0; i < MAX_BLOCK_SIZE; i++) {
+        snap->orders[i].free_blocks = arena->freelists[i].count;
+        snap->bytes_free += arena->freelists[i].count * BLOCKSIZE(i);
+    }
+}
+
+/*
+ * buddy_stats_print
+ *
+ * Dumps a snapshot, one line per order that has seen any use.
+ */
+void
+buddy_stats_print (FILE *fp, buddy_stats_st *snap)
+{
+    buddy_order_stats_st  *os;
+    uint                   i;
+
+    fprintf (fp, "arena %" PRIu64 " bytes, in use %" PRIu64
+             " (high %" PRIu64 "), free %" PRIu64 ", failed allocs %" PRIu64 "\n",
+             snap->size, snap->bytes_in_use, snap->bytes_in_use_high,
+             snap->bytes_free, snap->failed_allocs);
+    fprintf (fp, "requested %" PRIu64 ", rounding waste %" PRIu64
+             " (high %" PRIu64 ")\n",
+             snap->bytes_requested, snap->rounding_waste,
+             snap->rounding_waste_high);
+    if (snap->coalesce_passes || snap->deferred)
+        fprintf (fp, "deferred frees %" PRIu64 ", coalesce passes %" PRIu64 "\n",
+                 snap->deferred, snap->coalesce_passes);
+    if (snap->trim_passes)
+        fprintf (fp, "trimmed %" PRIu64 ", released %" PRIu64
+                 " in %" PRIu64 " trims\n",
+                 snap->bytes_trimmed, snap->bytes_released, snap->trim_passes);
+    fprintf (fp, "%5s %12s %12s %12s %12s %10s %10s %10s\n", "order",
+             "allocs", "frees", "splits", "coalesces", "free", "in use", "high");
+
+    for (i = 0; i <= snap->top_order && i < MAX_BLOCK_SIZE; i++) {
+        os = &snap->orders[i];
+        if (!os->allocs && !os->splits && !os->coalesces && !os->free_blocks)
+            continue;
+        fprintf (fp, "%5u %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+                 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+                 i, os->allocs, os->frees, os->splits, os->coalesces,
+                 os->free_blocks, os->in_use, os->in_use_high);
+    }
+}
+
+/*
+ * buddy_alloc_init
+ *
+ * Initialize the buddy allocation system.
+ */
+int
+buddy_alloc_init ()
+{
+    uint       i;
+
+    memset (&buddy_arena_g, 0, sizeof(buddy_arena_g));
+    for (i = 0; i < MAX_BLOCK_SIZE; i++)
+        clist_init (&buddy_arena_g.freelists[i]);
+    mem_init_g = 1;
+    return (0);
+}
+
+/*
+ * buddy_alloc_chunk
+ *
+ * Put a malloc'd pool of chunk_size bytes under the buddy system.
+ */
+int
+buddy_alloc_chunk (uint64_t chunk_size)
+{
+    uint64_t   real_size;
+    uchar     *buf;
+
+    real_size = get_real_size (chunk_size);
+    buf = (uchar *) malloc (real_size * sizeof(uchar));
+    if (!buf) {
+        return (-1);
+    }
+
+    if (buddy_arena_init_mem (&buddy_arena_g, buf, real_size) != 0) {
+        free (buf);
+        return (-1);
+    }
+    buddy_arena_g.flags = BUDDY_ARENA_MALLOC;
+    buddy_arena_g.map_addr = buf;
+    buddy_arena_g.map_len = real_size;
+    return (0);
+}
+
+/*
+ * buddy_alloc_arena
+ *
+ * Put an mmap'd pool of size bytes under the buddy system.
+ */
+int
+buddy_alloc_arena (uint64_t size, uint flags)
+{
+    return (buddy_arena_init (&buddy_arena_g, size, flags));
+}
+
+unsigned char*
+buddy_alloc (uint64_t size)
+{
+    return (buddy_arena_alloc (&buddy_arena_g, size));
+}
+
+int
+buddy_dealloc (uchar *block, uint64_t size)
+{
+    return (buddy_arena_dealloc (&buddy_arena_g, block, size));
+}
+
+int
+buddy_free (uchar *block)
+{
+    return (buddy_arena_free (&buddy_arena_g, block));
+}
+
+unsigned char*
+buddy_realloc (uchar *block, uint64_t size)
+{
+    return (buddy_arena_realloc (&buddy_arena_g, block, size));
+}
+
+void
+buddy_set_lazy (uint64_t watermark)
+{
+    buddy_arena_set_lazy (&buddy_arena_g, watermark);
+}
+
+uint64_t
+buddy_coalesce ()
+{
+    return (buddy_arena_coalesce (&buddy_arena_g));
+}
+
+uint64_t
+buddy_trim ()
+{
+    return (buddy_arena_trim (&buddy_arena_g));
+}
+
+uint
+buddy_alloc_bulk (uint64_t size, uint n, uchar **out)
+{
+    return (buddy_arena_alloc_bulk (&buddy_arena_g, size, n, out));
+}
+
+int
+buddy_dealloc_bulk (uchar **blocks, uint n, uint64_t size)
+{
+    return (buddy_arena_dealloc_bulk (&buddy_arena_g, blocks, n, size));
+}
+
+void
+buddy_stats (buddy_stats_st *snap)
+{
+    buddy_arena_stats (&buddy_arena_g, snap);
+}
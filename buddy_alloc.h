@@ -4,7 +4,7 @@
 #include <inttypes.h>
 
 
-/* 
+/*
  * The Buddy system ...
  * The idea of this method is to keep separate lists of
  * available blocks of each size 2 ^k, 0 <= k <= m.
@@ -13,25 +13,40 @@
  * when a block of 2^k words is desired, and if nothing of this size
  * is available, a larger available block is split into 2 equal parts;
  * ultimately a block of the right size 2^k will appear.
+ *
+ * All the buddy math is done on offsets from the arena base, so
+ * the pool does not have to be naturally aligned and can be
+ * larger than 4G.
  */
 
-#include "dlist.h"
+#include "clist.h"
+
+/*
+ * Orders go up to 2 pow (MAX_BLOCK_SIZE - 1).
+ * All memory blocks are aligned to 2 power k relative to the arena base.
+ */
+#define  MAX_BLOCK_SIZE         64
 
 /*
- * This is entire pool of memory space - 2 pow MAX_BLOCK_SIZE
- * All memory blocks are aligned to 2 power k
+ * blocks in freelists[i] are of size 2**i.
  */
-#define  MAX_BLOCK_SIZE         32
+#define BLOCKSIZE(i)            ((uint64_t) 1 << (i))
 
-/* 
- * blocks in freelists[i] are of size 2**i. 
+/*
+ * the address of the buddy of a block from freelists[i].
  */
-#define BLOCKSIZE(i)            (1 << (i))
+#define BUDDYOF(base,b,i)       (uchar *) ((base) + \
+                                 (((uint64_t) ((b) - (base))) ^ BLOCKSIZE(i)))
 
-/* 
- * the address of the buddy of a block from freelists[i]. 
- */ 
-#define BUDDYOF(b,i)           (uchar *) ( ((uint64_t) b) ^ (1 << (i)) )
+/*
+ * Free bitmaps, bit n of freemaps[i] is set when the block of size 2**i
+ * at offset (n << i) from the arena base is on freelists[i].
+ */
+#define BITMAP_WORD_BITS       64
+#define BITMAP_WORDS(nbits)    (((nbits) + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+#define BITMAP_TEST(m, n)      (((m)[(n) / BITMAP_WORD_BITS] >> ((n) % BITMAP_WORD_BITS)) & 1)
+#define BITMAP_SET(m, n)       ((m)[(n) / BITMAP_WORD_BITS] |= ((uint64_t) 1 << ((n) % BITMAP_WORD_BITS)))
+#define BITMAP_CLEAR(m, n)     ((m)[(n) / BITMAP_WORD_BITS] &= ~((uint64_t) 1 << ((n) % BITMAP_WORD_BITS)))
 
 #define GET(p)                 (*(uint64_t *)(p))
 #define PUT(p, val)            (*(uint64_t *)(p) = (val))
@@ -40,10 +55,144 @@
 #define  MIN_SIZE_REQUIRED     (sizeof (struct _node_st))
 #define  ROUND8(N)             (8 * ((N+7)/8))
 
-int buddy_alloc_init ();
-int buddy_alloc_chunk (uint chunk_size);
-unsigned char* buddy_alloc (int size);
-int buddy_dealloc (uchar *block, int size);
+/*
+ * The order map has a byte per block of the smallest order.  The
+ * byte of the first such block of an allocated block holds its
+ * order + 1, and the bytes after it hold what get_real_size()
+ * rounded up to, as the slack from the block size in 8 byte units,
+ * 7 bits per byte with ORDERMAP_SLACK set.  Every other byte is 0.
+ */
+#define  ORDERMAP_SLACK        0x80
+
+/*
+ * Lazy coalescing.  With a watermark set, a free only puts the
+ * block on its order's free list, where the next allocation of
+ * that order takes it back without any split.  Up to watermark
+ * blocks per order are kept that way, frees past it coalesce as
+ * usual.  When an allocation finds nothing, one pass over the free
+ * lists coalesces all the free buddies.
+ */
+#define  BUDDY_LAZY_WATERMARK  256
+
+/*
+ * Trimming.  A free block of order BUDDY_TRIM_MIN_ORDER or more has
+ * its pages given back to the kernel with madvise(2), all but the
+ * first one, which holds its free list node.  The address range
+ * stays reserved and the pages fault back in zero filled when the
+ * block is used again.  The order map byte of a trimmed free block
+ * is ORDERMAP_TRIMMED, so it is not released twice.
+ */
+#define  BUDDY_TRIM_MIN_ORDER  16
+#define  ORDERMAP_TRIMMED      0xff
 
+/*
+ * Arena flags.
+ */
+#define  BUDDY_ARENA_MALLOC    0x1   /* pool came from malloc */
+#define  BUDDY_ARENA_HUGETLB   0x2   /* back the pool with MAP_HUGETLB */
+#define  BUDDY_ARENA_THP       0x4   /* madvise the pool MADV_HUGEPAGE */
+#define  BUDDY_ARENA_MADV_FREE 0x8   /* trim with MADV_FREE, not MADV_DONTNEED */
+
+#define  BUDDY_HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+/*
+ * Statistics, kept as plain counters in the arena under whatever
+ * serializes the arena already.  Build with -DBUDDY_NO_STATS to
+ * compile the counting out.
+ */
+typedef struct _buddy_order_stats_st {
+    uint64_t      allocs;       /* blocks of this order handed out */
+    uint64_t      frees;        /* blocks of this order given back */
+    uint64_t      splits;       /* blocks of this order split in two */
+    uint64_t      coalesces;    /* buddy pairs merged into this order */
+    uint64_t      free_blocks;  /* on the free list, filled by a snapshot */
+    uint64_t      in_use;       /* allocated blocks of this order */
+    uint64_t      in_use_high;  /* high-water mark of in_use */
+} buddy_order_stats_st;
+
+typedef struct _buddy_stats_st {
+    uint64_t      size;              /* bytes under management */
+    uint          top_order;
+    uint64_t      bytes_in_use;      /* sum of the allocated block sizes */
+    uint64_t      bytes_in_use_high;
+    uint64_t      bytes_requested;   /* live requests, after get_real_size() */
+    uint64_t      rounding_waste;    /* bytes_in_use - bytes_requested */
+    uint64_t      rounding_waste_high;
+    uint64_t      bytes_free;        /* filled by a snapshot */
+    uint64_t      failed_allocs;
+    uint64_t      deferred;          /* lazy frees not coalesced yet */
+    uint64_t      coalesce_passes;
+    uint64_t      bytes_trimmed;     /* released and not used again yet */
+    uint64_t      bytes_released;    /* by all the trims so far */
+    uint64_t      trim_passes;
+    buddy_order_stats_st  orders[MAX_BLOCK_SIZE];
+} buddy_stats_st;
+
+#ifdef BUDDY_NO_STATS
+#define  BUDDY_STAT(stmt)
+#else
+#define  BUDDY_STAT(stmt)      do { stmt; } while (0)
 #endif
 
+/*
+ * An arena is one pool of memory managed by the buddy system.
+ */
+typedef struct _buddy_arena_st {
+    uchar        *base;       /* start of the managed pool */
+    uint64_t      size;       /* bytes under management */
+    uint          top_order;  /* order of the largest block */
+    uint          min_order;  /* order of the smallest block */
+    uint          flags;
+    void         *map_addr;   /* what we got from mmap/malloc */
+    uint64_t      map_len;
+    uint64_t      avail_mask; /* bit i set when freelists[i] is not empty */
+    clist_st      freelists[MAX_BLOCK_SIZE];
+    uint64_t     *freemaps[MAX_BLOCK_SIZE];
+    uchar        *ordermap;   /* a byte per block of min_order */
+    uint64_t      ordermap_len;
+    uint64_t      lazy_watermark; /* 0, or deferred frees kept per order */
+    uint64_t      lazy_pending;   /* deferred frees, all orders */
+    uint64_t      lazy_count[MAX_BLOCK_SIZE];
+    uint64_t      trimmed;        /* bytes released by trims, not reused */
+    buddy_stats_st  stats;
+} buddy_arena_st;
+
+int buddy_arena_init (buddy_arena_st *arena, uint64_t size, uint flags);
+int buddy_arena_init_mem (buddy_arena_st *arena, uchar *buf, uint64_t size);
+void buddy_arena_destroy (buddy_arena_st *arena);
+unsigned char* buddy_arena_alloc (buddy_arena_st *arena, uint64_t size);
+int buddy_arena_dealloc (buddy_arena_st *arena, uchar *block, uint64_t size);
+int buddy_arena_free (buddy_arena_st *arena, uchar *block);
+unsigned char* buddy_arena_realloc (buddy_arena_st *arena, uchar *block,
+                                    uint64_t size);
+uint64_t buddy_arena_usable_size (buddy_arena_st *arena, uchar *block);
+void buddy_arena_set_lazy (buddy_arena_st *arena, uint64_t watermark);
+uint64_t buddy_arena_coalesce (buddy_arena_st *arena);
+uint64_t buddy_arena_trim (buddy_arena_st *arena);
+uint buddy_arena_alloc_bulk (buddy_arena_st *arena, uint64_t size, uint n,
+                             uchar **out);
+int buddy_arena_dealloc_bulk (buddy_arena_st *arena, uchar **blocks, uint n,
+                              uint64_t size);
+uchar *buddy_arena_block_of (buddy_arena_st *arena, uchar *ptr, uint i);
+uchar *buddy_map_arena (uint64_t *size, uint flags);
+void buddy_arena_stats (buddy_arena_st *arena, buddy_stats_st *snap);
+void buddy_stats_print (FILE *fp, buddy_stats_st *snap);
+
+uint64_t get_real_size (uint64_t chunk);
+uint buddy_get_order (uint64_t size);
+
+int buddy_alloc_init ();
+int buddy_alloc_chunk (uint64_t chunk_size);
+int buddy_alloc_arena (uint64_t size, uint flags);
+unsigned char* buddy_alloc (uint64_t size);
+int buddy_dealloc (uchar *block, uint64_t size);
+int buddy_free (uchar *block);
+unsigned char* buddy_realloc (uchar *block, uint64_t size);
+void buddy_set_lazy (uint64_t watermark);
+uint64_t buddy_coalesce ();
+uint64_t buddy_trim ();
+uint buddy_alloc_bulk (uint64_t size, uint n, uchar **out);
+int buddy_dealloc_bulk (uchar **blocks, uint n, uint64_t size);
+void buddy_stats (buddy_stats_st *snap);
+
+#endif
@@ -0,0 +1,295 @@
+
+#include <pthread.h>
+#include <time.h>
+
+#include "buddy_cache.h"
+
+extern buddy_arena_st  buddy_arena_g;
+
+/*
+ * the shared buddy arena and the lock that protects it.
+ */
+buddy_arena_st   *central_arena_g;
+pthread_mutex_t   central_lock_g = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t     cache_key_g;
+
+/*
+ * the trim thread, it sleeps on trim_cond_g under the central lock.
+ */
+pthread_t         trim_thread_g;
+pthread_cond_t    trim_cond_g = PTHREAD_COND_INITIALIZER;
+boolean           trim_running_g;
+uint              trim_interval_g;
+
+/*
+ * the calling thread's magazines.
+ */
+static __thread buddy_cache_st  cache_tls;
+
+/*
+ * magazine_refill
+ *
+ * Moves up to a batch of blocks of order i from the central
+ * buddy into the magazine.
+ */
+static uint
+magazine_refill (buddy_magazine_st *mag, uint i)
+{
+    uint    n;
+
+    pthread_mutex_lock (&central_lock_g);
+    n = buddy_arena_alloc_bulk (central_arena_g, BLOCKSIZE(i),
+                                BUDDY_MAGAZINE_BATCH, &mag->blocks[mag->count]);
+    pthread_mutex_unlock (&central_lock_g);
+    mag->count += n;
+    return (n);
+}
+
+/*
+ * magazine_flush
+ *
+ * Gives the n oldest blocks of the magazine back to the central
+ * buddy, where they get a chance to coalesce.
+ */
+static void
+magazine_flush (buddy_magazine_st *mag, uint i, uint n)
+{
+    if (n > mag->count)
+        n = mag->count;
+    if (n == 0)
+        return;
+
+    pthread_mutex_lock (&central_lock_g);
+    buddy_arena_dealloc_bulk (central_arena_g, mag->blocks, n, BLOCKSIZE(i));
+    pthread_mutex_unlock (&central_lock_g);
+
+    mag->count -= n;
+    memmove (&mag->blocks[0], &mag->blocks[n], mag->count * sizeof(uchar *));
+}
+
+/*
+ * cache_thread_exit
+ *
+ * pthread key destructor, a thread's magazines go back to the
+ * central buddy when it exits.
+ */
+static void
+cache_thread_exit (void *arg)
+{
+    buddy_cache_st  *cache;
+    uint             i;
+
+    cache = (buddy_cache_st *) arg;
+    for (i = 0; i <= BUDDY_MAGAZINE_MAX_ORDER; i++) {
+        magazine_flush (&cache->mags[i], i, cache->mags[i].count);
+    }
+    cache->registered = 0;
+}
+
+/*
+ * get_cache
+ *
+ * Returns the calling thread's magazines, registering them for
+ * the flush on thread exit the first time.
+ */
+static inline buddy_cache_st *
+get_cache ()
+{
+    if (!cache_tls.registered) {
+        pthread_setspecific (cache_key_g, &cache_tls);
+        cache_tls.registered = 1;
+    }
+    return (&cache_tls);
+}
+
+/*
+ * buddy_cache_init
+ *
+ * Puts the magazines in front of arena, or the default buddy
+ * arena if NULL.  The arena has to be initialized already.
+ */
+int
+buddy_cache_init (buddy_arena_st *arena)
+{
+    central_arena_g = arena ? arena : &buddy_arena_g;
+    if (pthread_key_create (&cache_key_g, cache_thread_exit) != 0)
+        return (-1);
+    return (0);
+}
+
+/*
+ * buddy_cache_arena
+ *
+ * The arena behind the magazines.
+ */
+buddy_arena_st *
+buddy_cache_arena ()
+{
+    return (central_arena_g);
+}
+
+unsigned char*
+buddy_cache_alloc (uint64_t size)
+{
+    buddy_magazine_st  *mag;
+    uchar              *block;
+    uint                i;
+
+    i = buddy_get_order (size);
+    if (i > BUDDY_MAGAZINE_MAX_ORDER) {
+        pthread_mutex_lock (&central_lock_g);
+        block = buddy_arena_alloc (central_arena_g, size);
+        pthread_mutex_unlock (&central_lock_g);
+        return (block);
+    }
+
+    mag = &get_cache ()->mags[i];
+    if (mag->count == 0 && magazine_refill (mag, i) == 0)
+        return (NULL);
+
+    return (mag->blocks[--mag->count]);
+}
+
+int
+buddy_cache_dealloc (uchar *block, uint64_t size)
+{
+    buddy_magazine_st  *mag;
+    uint                i;
+    int                 status;
+
+    if (!block)
+        return (-1);
+
+    i = buddy_get_order (size);
+    if (i > BUDDY_MAGAZINE_MAX_ORDER) {
+        pthread_mutex_lock (&central_lock_g);
+        status = buddy_arena_dealloc (central_arena_g, block, size);
+        pthread_mutex_unlock (&central_lock_g);
+        return (status);
+    }
+
+    mag = &get_cache ()->mags[i];
+    if (mag->count == BUDDY_MAGAZINE_SIZE)
+        magazine_flush (mag, i, BUDDY_MAGAZINE_BATCH);
+
+    mag->blocks[mag->count++] = block;
+    return (0);
+}
+
+/*
+ * buddy_cache_flush
+ *
+ * Gives all the blocks cached by the calling thread back to
+ * the central buddy.
+ */
+void
+buddy_cache_flush ()
+{
+    cache_thread_exit (&cache_tls);
+}
+
+/*
+ * buddy_cache_stats
+ *
+ * Snapshot of the central buddy.  Blocks sitting in the magazines
+ * count as in use, and a refill counts as allocations of whole
+ * blocks, so the rounding waste only shows requests that bypass
+ * the magazines.
+ */
+void
+buddy_cache_stats (buddy_stats_st *snap)
+{
+    pthread_mutex_lock (&central_lock_g);
+    buddy_arena_stats (central_arena_g, snap);
+    pthread_mutex_unlock (&central_lock_g);
+}
+
+/*
+ * buddy_cache_trim
+ *
+ * Gives the pages of the large free blocks of the central buddy
+ * back to the kernel.  Blocks cached in the magazines are small
+ * and stay where they are.  Returns the bytes released.
+ */
+uint64_t
+buddy_cache_trim ()
+{
+    uint64_t  released;
+
+    pthread_mutex_lock (&central_lock_g);
+    released = buddy_arena_trim (central_arena_g);
+    pthread_mutex_unlock (&central_lock_g);
+    return (released);
+}
+
+/*
+ * trim_loop
+ *
+ * Trims the central buddy every trim_interval_g milliseconds until
+ * it is told to stop.
+ */
+static void *
+trim_loop (void *arg)
+{
+    struct timespec  ts;
+
+    pthread_mutex_lock (&central_lock_g);
+    while (trim_running_g) {
+        clock_gettime (CLOCK_REALTIME, &ts);
+        ts.tv_sec += trim_interval_g / 1000;
+        ts.tv_nsec += (long) (trim_interval_g % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait (&trim_cond_g, &central_lock_g, &ts);
+        if (trim_running_g)
+            buddy_arena_trim (central_arena_g);
+    }
+    pthread_mutex_unlock (&central_lock_g);
+    return (NULL);
+}
+
+/*
+ * buddy_cache_trim_start
+ *
+ * Starts a thread that trims the central buddy every interval_ms
+ * milliseconds, BUDDY_TRIM_INTERVAL_MS if 0.
+ */
+int
+buddy_cache_trim_start (uint interval_ms)
+{
+    pthread_mutex_lock (&central_lock_g);
+    if (trim_running_g) {
+        pthread_mutex_unlock (&central_lock_g);
+        return (-1);
+    }
+    trim_interval_g = interval_ms ? interval_ms : BUDDY_TRIM_INTERVAL_MS;
+    trim_running_g = 1;
+    pthread_mutex_unlock (&central_lock_g);
+
+    if (pthread_create (&trim_thread_g, NULL, trim_loop, NULL) != 0) {
+        trim_running_g = 0;
+        return (-1);
+    }
+    return (0);
+}
+
+/*
+ * buddy_cache_trim_stop
+ *
+ * Wakes the trim thread up and waits for it to exit.
+ */
+void
+buddy_cache_trim_stop ()
+{
+    pthread_mutex_lock (&central_lock_g);
+    if (!trim_running_g) {
+        pthread_mutex_unlock (&central_lock_g);
+        return;
+    }
+    trim_running_g = 0;
+    pthread_cond_signal (&trim_cond_g);
+    pthread_mutex_unlock (&central_lock_g);
+    pthread_join (trim_thread_g, NULL);
+}
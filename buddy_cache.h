@@ -0,0 +1,52 @@
+#ifndef __BUDDY_CACHE_H__
+#define __BUDDY_CACHE_H__
+
+/*
+ * Per thread magazines in front of the buddy system.
+ * Every thread keeps a small stack of free blocks for each order.
+ * Allocations and frees are served from the calling thread's
+ * magazine and only go to the shared buddy arena, under its lock,
+ * to refill or flush a batch of blocks at a time.
+ */
+
+#include "buddy_alloc.h"
+
+/*
+ * blocks per magazine, and how many are moved to/from the
+ * central buddy at a time.
+ */
+#define  BUDDY_MAGAZINE_SIZE       32
+#define  BUDDY_MAGAZINE_BATCH      16
+
+/*
+ * blocks of a larger order bypass the magazines.
+ */
+#define  BUDDY_MAGAZINE_MAX_ORDER  16
+
+/*
+ * how often the trim thread looks for free pages to give back,
+ * in milliseconds.
+ */
+#define  BUDDY_TRIM_INTERVAL_MS    1000
+
+typedef struct _buddy_magazine_st {
+    uint          count;
+    uchar        *blocks[BUDDY_MAGAZINE_SIZE];
+} buddy_magazine_st;
+
+typedef struct _buddy_cache_st {
+    boolean            registered;  /* flushed on thread exit */
+    buddy_magazine_st  mags[BUDDY_MAGAZINE_MAX_ORDER + 1];
+} buddy_cache_st;
+
+int buddy_cache_init (buddy_arena_st *arena);
+buddy_arena_st *buddy_cache_arena ();
+unsigned char* buddy_cache_alloc (uint64_t size);
+int buddy_cache_dealloc (uchar *block, uint64_t size);
+void buddy_cache_flush ();
+void buddy_cache_stats (buddy_stats_st *snap);
+uint64_t buddy_cache_trim ();
+int buddy_cache_trim_start (uint interval_ms);
+void buddy_cache_trim_stop ();
+
+#endif
@@ -0,0 +1,420 @@
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "buddy_lf.h"
+#include "fls.h"
+
+#define  WORD_BITS          64
+#define  WORDS(nbits)       (((nbits) + WORD_BITS - 1) / WORD_BITS)
+#define  BIT(n)             ((uint64_t) 1 << ((n) % WORD_BITS))
+
+#define  LOAD(p)            __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+
+extern void log_error (char *err_msg);
+
+/*
+ * where a thread starts looking in a word, so that threads do not
+ * all fight over the lowest free block.
+ */
+static __thread uint  lf_rotor;
+
+static inline uint
+get_rotor ()
+{
+    uintptr_t  x;
+
+    if (!lf_rotor) {
+        x = (uintptr_t) &lf_rotor;
+        x ^= x >> 17;
+        x *= 0x9E3779B97F4A7C15ULL;
+        lf_rotor = (uint) (x >> 58) | 0x40;
+    }
+    return (lf_rotor & (WORD_BITS - 1));
+}
+
+/*
+ * pick_bit
+ *
+ * The first set bit of v at or after bit r, wrapping around.
+ */
+static inline uint
+pick_bit (uint64_t v, uint r)
+{
+    uint64_t  x;
+
+    x = r ? (v >> r) | (v << (WORD_BITS - r)) : v;
+    return ((TLSF_ffs64 (x) + r) & (WORD_BITS - 1));
+}
+
+/*
+ * map_propagate
+ *
+ * Sets bit n of level k and of the levels above, up to the first
+ * word that was already non-zero: whoever made that word non-zero
+ * set the bits above it.
+ */
+static void
+map_propagate (buddy_lf_map_st *map, uint k, uint64_t n)
+{
+    uint64_t  old;
+
+    for (; k < map->nlevels; k++) {
+        old = __sync_fetch_and_or (&map->levels[k][n / WORD_BITS], BIT(n));
+        if (old)
+            break;
+        n /= WORD_BITS;
+    }
+}
+
+/*
+ * map_set
+ *
+ * Marks block n free.  Only used where the block cannot have a
+ * free buddy: while carving the arena and for split halves.
+ */
+static void
+map_set (buddy_lf_map_st *map, uint64_t n)
+{
+    uint64_t  old;
+
+    old = __sync_fetch_and_or (&map->levels[0][n / WORD_BITS], BIT(n));
+    if (!old)
+        map_propagate (map, 1, n / WORD_BITS);
+}
+
+/*
+ * map_claim
+ *
+ * Looks for a free block under word w of level k and claims it.
+ * Summary bits found to lead to an empty word are cleared on the
+ * way, and set back if the word filled up meanwhile.
+ */
+static int64_t
+map_claim (buddy_lf_map_st *map, uint k, uint64_t w, uint r)
+{
+    uint64_t  *word, v, old, child;
+    int64_t    n;
+    uint       b;
+
+    word = &map->levels[k][w];
+    v = LOAD(word);
+    while (v) {
+        b = pick_bit (v, r);
+
+        if (k == 0) {
+            old = __sync_fetch_and_and (word, ~BIT(b));
+            if (old & BIT(b))
+                return ((int64_t) (w * WORD_BITS + b));
+            v = old & ~BIT(b);
+            continue;
+        }
+
+        child = w * WORD_BITS + b;
+        n = map_claim (map, k - 1, child, r);
+        if (n >= 0)
+            return (n);
+
+        __sync_fetch_and_and (word, ~BIT(b));
+        if (LOAD(&map->levels[k - 1][child]))
+            map_propagate (map, k, child);
+        v &= ~BIT(b);
+    }
+    return (-1);
+}
+
+static void
+map_free (buddy_lf_map_st *map)
+{
+    uint  k;
+
+    for (k = 0; k < BUDDY_LF_MAX_LEVELS; k++) {
+        free (map->levels[k]);
+        map->levels[k] = NULL;
+    }
+    map->nlevels = 0;
+}
+
+/*
+ * map_init
+ *
+ * A bitmap of nbits blocks and its summary levels, up to a
+ * single word.
+ */
+static int
+map_init (buddy_lf_map_st *map, uint64_t nbits)
+{
+    uint64_t  bits;
+    uint      k;
+
+    memset (map, 0, sizeof(buddy_lf_map_st));
+    map->nbits = nbits;
+    bits = nbits;
+    for (k = 0; k < BUDDY_LF_MAX_LEVELS; k++) {
+        map->levels[k] = (uint64_t *) calloc (WORDS(bits), sizeof(uint64_t));
+        if (!map->levels[k]) {
+            map_free (map);
+            return (-1);
+        }
+        map->nlevels = k + 1;
+        if (bits <= WORD_BITS)
+            break;
+        bits = WORDS(bits);
+    }
+    return (0);
+}
+
+static inline uint64_t
+block_index (buddy_lf_arena_st *arena, uchar *block, uint i)
+{
+    return ((uint64_t) (block - arena->base) >> i);
+}
+
+static inline uchar *
+order_of (buddy_lf_arena_st *arena, uchar *block)
+{
+    return (&arena->ordermap[block_index (arena, block, arena->min_order)]);
+}
+
+/*
+ * buddy_lf_arena_init_mem
+ *
+ * Puts a pool under lock-free buddy management, carved the same
+ * way as buddy_arena_init_mem() does.  Not thread safe.
+ */
+int
+buddy_lf_arena_init_mem (buddy_lf_arena_st *arena, uchar *buf, uint64_t size)
+{
+    uint64_t   offset;
+    uint       i;
+
+    if (!arena || !buf)
+        return (-1);
+
+    size &= ~((uint64_t) MIN_SIZE_REQUIRED - 1);
+    if (size < MIN_SIZE_REQUIRED)
+        return (-1);
+
+    memset (arena, 0, sizeof(buddy_lf_arena_st));
+    arena->base = buf;
+    arena->size = size;
+    arena->top_order = TLSF_fls64 (size);
+    arena->min_order = buddy_get_order (1);
+
+    /*
+     * mmap'd so that only the pages blocks are allocated from
+     * get memory.
+     */
+    arena->ordermap_len = (size >> arena->min_order) + 1;
+    arena->ordermap = (uchar *) mmap (NULL, arena->ordermap_len,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+            -1, 0);
+    if (arena->ordermap == MAP_FAILED) {
+        memset (arena, 0, sizeof(buddy_lf_arena_st));
+        return (-1);
+    }
+
+    for (i = arena->min_order; i <= arena->top_order; i++) {
+        if (map_init (&arena->maps[i], size >> i) != 0) {
+            buddy_lf_arena_destroy (arena);
+            return (-1);
+        }
+    }
+
+    for (offset = 0; size - offset >= MIN_SIZE_REQUIRED; ) {
+        i = TLSF_fls64 (size - offset);
+        if (offset)
+            i = (uint) TLSF_ffs64 (offset) < i ? (uint) TLSF_ffs64 (offset) : i;
+        map_set (&arena->maps[i], block_index (arena, buf + offset, i));
+        offset += BLOCKSIZE(i);
+    }
+    return (0);
+}
+
+/*
+ * buddy_lf_arena_init
+ *
+ * An mmap'd lock-free arena of size bytes.
+ */
+int
+buddy_lf_arena_init (buddy_lf_arena_st *arena, uint64_t size, uint flags)
+{
+    uchar  *buf;
+
+    if (!arena || size < MIN_SIZE_REQUIRED)
+        return (-1);
+
+    buf = buddy_map_arena (&size, flags);
+    if (!buf) {
+        log_error ("unable to map the buddy arena");
+        return (-1);
+    }
+    if (buddy_lf_arena_init_mem (arena, buf, size) != 0) {
+        munmap (buf, size);
+        return (-1);
+    }
+    arena->flags = flags;
+    arena->map_addr = buf;
+    arena->map_len = size;
+    return (0);
+}
+
+/*
+ * buddy_lf_arena_destroy
+ *
+ * No thread may be using the arena.
+ */
+void
+buddy_lf_arena_destroy (buddy_lf_arena_st *arena)
+{
+    uint  i;
+
+    if (!arena || !arena->base)
+        return;
+
+    if (arena->map_addr)
+        munmap (arena->map_addr, arena->map_len);
+    if (arena->ordermap)
+        munmap (arena->ordermap, arena->ordermap_len);
+    for (i = 0; i < MAX_BLOCK_SIZE; i++)
+        map_free (&arena->maps[i]);
+    memset (arena, 0, sizeof(buddy_lf_arena_st));
+}
+
+/*
+ * buddy_lf_alloc
+ *
+ * Claims a free block of the smallest order >= the request that
+ * has one, splits it down, publishing the upper halves, and
+ * records its order.
+ */
+unsigned char*
+buddy_lf_alloc (buddy_lf_arena_st *arena, uint64_t size)
+{
+    buddy_lf_map_st  *map;
+    uchar            *block;
+    uint              i, j, r, pass;
+    int64_t           n;
+
+    i = buddy_get_order (size);
+    if (i > arena->top_order) {
+        log_error ( "no space available" );
+        return (NULL);
+    }
+
+    r = get_rotor ();
+    for (pass = 0; pass < BUDDY_LF_RETRIES; pass++) {
+        for (j = i; j <= arena->top_order; j++) {
+            map = &arena->maps[j];
+            if (!LOAD(&map->levels[map->nlevels - 1][0]))
+                continue;
+            n = map_claim (map, map->nlevels - 1, 0, r);
+            if (n < 0)
+                continue;
+
+            while (j > i) {
+                j--;
+                n <<= 1;
+                map_set (&arena->maps[j], (uint64_t) n + 1);
+            }
+            block = arena->base + ((uint64_t) n << i);
+            __atomic_store_n (order_of (arena, block), (uchar) (i + 1),
+                              __ATOMIC_RELEASE);
+            return (block);
+        }
+        sched_yield ();
+    }
+
+    log_error ( "no space available" );
+    return (NULL);
+}
+
+/*
+ * buddy_lf_dealloc
+ *
+ * Frees a block and coalesces it with its free buddies.  The
+ * block's entry in the order map is cleared first, a block that
+ * is not allocated with this size is refused there.  Then at each
+ * order one CAS on the word holding the block and its buddy either
+ * takes the buddy or marks the block free, which ends the free.
+ */
+int
+buddy_lf_dealloc (buddy_lf_arena_st *arena, uchar *block, uint64_t size)
+{
+    buddy_lf_map_st  *map;
+    uint64_t         *word, old, new, n, mine, buddy;
+    uchar             order;
+    uint              i;
+
+    i = buddy_get_order (size);
+    if (i > arena->top_order || block < arena->base ||
+        (uint64_t) (block - arena->base) + BLOCKSIZE(i) > arena->size ||
+        ((uint64_t) (block - arena->base) & (BLOCKSIZE(i) - 1))) {
+        log_error ( "block does not belong to the arena" );
+        return (-1);
+    }
+
+    order = (uchar) (i + 1);
+    if (!__atomic_compare_exchange_n (order_of (arena, block), &order, 0,
+                                      FALSE, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        log_error ( "block is not allocated" );
+        return (-1);
+    }
+
+    n = block_index (arena, block, i);
+    for (;;) {
+        map = &arena->maps[i];
+        word = &map->levels[0][n / WORD_BITS];
+        mine = BIT(n);
+        buddy = (i < arena->top_order) ? BIT(n ^ 1) : 0;
+
+        old = LOAD(word);
+        for (;;) {
+            if (old & mine) {
+                log_error ( "block is already free" );
+                return (-1);
+            }
+            new = (old & buddy) ? (old & ~buddy) : (old | mine);
+            if (__sync_bool_compare_and_swap (word, old, new))
+                break;
+            old = LOAD(word);
+        }
+
+        if (!(old & buddy)) {
+            if (!old)
+                map_propagate (map, 1, n / WORD_BITS);
+            return (0);
+        }
+
+        /*
+         * we own the buddy now, carry on with the pair.
+         */
+        n >>= 1;
+        i++;
+    }
+}
+
+/*
+ * buddy_lf_free_bytes
+ *
+ * Bytes in free blocks, only exact while no thread is in
+ * the arena.
+ */
+uint64_t
+buddy_lf_free_bytes (buddy_lf_arena_st *arena)
+{
+    buddy_lf_map_st  *map;
+    uint64_t          bytes, w;
+    uint              i;
+
+    bytes = 0;
+    for (i = arena->min_order; i <= arena->top_order; i++) {
+        map = &arena->maps[i];
+        for (w = 0; w < WORDS(map->nbits); w++)
+            bytes += (uint64_t) __builtin_popcountll (map->levels[0][w]) <<
+                     i;
+    }
+    return (bytes);
+}
@@ -0,0 +1,74 @@
+#ifndef __BUDDY_LF_H__
+#define __BUDDY_LF_H__
+
+/*
+ * A lock-free buddy system.
+ * There are no free lists, the free blocks of each order are the
+ * set bits of that order's bitmap and every state change of a block
+ * is one atomic operation on the word that holds its bit:
+ *
+ *   - an allocation claims a block by clearing its bit, whoever
+ *     clears it first owns it, the upper halves of a split are
+ *     published by setting their bits one order down.
+ *   - a block and its buddy are bits 2k and 2k+1 of the same word,
+ *     so a free either clears its buddy's bit, taking the buddy
+ *     with it to coalesce one order up, or sets its own bit, in a
+ *     single compare-and-swap.  Of two buddies freed at the same
+ *     time exactly one sees the other and carries on.
+ *   - as in buddy_alloc.c, an order map holds a byte per block of
+ *     min_order, the order + 1 of an allocated block starting
+ *     there.  A free first clears it with a compare-and-swap, so
+ *     a block that is not allocated, with that size, is not freed
+ *     even when it has coalesced away.
+ *
+ * A bitmap has summary levels above it, bit n of a level says that
+ * word n of the level below may have a bit set, so finding a free
+ * block looks at a handful of words whatever the size of the arena.
+ * Summary bits are set by whoever makes a word non-zero and cleared
+ * lazily by a search that finds the word empty.
+ *
+ * Blocks are numbered from the arena base, as in buddy_alloc.c, and
+ * block sizes are the same as buddy_alloc() would give.
+ */
+
+#include "buddy_alloc.h"
+
+/*
+ * 64 way summary levels, enough for a 2^64 bit bitmap.
+ */
+#define  BUDDY_LF_MAX_LEVELS    11
+
+/*
+ * an allocation can miss a block that a free is coalescing at
+ * that moment, it looks this many times before failing.
+ */
+#define  BUDDY_LF_RETRIES       4
+
+typedef struct _buddy_lf_map_st {
+    uint          nlevels;
+    uint64_t      nbits;                        /* blocks of the order */
+    uint64_t     *levels[BUDDY_LF_MAX_LEVELS];  /* levels[0] is the bitmap */
+} buddy_lf_map_st;
+
+typedef struct _buddy_lf_arena_st {
+    uchar            *base;
+    uint64_t          size;
+    uint              top_order;
+    uint              min_order;  /* order of the smallest block */
+    uint              flags;
+    void             *map_addr;
+    uint64_t          map_len;
+    uchar            *ordermap;   /* a byte per block of min_order */
+    uint64_t          ordermap_len;
+    buddy_lf_map_st   maps[MAX_BLOCK_SIZE];
+} buddy_lf_arena_st;
+
+int buddy_lf_arena_init (buddy_lf_arena_st *arena, uint64_t size, uint flags);
+int buddy_lf_arena_init_mem (buddy_lf_arena_st *arena, uchar *buf,
+                             uint64_t size);
+void buddy_lf_arena_destroy (buddy_lf_arena_st *arena);
+unsigned char* buddy_lf_alloc (buddy_lf_arena_st *arena, uint64_t size);
+int buddy_lf_dealloc (buddy_lf_arena_st *arena, uchar *block, uint64_t size);
+uint64_t buddy_lf_free_bytes (buddy_lf_arena_st *arena);
+
+#endif
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "buddy_lf.h"
+
+/*
+ * Tests the lock-free buddy the same way as the serial one, then
+ * hammers it from many threads and compares the throughput with
+ * the serial buddy behind a mutex.
+ *
+ *   gcc -O2 -o buddy_lf_test buddy_lf_test.c buddy_lf.c buddy_alloc.c \
+ *       -lpthread
+ *   ./buddy_lf_test [max_threads]
+ */
+
+#define  ARENA_SIZE       (64ULL * 1024 * 1024)
+#define  SLOTS            4096
+#define  OPS_PER_THREAD   400000
+#define  MAX_REQUEST      4096
+
+typedef struct _slot_st {
+    uchar        *block;
+    uint64_t      size;
+} slot_st;
+
+typedef struct _test_ctxt_st {
+    pthread_t      thread_id;
+    int            thread_num;
+    unsigned int   seed;
+    slot_st        slots[SLOTS];
+    uint64_t       failed;
+} test_ctxt_st;
+
+buddy_lf_arena_st   lf_arena_g;
+buddy_arena_st      serial_arena_g;
+pthread_mutex_t     serial_lock_g = PTHREAD_MUTEX_INITIALIZER;
+boolean             use_lf_g;
+
+static uchar *
+test_alloc (uint64_t size)
+{
+    uchar  *p;
+
+    if (use_lf_g)
+        return (buddy_lf_alloc (&lf_arena_g, size));
+    pthread_mutex_lock (&serial_lock_g);
+    p = buddy_arena_alloc (&serial_arena_g, size);
+    pthread_mutex_unlock (&serial_lock_g);
+    return (p);
+}
+
+static int
+test_dealloc (uchar *block, uint64_t size)
+{
+    int  status;
+
+    if (use_lf_g)
+        return (buddy_lf_dealloc (&lf_arena_g, block, size));
+    pthread_mutex_lock (&serial_lock_g);
+    status = buddy_arena_dealloc (&serial_arena_g, block, size);
+    pthread_mutex_unlock (&serial_lock_g);
+    return (status);
+}
+
+/*
+ * a block carries its own address, whoever else got it too
+ * overwrites that.
+ */
+static void
+stamp (uchar *block, uint64_t size)
+{
+    uint64_t  *w;
+
+    w = (uint64_t *) block;
+    w[0] = (uint64_t) (uintptr_t) block;
+    if (size >= 16)
+        w[(size - 8) / 8] = ~w[0];
+}
+
+static void
+check (uchar *block, uint64_t size)
+{
+    uint64_t  *w;
+
+    w = (uint64_t *) block;
+    assert (w[0] == (uint64_t) (uintptr_t) block);
+    assert (size < 16 || w[(size - 8) / 8] == ~w[0]);
+}
+
+static uint64_t
+random_size (unsigned int *seed)
+{
+    uint64_t  size;
+
+    size = 8 + rand_r (seed) % 256;
+    if (rand_r (seed) % 16 == 0)
+        size = 8 + rand_r (seed) % MAX_REQUEST;
+    return (size);
+}
+
+static void *
+thread_loop (void *data)
+{
+    test_ctxt_st  *ctxt;
+    slot_st       *s;
+    int            i;
+
+    ctxt = (test_ctxt_st *) data;
+    for (i = 0; i < OPS_PER_THREAD; i++) {
+        s = &ctxt->slots[rand_r (&ctxt->seed) % SLOTS];
+        if (s->block) {
+            check (s->block, s->size);
+            assert (test_dealloc (s->block, s->size) == 0);
+            s->block = NULL;
+        } else {
+            s->size = random_size (&ctxt->seed);
+            s->block = test_alloc (s->size);
+            if (s->block)
+                stamp (s->block, s->size);
+            else
+                ctxt->failed++;
+        }
+    }
+    for (i = 0; i < SLOTS; i++) {
+        s = &ctxt->slots[i];
+        if (s->block) {
+            check (s->block, s->size);
+            assert (test_dealloc (s->block, s->size) == 0);
+            s->block = NULL;
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * test_serial
+ *
+ * Runs the same sequence against both buddies.  Block sizes must
+ * match, no two live blocks may overlap and everything must
+ * coalesce back at the end.
+ */
+static void
+test_serial ()
+{
+    static slot_st  lf[SLOTS], sr[SLOTS];
+    unsigned int    seed;
+    uint64_t        size;
+    uchar          *buf;
+    int             i, k;
+
+    buf = (uchar *) malloc (ARENA_SIZE + 4096);
+    assert (buddy_lf_arena_init_mem (&lf_arena_g, buf + 4096, ARENA_SIZE) == 0);
+    assert (buddy_lf_free_bytes (&lf_arena_g) == ARENA_SIZE);
+
+    seed = 1;
+    for (i = 0; i < 1000000; i++) {
+        k = rand_r (&seed) % SLOTS;
+        if (lf[k].block) {
+            check (lf[k].block, lf[k].size);
+            assert (buddy_lf_dealloc (&lf_arena_g, lf[k].block, lf[k].size) == 0);
+            assert (buddy_arena_dealloc (&serial_arena_g, sr[k].block,
+                                         sr[k].size) == 0);
+            lf[k].block = sr[k].block = NULL;
+        } else {
+            size = random_size (&seed);
+            lf[k].size = sr[k].size = size;
+            lf[k].block = buddy_lf_alloc (&lf_arena_g, size);
+            sr[k].block = buddy_arena_alloc (&serial_arena_g, size);
+            assert (lf[k].block && sr[k].block);
+            assert (((uint64_t) (lf[k].block - lf_arena_g.base) &
+                     (BLOCKSIZE(buddy_get_order (size)) - 1)) == 0);
+            stamp (lf[k].block, size);
+        }
+    }
+
+    /*
+     * a double free is caught.
+     */
+    for (k = 0; !lf[k].block; k++)
+        ;
+    assert (buddy_lf_dealloc (&lf_arena_g, lf[k].block, lf[k].size) == 0);
+    assert (buddy_lf_dealloc (&lf_arena_g, lf[k].block, lf[k].size) != 0);
+    assert (buddy_arena_dealloc (&serial_arena_g, sr[k].block, sr[k].size) == 0);
+    lf[k].block = NULL;
+
+    for (k = 0; k < SLOTS; k++) {
+        if (!lf[k].block)
+            continue;
+        assert (buddy_lf_dealloc (&lf_arena_g, lf[k].block, lf[k].size) == 0);
+        assert (buddy_arena_dealloc (&serial_arena_g, sr[k].block,
+                                     sr[k].size) == 0);
+    }
+    assert (buddy_lf_free_bytes (&lf_arena_g) == ARENA_SIZE);
+    assert (buddy_lf_alloc (&lf_arena_g, ARENA_SIZE) == lf_arena_g.base);
+    buddy_lf_arena_destroy (&lf_arena_g);
+    free (buf);
+    printf ("serial: ok\n");
+}
+
+/*
+ * test_double_free
+ *
+ * Fills a small arena with the smallest blocks, then frees a pair
+ * of buddies, which coalesce, and frees one of them again.  The
+ * second free must fail, and must not have handed the memory out
+ * twice.  A free with the wrong size must fail too.
+ */
+static void
+test_double_free ()
+{
+    buddy_lf_arena_st   arena;
+    uchar             **blocks, *buf, *x, *y;
+    uint64_t            size, bs, n, k;
+
+    size = 1024 * 1024;
+    buf = (uchar *) malloc (size);
+    assert (buddy_lf_arena_init_mem (&arena, buf, size) == 0);
+    bs = BLOCKSIZE(buddy_get_order (64));
+    blocks = (uchar **) calloc (size / bs, sizeof(uchar *));
+
+    for (n = 0; n < size / bs; n++)
+        assert ((blocks[n] = buddy_lf_alloc (&arena, 64)) != NULL);
+    assert (buddy_lf_free_bytes (&arena) == 0);
+
+    x = blocks[0];
+    y = arena.base + ((uint64_t) (x - arena.base) ^ bs);
+    assert (buddy_lf_dealloc (&arena, x, 2 * bs) != 0);
+    assert (buddy_lf_dealloc (&arena, x, 64) == 0);
+    assert (buddy_lf_dealloc (&arena, y, 64) == 0);
+    assert (buddy_lf_dealloc (&arena, y, 64) != 0);
+    assert (buddy_lf_dealloc (&arena, x, 64) != 0);
+    assert (buddy_lf_free_bytes (&arena) == 2 * bs);
+
+    for (k = 0; k < n; k++) {
+        if (blocks[k] != x && blocks[k] != y)
+            assert (buddy_lf_dealloc (&arena, blocks[k], 64) == 0);
+    }
+    assert (buddy_lf_free_bytes (&arena) == size);
+    assert (buddy_lf_alloc (&arena, size) == arena.base);
+    assert (buddy_lf_dealloc (&arena, arena.base, size) == 0);
+
+    buddy_lf_arena_destroy (&arena);
+    free (blocks);
+    free (buf);
+    printf ("double free: ok\n");
+}
+
+static double
+run_threads (int nthreads)
+{
+    test_ctxt_st     *ctxt;
+    struct timespec   t0, t1;
+    uint64_t          failed;
+    int               i;
+
+    ctxt = (test_ctxt_st *) calloc (nthreads, sizeof(test_ctxt_st));
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nthreads; i++) {
+        ctxt[i].thread_num = i;
+        ctxt[i].seed = i + 1;
+        pthread_create (&ctxt[i].thread_id, NULL, thread_loop, &ctxt[i]);
+    }
+    failed = 0;
+    for (i = 0; i < nthreads; i++) {
+        pthread_join (ctxt[i].thread_id, NULL);
+        failed += ctxt[i].failed;
+    }
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    free (ctxt);
+    assert (failed == 0);
+
+    return ((double) nthreads * OPS_PER_THREAD /
+            ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9));
+}
+
+int
+main (int argc, char **argv)
+{
+    double  lf_ops, serial_ops;
+    int     max_threads, n;
+
+    max_threads = (argc > 1) ? atoi (argv[1]) : 32;
+
+    buddy_arena_init (&serial_arena_g, ARENA_SIZE, 0);
+    test_serial ();
+    test_double_free ();
+
+    assert (buddy_lf_arena_init (&lf_arena_g, ARENA_SIZE, 0) == 0);
+    printf ("%8s %14s %14s\n", "threads", "lock-free/s", "mutex/s");
+    for (n = 1; n <= max_threads; n *= 2) {
+        use_lf_g = 1;
+        lf_ops = run_threads (n);
+        assert (buddy_lf_free_bytes (&lf_arena_g) == ARENA_SIZE);
+
+        use_lf_g = 0;
+        serial_ops = run_threads (n);
+        printf ("%8d %14.0f %14.0f\n", n, lf_ops, serial_ops);
+    }
+    buddy_lf_arena_destroy (&lf_arena_g);
+    buddy_arena_destroy (&serial_arena_g);
+    return (0);
+}
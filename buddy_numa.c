@@ -0,0 +1,413 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "buddy_numa.h"
+
+#ifndef MPOL_BIND
+#define MPOL_BIND    2
+#endif
+
+#define  NODE_SYSFS   "/sys/devices/system/node"
+
+extern void log_error (char *err_msg);
+
+/*
+ * global NUMA arenas
+ */
+buddy_numa_st   buddy_numa_g;
+
+static __thread int    numa_node_tls = -1;
+static __thread uint   numa_calls_tls;
+
+/*
+ * read_node_list
+ *
+ * Parses a sysfs node list such as "0-1,4" into ids.
+ */
+static int
+read_node_list (const char *path, int *ids, int max)
+{
+    FILE  *fp;
+    char   buf[256], *p, *end;
+    long   lo, hi;
+    int    n;
+
+    fp = fopen (path, "r");
+    if (!fp)
+        return (-1);
+    if (!fgets (buf, sizeof(buf), fp)) {
+        fclose (fp);
+        return (-1);
+    }
+    fclose (fp);
+
+    n = 0;
+    for (p = buf; *p && *p != '\n'; ) {
+        lo = strtol (p, &end, 10);
+        if (end == p)
+            break;
+        hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol (p + 1, &end, 10);
+            p = end;
+        }
+        for (; lo <= hi && n < max; lo++) {
+            if (lo < BUDDY_NUMA_MAX_NODES)
+                ids[n++] = (int) lo;
+        }
+        if (*p == ',')
+            p++;
+    }
+    return (n);
+}
+
+/*
+ * read_distances
+ *
+ * The distances from node to the online nodes, in the order of
+ * the online list.
+ */
+static int
+read_distances (int node, int *dist, int max)
+{
+    FILE  *fp;
+    char   path[128];
+    int    n;
+
+    snprintf (path, sizeof(path), NODE_SYSFS "/node%d/distance", node);
+    fp = fopen (path, "r");
+    if (!fp)
+        return (-1);
+    for (n = 0; n < max && fscanf (fp, "%d", &dist[n]) == 1; n++)
+        ;
+    fclose (fp);
+    return (n);
+}
+
+/*
+ * set_fallback
+ *
+ * Orders the other arenas by their distance from arena k.
+ */
+static void
+set_fallback (uint k, int *online, int nonline)
+{
+    buddy_numa_node_st  *nd;
+    int                  dist[BUDDY_NUMA_MAX_NODES], by_index[BUDDY_NUMA_MAX_NODES];
+    int                  n, ndist, d;
+    uint                 i, j, f;
+
+    nd = &buddy_numa_g.nodes[k];
+    for (i = 0; i < buddy_numa_g.nnodes; i++)
+        by_index[i] = 0;
+
+    ndist = read_distances (nd->node, dist, BUDDY_NUMA_MAX_NODES);
+    for (n = 0; n < ndist && n < nonline; n++) {
+        d = buddy_numa_g.node_index[online[n]];
+        if (d >= 0)
+            by_index[d] = dist[n];
+    }
+
+    /*
+     * the other arenas, insertion sorted by distance.
+     */
+    for (f = 0, i = 0; i < buddy_numa_g.nnodes; i++) {
+        if (i == k)
+            continue;
+        for (j = f++; j > 0 && by_index[nd->fallback[j - 1]] > by_index[i]; j--)
+            nd->fallback[j] = nd->fallback[j - 1];
+        nd->fallback[j] = i;
+    }
+    for (; f < BUDDY_NUMA_MAX_NODES; f++)
+        nd->fallback[f] = k;
+}
+
+/*
+ * bind_to_node
+ *
+ * Binds the pages of the pool to node.  Nothing has been touched
+ * yet so every page is faulted in on the node.
+ */
+static boolean
+bind_to_node (uchar *buf, uint64_t size, int node)
+{
+    unsigned long  mask;
+
+    mask = 1UL << node;
+    if (syscall (SYS_mbind, buf, size, MPOL_BIND, &mask,
+                 BUDDY_NUMA_MAX_NODES + 1, 0) != 0)
+        return (0);
+    return (1);
+}
+
+/*
+ * buddy_numa_init
+ *
+ * Maps an arena of size_per_node bytes for each node that has
+ * memory and binds it there.  Arenas from an earlier init are
+ * destroyed first.
+ */
+int
+buddy_numa_init (uint64_t size_per_node, uint flags, uint policy)
+{
+    buddy_numa_node_st  *nd;
+    int                  ids[BUDDY_NUMA_MAX_NODES], online[BUDDY_NUMA_MAX_NODES];
+    int                  nids, nonline, n;
+    uint64_t             size;
+    uchar               *buf;
+
+    if (buddy_numa_g.nnodes)
+        buddy_numa_destroy ();
+    memset (&buddy_numa_g, 0, sizeof(buddy_numa_g));
+    buddy_numa_g.policy = policy;
+    for (n = 0; n < BUDDY_NUMA_MAX_NODES; n++)
+        buddy_numa_g.node_index[n] = -1;
+
+    nonline = read_node_list (NODE_SYSFS "/online", online, BUDDY_NUMA_MAX_NODES);
+    nids = read_node_list (NODE_SYSFS "/has_memory", ids, BUDDY_NUMA_MAX_NODES);
+    if (nids <= 0) {
+        nids = nonline;
+        memcpy (ids, online, sizeof(ids));
+    }
+    if (nids <= 0) {
+        nids = 1;
+        ids[0] = 0;
+    }
+
+    for (n = 0; n < nids; n++) {
+        nd = &buddy_numa_g.nodes[buddy_numa_g.nnodes];
+        size = size_per_node;
+        buf = buddy_map_arena (&size, flags);
+        if (!buf) {
+            log_error ("unable to map the buddy arena");
+            buddy_numa_destroy ();
+            return (-1);
+        }
+        nd->node = ids[n];
+        nd->bound = (nids > 1) ? bind_to_node (buf, size, ids[n]) : 0;
+        if (nids > 1 && !nd->bound)
+            log_error ("mbind failed, arena is not node local");
+
+        if (buddy_arena_init_mem (&nd->arena, buf, size) != 0) {
+            munmap (buf, size);
+            buddy_numa_destroy ();
+            return (-1);
+        }
+        nd->arena.flags = flags;
+        nd->arena.map_addr = buf;
+        nd->arena.map_len = size;
+        pthread_mutex_init (&nd->lock, NULL);
+        buddy_numa_g.node_index[ids[n]] = buddy_numa_g.nnodes++;
+    }
+
+    for (n = 0; n < (int) buddy_numa_g.nnodes; n++)
+        set_fallback (n, online, nonline);
+    return (0);
+}
+
+/*
+ * buddy_numa_destroy
+ *
+ * Unmaps all the arenas, no thread may be using them.
+ */
+void
+buddy_numa_destroy ()
+{
+    uint  k;
+
+    for (k = 0; k < buddy_numa_g.nnodes; k++) {
+        buddy_arena_destroy (&buddy_numa_g.nodes[k].arena);
+        pthread_mutex_destroy (&buddy_numa_g.nodes[k].lock);
+    }
+    buddy_numa_g.nnodes = 0;
+}
+
+uint
+buddy_numa_nodes ()
+{
+    return (buddy_numa_g.nnodes);
+}
+
+/*
+ * local_index
+ *
+ * The arena of the node the calling thread runs on.  The node is
+ * looked up again every BUDDY_NUMA_NODE_REFRESH calls in case the
+ * thread migrated.
+ */
+static inline uint
+local_index ()
+{
+    unsigned  cpu, node;
+    int       k;
+
+    if (numa_node_tls < 0 || numa_calls_tls++ >= BUDDY_NUMA_NODE_REFRESH) {
+        numa_calls_tls = 0;
+        if (syscall (SYS_getcpu, &cpu, &node, NULL) != 0 ||
+            node >= BUDDY_NUMA_MAX_NODES)
+            node = 0;
+        numa_node_tls = (int) node;
+    }
+    k = buddy_numa_g.node_index[numa_node_tls];
+    return (k >= 0 ? (uint) k : 0);
+}
+
+static uchar *
+alloc_from (uint k, uint64_t size)
+{
+    buddy_numa_node_st  *nd;
+    uchar               *block;
+
+    nd = &buddy_numa_g.nodes[k];
+    pthread_mutex_lock (&nd->lock);
+    block = buddy_arena_alloc (&nd->arena, size);
+    pthread_mutex_unlock (&nd->lock);
+    return (block);
+}
+
+/*
+ * arena_index_of
+ *
+ * The arena whose address range holds ptr, -1 if none does.
+ */
+static int
+arena_index_of (uchar *ptr)
+{
+    buddy_arena_st  *arena;
+    uint             k;
+
+    for (k = 0; k < buddy_numa_g.nnodes; k++) {
+        arena = &buddy_numa_g.nodes[k].arena;
+        if (ptr >= arena->base && (uint64_t) (ptr - arena->base) < arena->size)
+            return ((int) k);
+    }
+    return (-1);
+}
+
+/*
+ * buddy_numa_node_of
+ *
+ * The node that ptr was allocated on.
+ */
+int
+buddy_numa_node_of (uchar *ptr)
+{
+    int  k;
+
+    k = arena_index_of (ptr);
+    return (k >= 0 ? buddy_numa_g.nodes[k].node : -1);
+}
+
+/*
+ * buddy_numa_alloc
+ *
+ * Allocates from the local node, and from the others nearest
+ * first when the policy allows it.
+ */
+unsigned char*
+buddy_numa_alloc (uint64_t size)
+{
+    buddy_numa_node_st  *nd;
+    uchar               *block;
+    uint                 k, f;
+
+    if (buddy_numa_g.nnodes == 0)
+        return (NULL);
+
+    k = local_index ();
+    block = alloc_from (k, size);
+    if (block || buddy_numa_g.policy == BUDDY_NUMA_LOCAL_ONLY)
+        return (block);
+
+    nd = &buddy_numa_g.nodes[k];
+    for (f = 0; f + 1 < buddy_numa_g.nnodes; f++) {
+        block = alloc_from (nd->fallback[f], size);
+        if (block)
+            return (block);
+    }
+    return (NULL);
+}
+
+/*
+ * buddy_numa_alloc_on
+ *
+ * Allocates from the arena of a given node, no fallback.
+ */
+unsigned char*
+buddy_numa_alloc_on (int node, uint64_t size)
+{
+    if (node < 0 || node >= BUDDY_NUMA_MAX_NODES ||
+        buddy_numa_g.node_index[node] < 0)
+        return (NULL);
+    return (alloc_from (buddy_numa_g.node_index[node], size));
+}
+
+/*
+ * buddy_numa_dealloc
+ *
+ * Gives a block back to the arena that owns it.
+ */
+int
+buddy_numa_dealloc (uchar *block, uint64_t size)
+{
+    buddy_numa_node_st  *nd;
+    int                  k, status;
+
+    k = arena_index_of (block);
+    if (k < 0) {
+        log_error ( "block does not belong to any node" );
+        return (-1);
+    }
+
+    nd = &buddy_numa_g.nodes[k];
+    pthread_mutex_lock (&nd->lock);
+    status = buddy_arena_dealloc (&nd->arena, block, size);
+    pthread_mutex_unlock (&nd->lock);
+    return (status);
+}
+
+/*
+ * buddy_numa_stats
+ *
+ * Snapshot of the statistics of a node's arena.
+ */
+int
+buddy_numa_stats (int node, buddy_stats_st *snap)
+{
+    buddy_numa_node_st  *nd;
+
+    if (node < 0 || node >= BUDDY_NUMA_MAX_NODES ||
+        buddy_numa_g.node_index[node] < 0)
+        return (-1);
+
+    nd = &buddy_numa_g.nodes[buddy_numa_g.node_index[node]];
+    pthread_mutex_lock (&nd->lock);
+    buddy_arena_stats (&nd->arena, snap);
+    pthread_mutex_unlock (&nd->lock);
+    return (0);
+}
+
+/*
+ * buddy_numa_trim
+ *
+ * Trims the arena of every node, returns the bytes released.  The
+ * pages stay bound to their node when they fault back in.
+ */
+uint64_t
+buddy_numa_trim ()
+{
+    buddy_numa_node_st  *nd;
+    uint64_t             released;
+    uint                 k;
+
+    released = 0;
+    for (k = 0; k < buddy_numa_g.nnodes; k++) {
+        nd = &buddy_numa_g.nodes[k];
+        pthread_mutex_lock (&nd->lock);
+        released += buddy_arena_trim (&nd->arena);
+        pthread_mutex_unlock (&nd->lock);
+    }
+    return (released);
+}
@@ -0,0 +1,62 @@
+#ifndef __BUDDY_NUMA_H__
+#define __BUDDY_NUMA_H__
+
+/*
+ * NUMA aware buddy arenas.
+ * There is one buddy arena per NUMA node that has memory, its pages
+ * are bound to the node with mbind(2).  A thread allocates from the
+ * arena of the node it runs on, and a block is freed back to the
+ * arena whose address range holds it, whichever thread frees it.
+ *
+ * When the local arena cannot serve a request the fallback policy
+ * decides: fail, or try the other nodes nearest first by the
+ * distances the kernel reports.
+ *
+ * No libnuma is needed, mbind and getcpu are called directly.  On a
+ * box without NUMA there is a single arena and nothing is bound.
+ */
+
+#include <pthread.h>
+
+#include "buddy_alloc.h"
+
+#define  BUDDY_NUMA_MAX_NODES      64
+
+/*
+ * fallback policies
+ */
+#define  BUDDY_NUMA_LOCAL_ONLY     0   /* fail when the local arena is out */
+#define  BUDDY_NUMA_NEAREST        1   /* try the other nodes, nearest first */
+
+/*
+ * how many allocations a thread makes before it asks again
+ * which node it runs on.
+ */
+#define  BUDDY_NUMA_NODE_REFRESH   256
+
+typedef struct _buddy_numa_node_st {
+    int              node;                  /* kernel node id */
+    boolean          bound;                 /* mbind succeeded */
+    pthread_mutex_t  lock;
+    buddy_arena_st   arena;
+    uint             fallback[BUDDY_NUMA_MAX_NODES];  /* nearest first */
+} buddy_numa_node_st;
+
+typedef struct _buddy_numa_st {
+    uint                 nnodes;
+    uint                 policy;
+    int                  node_index[BUDDY_NUMA_MAX_NODES];  /* id -> index */
+    buddy_numa_node_st   nodes[BUDDY_NUMA_MAX_NODES];
+} buddy_numa_st;
+
+int buddy_numa_init (uint64_t size_per_node, uint flags, uint policy);
+void buddy_numa_destroy ();
+uint buddy_numa_nodes ();
+int buddy_numa_node_of (uchar *ptr);
+unsigned char* buddy_numa_alloc (uint64_t size);
+unsigned char* buddy_numa_alloc_on (int node, uint64_t size);
+int buddy_numa_dealloc (uchar *block, uint64_t size);
+int buddy_numa_stats (int node, buddy_stats_st *snap);
+uint64_t buddy_numa_trim ();
+
+#endif
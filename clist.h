@@ -0,0 +1,237 @@
+#ifndef __CLIST_H__
+#define __CLIST_H__
+
+/*
+ * A circular doubly linked list with a sentinel.
+ * The nodes are the same node_st a dlist links, but the list is
+ * closed through a sentinel node in the list header, so no link is
+ * ever NULL and every operation is O(1): push and pop at both ends,
+ * unlink of a node, and splicing a whole list onto another.
+ *
+ * A node must be on the list it is unlinked from, there is no
+ * membership check.  A list must not be copied once it has nodes,
+ * the first and last node point at its sentinel.
+ */
+
+#include "dlist.h"
+
+typedef struct _clist_st {
+    node_st   sentinel;   /* sentinel.next is the head, .prev the tail */
+    uint      count;
+} clist_st;
+
+#define  CLIST_END(list)       (&(list)->sentinel)
+
+/*
+ * walks the list, node must not be unlinked meanwhile.
+ */
+#define  CLIST_FOREACH(list, node) \
+    for ((node) = (list)->sentinel.next; (node) != CLIST_END(list); \
+         (node) = (node)->next)
+
+/*
+ * walks the list, node may be unlinked on the way.
+ */
+#define  CLIST_FOREACH_SAFE(list, node, tmp) \
+    for ((node) = (list)->sentinel.next, (tmp) = (node)->next; \
+         (node) != CLIST_END(list); (node) = (tmp), (tmp) = (node)->next)
+
+static inline void
+clist_init (clist_st *list)
+{
+    list->sentinel.next = list->sentinel.prev = &list->sentinel;
+    list->count = 0;
+}
+
+static inline boolean
+clist_empty (clist_st *list)
+{
+    return (list->sentinel.next == &list->sentinel);
+}
+
+static inline node_st *
+clist_head (clist_st *list)
+{
+    return (clist_empty (list) ? NULL : list->sentinel.next);
+}
+
+static inline node_st *
+clist_tail (clist_st *list)
+{
+    return (clist_empty (list) ? NULL : list->sentinel.prev);
+}
+
+/*
+ * clist_next
+ *
+ * The node after node, NULL at the end of the list.
+ */
+static inline node_st *
+clist_next (clist_st *list, node_st *node)
+{
+    return (node->next == &list->sentinel ? NULL : node->next);
+}
+
+/*
+ * clist_insert_after
+ *
+ * Links node in after pos, which may be the sentinel.
+ */
+static inline void
+clist_insert_after (clist_st *list, node_st *pos, node_st *node)
+{
+    node->prev = pos;
+    node->next = pos->next;
+    pos->next->prev = node;
+    pos->next = node;
+    list->count++;
+}
+
+static inline void
+clist_push_head (clist_st *list, node_st *node)
+{
+    clist_insert_after (list, &list->sentinel, node);
+}
+
+static inline void
+clist_push_tail (clist_st *list, node_st *node)
+{
+    clist_insert_after (list, list->sentinel.prev, node);
+}
+
+/*
+ * clist_unlink
+ *
+ * Takes a node off the list it is on.
+ */
+static inline void
+clist_unlink (clist_st *list, node_st *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = node->prev = NULL;
+    list->count--;
+}
+
+static inline node_st *
+clist_pop_head (clist_st *list)
+{
+    node_st  *node;
+
+    node = clist_head (list);
+    if (node)
+        clist_unlink (list, node);
+    return (node);
+}
+
+static inline node_st *
+clist_pop_tail (clist_st *list)
+{
+    node_st  *node;
+
+    node = clist_tail (list);
+    if (node)
+        clist_unlink (list, node);
+    return (node);
+}
+
+/*
+ * clist_splice_tail
+ *
+ * Moves all the nodes of src, in order, to the tail of dst.
+ * src is left empty.
+ */
+static inline void
+clist_splice_tail (clist_st *dst, clist_st *src)
+{
+    node_st  *first, *last;
+
+    if (clist_empty (src))
+        return;
+
+    first = src->sentinel.next;
+    last = src->sentinel.prev;
+    first->prev = dst->sentinel.prev;
+    dst->sentinel.prev->next = first;
+    last->next = &dst->sentinel;
+    dst->sentinel.prev = last;
+    dst->count += src->count;
+    clist_init (src);
+}
+
+/*
+ * clist_splice_head
+ *
+ * Moves all the nodes of src, in order, to the head of dst.
+ * src is left empty.
+ */
+static inline void
+clist_splice_head (clist_st *dst, clist_st *src)
+{
+    node_st  *first, *last;
+
+    if (clist_empty (src))
+        return;
+
+    first = src->sentinel.next;
+    last = src->sentinel.prev;
+    last->next = dst->sentinel.next;
+    dst->sentinel.next->prev = last;
+    first->prev = &dst->sentinel;
+    dst->sentinel.next = first;
+    dst->count += src->count;
+    clist_init (src);
+}
+
+/*
+ * clist_push_tail_batch
+ *
+ * Chains n nodes together and links them in at the tail at once.
+ */
+static inline void
+clist_push_tail_batch (clist_st *list, node_st **nodes, uint n)
+{
+    node_st  *prev;
+    uint      k;
+
+    if (n == 0)
+        return;
+
+    prev = list->sentinel.prev;
+    for (k = 0; k < n; k++) {
+        nodes[k]->prev = prev;
+        prev->next = nodes[k];
+        prev = nodes[k];
+    }
+    prev->next = &list->sentinel;
+    list->sentinel.prev = prev;
+    list->count += n;
+}
+
+/*
+ * clist_pop_head_batch
+ *
+ * Takes up to n nodes off the head into out, returns how many.
+ * The list is cut once after the last one.
+ */
+static inline uint
+clist_pop_head_batch (clist_st *list, node_st **out, uint n)
+{
+    node_st  *node;
+    uint      k;
+
+    node = list->sentinel.next;
+    for (k = 0; k < n && node != &list->sentinel; k++) {
+        out[k] = node;
+        node = node->next;
+    }
+    if (k == 0)
+        return (0);
+
+    list->sentinel.next = node;
+    node->prev = &list->sentinel;
+    list->count -= k;
+    return (k);
+}
+
+#endif
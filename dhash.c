@@ -0,0 +1,272 @@
+#include "dhash.h"
+
+/*
+ * bucket_of
+ *
+ * Fibonacci hashing, the top bits of the hash times 2^32 / phi,
+ * so a weak hash function still spreads over the buckets.
+ */
+static inline uint
+bucket_of (uint hash_value, uint bits)
+{
+    return ((uint) (((uint32_t) hash_value * 0x9E3779B1U) >> (32 - bits)));
+}
+
+static inline void
+link_in (node_st **head, node_st *link)
+{
+    link->prev = NULL;
+    link->next = *head;
+    if (link->next)
+        link->next->prev = link;
+    *head = link;
+}
+
+static inline void
+link_out (node_st **head, node_st *link)
+{
+    if (link->prev)
+        link->prev->next = link->next;
+    else
+        *head = link->next;
+    if (link->next)
+        link->next->prev = link->prev;
+    link->next = link->prev = NULL;
+}
+
+/*
+ * old_head
+ *
+ * The old bucket for a hash value, if it has not been moved yet.
+ */
+static inline node_st **
+old_head (dhash_st *hash, uint hash_value)
+{
+    uint  i;
+
+    if (!hash->old.buckets)
+        return (NULL);
+    i = bucket_of (hash_value, hash->old.bits);
+    if (i < hash->migrate)
+        return (NULL);
+    return (&hash->old.buckets[i]);
+}
+
+static inline node_st **
+new_head (dhash_st *hash, uint hash_value)
+{
+    return (&hash->table.buckets[bucket_of (hash_value, hash->table.bits)]);
+}
+
+/*
+ * migrate
+ *
+ * Moves up to n old buckets into the table, freeing the old
+ * buckets after the last one.
+ */
+static void
+migrate (dhash_st *hash, uint n)
+{
+    node_st  *link;
+
+    while (hash->old.buckets && n--) {
+        while ((link = hash->old.buckets[hash->migrate]) != NULL) {
+            link_out (&hash->old.buckets[hash->migrate], link);
+            link_in (new_head (hash, hash->hash_fn (DHASH_NODE(hash, link))),
+                     link);
+        }
+        if (++hash->migrate == (1U << hash->old.bits)) {
+            free (hash->old.buckets);
+            hash->old.buckets = NULL;
+            hash->migrate = 0;
+        }
+    }
+}
+
+/*
+ * grow
+ *
+ * Starts moving everything into a table twice the size.  Without
+ * memory for it the chains just get longer.
+ */
+static void
+grow (dhash_st *hash)
+{
+    node_st  **buckets;
+    uint       bits;
+
+    if (hash->old.buckets)
+        migrate (hash, ~0U);
+
+    bits = hash->table.bits + 1;
+    if (bits > 31)
+        return;
+    buckets = (node_st **) calloc ((size_t) 1 << bits, sizeof (node_st *));
+    if (!buckets)
+        return;
+
+    hash->old = hash->table;
+    hash->migrate = 0;
+    hash->table.buckets = buckets;
+    hash->table.bits = bits;
+}
+
+/*
+ * find_in
+ *
+ * The first element of a chain equal to to_node, or, when member
+ * is set, the element member itself.
+ */
+static node_st *
+find_in (dhash_st *hash, node_st *link, node_st *to_node, node_st *member)
+{
+    node_st  *node;
+
+    for (; link; link = link->next) {
+        node = DHASH_NODE(hash, link);
+        if (member ? node == member : hash->cmp_fn (node, to_node) == 0)
+            return (node);
+    }
+    return (NULL);
+}
+
+static node_st *
+lookup (dhash_st *hash, node_st *to_node, node_st *member)
+{
+    node_st  **head, *node;
+    uint       hash_value;
+
+    if (!hash || !to_node)
+        return (NULL);
+
+    hash_value = hash->hash_fn (to_node);
+    head = old_head (hash, hash_value);
+    if (head) {
+        node = find_in (hash, *head, to_node, member);
+        if (node)
+            return (node);
+    }
+    return (find_in (hash, *new_head (hash, hash_value), to_node, member));
+}
+
+/*
+ * dhash_init
+ *
+ * Init a new hash table, allocating it when *hash is NULL.  The
+ * chain links are link_offset bytes into each element.
+ */
+int
+dhash_init (dhash_st **hash, uint link_offset, node_hash_fn hash_fn,
+            node_cmp_fn cmp_fn)
+{
+    if (!hash || !hash_fn || !cmp_fn)
+        return (-1);
+
+    if (*hash == NULL)
+        *hash = (dhash_st *) malloc (sizeof (dhash_st));
+    if (*hash == NULL)
+        return (-1);
+
+    memset (*hash, 0, sizeof (dhash_st));
+    (*hash)->table.bits = DHASH_MIN_BITS;
+    (*hash)->table.buckets =
+        (node_st **) calloc (1U << DHASH_MIN_BITS, sizeof (node_st *));
+    if (!(*hash)->table.buckets)
+        return (-1);
+
+    (*hash)->link_offset = link_offset;
+    (*hash)->hash_fn = hash_fn;
+    (*hash)->cmp_fn = cmp_fn;
+    return (0);
+}
+
+/*
+ * dhash_destroy
+ *
+ * Frees the buckets, the elements are left alone.  The table
+ * itself is left to the caller.
+ */
+void
+dhash_destroy (dhash_st *hash)
+{
+    if (!hash)
+        return;
+
+    free (hash->table.buckets);
+    free (hash->old.buckets);
+    memset (hash, 0, sizeof (dhash_st));
+}
+
+/*
+ * dhash_insert
+ *
+ * Adds an element, equal ones are kept too.
+ */
+int
+dhash_insert (dhash_st *hash, node_st *node)
+{
+    if (!hash || !node)
+        return (-1);
+
+    if (hash->count >= (1U << hash->table.bits))
+        grow (hash);
+    migrate (hash, DHASH_MIGRATE);
+
+    link_in (new_head (hash, hash->hash_fn (node)), DHASH_LINK(hash, node));
+    hash->count++;
+    return (0);
+}
+
+/*
+ * dhash_remove
+ *
+ * Takes out an element that is in the table, without looking for
+ * it unless it heads its chain.
+ */
+int
+dhash_remove (dhash_st *hash, node_st *node)
+{
+    node_st  **head, *link;
+    uint       hash_value;
+
+    if (!hash || !node)
+        return (-1);
+
+    link = DHASH_LINK(hash, node);
+    head = NULL;
+    if (!link->prev) {
+        hash_value = hash->hash_fn (node);
+        head = old_head (hash, hash_value);
+        if (!head || *head != link)
+            head = new_head (hash, hash_value);
+        if (*head != link)
+            return (-1);
+    }
+
+    link_out (head, link);
+    hash->count--;
+    migrate (hash, DHASH_MIGRATE);
+    return (0);
+}
+
+/*
+ * dhash_find
+ *
+ * Finds an element equal to to_node.
+ */
+node_st *
+dhash_find (dhash_st *hash, node_st *to_node)
+{
+    return (lookup (hash, to_node, NULL));
+}
+
+/*
+ * dhash_is_member
+ *
+ * Whether the element itself is in the table.
+ */
+boolean
+dhash_is_member (dhash_st *hash, node_st *node)
+{
+    return (lookup (hash, node, node) != NULL);
+}
@@ -0,0 +1,61 @@
+#ifndef __DHASH_H__
+#define __DHASH_H__
+
+/*
+ * An intrusive chained hash table of node_st's.
+ * The chains are doubly linked through a node_st inside each
+ * element, link_offset bytes from its start, so a member comes
+ * out in O(1) and the table allocates nothing but its buckets.
+ * With a link_offset of 0 the element's own next/prev are used,
+ * otherwise the element can be on a dlist and in the table at the
+ * same time, which is how a dlist gets an index (dlist_set_index).
+ *
+ * Elements are hashed with a node_hash_fn and matched with the
+ * same node_cmp_fn a dlist uses, against a probe node holding the
+ * key, as dlist_find_node() does.
+ *
+ * The table doubles when it holds as many elements as buckets.
+ * It does not rehash all at once: the old buckets stay around and
+ * every insert and remove moves DHASH_MIGRATE of them over, while
+ * finds look in both.  The table does not shrink.
+ */
+
+#include "dlist.h"
+
+#define  DHASH_MIN_BITS   4    /* 16 buckets to start with */
+#define  DHASH_MIGRATE    8    /* old buckets moved per insert or remove */
+
+typedef uint (*node_hash_fn) (struct _node_st *node);
+
+typedef struct _dhash_table_st {
+    node_st     **buckets;
+    uint          bits;     /* 1 << bits buckets */
+} dhash_table_st;
+
+typedef struct _dhash_st {
+    dhash_table_st  table;
+    dhash_table_st  old;       /* being moved into table, if buckets */
+    uint            migrate;   /* old buckets before this one are moved */
+    uint            count;
+    uint            link_offset;
+    node_hash_fn    hash_fn;
+    node_cmp_fn     cmp_fn;
+} dhash_st;
+
+/*
+ * the chain links of an element, and the element of a link.
+ */
+#define  DHASH_LINK(hash, node) \
+    ((node_st *) ((char *) (node) + (hash)->link_offset))
+#define  DHASH_NODE(hash, link) \
+    ((node_st *) ((char *) (link) - (hash)->link_offset))
+
+extern int dhash_init (dhash_st **hash, uint link_offset,
+                       node_hash_fn hash_fn, node_cmp_fn cmp_fn);
+extern void dhash_destroy (dhash_st *hash);
+extern int dhash_insert (dhash_st *hash, node_st *node);
+extern int dhash_remove (dhash_st *hash, node_st *node);
+extern node_st * dhash_find (dhash_st *hash, node_st *to_node);
+extern boolean dhash_is_member (dhash_st *hash, node_st *node);
+
+#endif
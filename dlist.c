@@ -1,4 +1,5 @@
 #include "dlist.h"
+#include "dhash.h"
 
 /*
  * get_last_node.
@@ -250,10 +251,15 @@ dequeue_local (dlist_st *dlist, node_st *node, boolean is_a_member)
     /*
      * Make sure that node is a member of our list.
      */
-    if (!is_a_member && !is_member (dlist, node)) {
-        return -1; 
+    if (!is_a_member) {
+        if (dlist->index ? !dhash_is_member (dlist->index, node)
+                         : !is_member (dlist, node))
+            return -1;
     }
 
+    if (dlist->index)
+        dhash_remove (dlist->index, node);
+
     if (dlist->head == node) 
         dlist->head = node->next;
 
@@ -293,6 +299,34 @@ dlist_init (dlist_st **dlist, node_free_fn free_fn, node_cmp_fn cmp_fn )
     (*dlist)->free_fn = free_fn;
     (*dlist)->cmp_fn = cmp_fn;
     (*dlist)->count = 0;
+    (*dlist)->index = NULL;
+    return 0;
+}
+
+/*
+ * dlist_set_index
+ *
+ * Keeps an empty hash table of the nodes in step with the list,
+ * so finds with the table's compare method and membership checks
+ * no longer walk the list.  The table has to link the nodes
+ * through a node_st of their own, not the one the list uses.
+ * A NULL index drops it.
+ */
+int
+dlist_set_index (dlist_st *dlist, struct _dhash_st *index)
+{
+    node_st *cur_node;
+
+    if (!dlist)
+        return -1;
+
+    if (index) {
+        if (index->link_offset == 0 || index->count != 0)
+            return -1;
+        for (cur_node = dlist->head; cur_node; cur_node = cur_node->next)
+            dhash_insert (index, cur_node);
+    }
+    dlist->index = index;
     return 0;
 }
 
@@ -308,6 +342,9 @@ dlist_find_node (dlist_st *dlist, node_cmp_fn cmp, node_st *to_node)
 
     if (!dlist || !dlist->head) return (NULL);
 
+    if (dlist->index && cmp == dlist->index->cmp_fn)
+        return (dhash_find (dlist->index, to_node));
+
     cur_node = dlist->head;
 
     /* 
@@ -353,6 +390,9 @@ dlist_enqueue (dlist_st *dlist, node_st *node)
     else 
         node_hook = get_last_node (dlist->head);
 
+    if (dlist->index)
+        dhash_insert (dlist->index, node);
+
     /* add to head */
     if (!node_hook) {
         node->next = dlist->head;
@@ -376,6 +416,29 @@ dlist_enqueue (dlist_st *dlist, node_st *node)
     return 0; 
 }
 
+/*
+ * enqueue_head
+ *
+ * Push a node on the head of an unsorted dlist, without
+ * walking to the end of the list.
+ */
+int
+dlist_enqueue_head (dlist_st *dlist, node_st *node)
+{
+    if (!dlist  || !node || dlist->cmp_fn)
+        return -1;
+
+    node->next = dlist->head;
+    node->prev = NULL;
+    if (node->next)
+        node->next->prev = node;
+    dlist->head = node;
+    dlist->count++;
+    if (dlist->index)
+        dhash_insert (dlist->index, node);
+    return 0;
+}
+
 /*
  * dequeue
  *
@@ -389,6 +452,18 @@ dlist_dequeue (dlist_st *dlist, node_st *node)
     return (dequeue_local (dlist, node, FALSE));
 }
 
+/*
+ * dequeue_member
+ *
+ * Dequeue's a node the caller knows is a member of this
+ * list, skipping the membership walk.
+ */
+int
+dlist_dequeue_member (dlist_st *dlist, node_st *node)
+{
+    return (dequeue_local (dlist, node, TRUE));
+}
+
 /*
  * dequeue_head
  *
@@ -442,6 +517,128 @@ dlist_find_and_dequeue (dlist_st *dlist, node_cmp_fn cmp, node_st *to_node)
     return (dequeue_local( dlist, node, TRUE));
 }
 
+/*
+ * merge_chains
+ *
+ * Merges two next-linked, NULL terminated chains sorted by cmp.
+ * On equal nodes the one from a comes first, which keeps the sort
+ * stable as long as a holds the earlier nodes.
+ */
+static node_st *
+merge_chains (node_st *a, node_st *b, node_cmp_fn cmp)
+{
+    node_st   head, *tail;
+
+    tail = &head;
+    while (a && b) {
+        if (cmp (a, b) <= 0) {
+            tail->next = a;
+            a = a->next;
+        } else {
+            tail->next = b;
+            b = b->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = a ? a : b;
+    return (head.next);
+}
+
+/*
+ * relink_prev
+ *
+ * Puts the prev pointers back after the nodes were chained
+ * through next alone.
+ */
+static void
+relink_prev (node_st *head)
+{
+    node_st *prev;
+
+    for (prev = NULL; head; prev = head, head = head->next)
+        head->prev = prev;
+}
+
+/*
+ * sort
+ *
+ * A stable merge sort of the list, with cmp or else the list's own
+ * compare method, in O(n log n) and without allocating.  The nodes
+ * are taken off into runs of 1, 2, 4, .. nodes, bins[i] holding
+ * 2^i of them, merging as a binary counter carries.  A bin always
+ * holds earlier nodes than the carry merged into it, so equal
+ * nodes keep their order.
+ */
+int
+dlist_sort (dlist_st *dlist, node_cmp_fn cmp)
+{
+    node_st   *bins[64], *node, *next, *carry;
+    int        i, top;
+
+    if (!dlist)
+        return -1;
+    if (!cmp)
+        cmp = dlist->cmp_fn;
+    if (!cmp)
+        return -1;
+
+    top = 0;
+    for (node = dlist->head; node; node = next) {
+        next = node->next;
+        node->next = NULL;
+        carry = node;
+        for (i = 0; i < top && bins[i]; i++) {
+            carry = merge_chains (bins[i], carry, cmp);
+            bins[i] = NULL;
+        }
+        if (i == top)
+            top++;
+        bins[i] = carry;
+    }
+
+    carry = NULL;
+    for (i = 0; i < top; i++) {
+        if (bins[i])
+            carry = merge_chains (bins[i], carry, cmp);
+    }
+    dlist->head = carry;
+    relink_prev (dlist->head);
+    return 0;
+}
+
+/*
+ * merge
+ *
+ * Moves all the nodes of run, which has to be sorted the same
+ * way, into the sorted dlist in one pass over both.  Nodes of the
+ * dlist come before equal nodes of the run.  An unsorted run can
+ * be put through dlist_sort() first.  The run is left empty.
+ */
+int
+dlist_merge (dlist_st *dlist, dlist_st *run)
+{
+    node_st *node;
+
+    if (!dlist || !run || !dlist->cmp_fn)
+        return -1;
+
+    if (run->index) {
+        for (node = run->head; node; node = node->next)
+            dhash_remove (run->index, node);
+    }
+    if (dlist->index) {
+        for (node = run->head; node; node = node->next)
+            dhash_insert (dlist->index, node);
+    }
+
+    dlist->head = merge_chains (dlist->head, run->head, dlist->cmp_fn);
+    relink_prev (dlist->head);
+    dlist->count += run->count;
+    run->head = NULL;
+    run->count = 0;
+    return 0;
+}
+
 /* --------------------------------------------*/
 /* Example doubly linked list.                 */
 /* --------------------------------------------*/
@@ -11,6 +11,7 @@
  * Forward declaration.
  */
 struct _node_st;
+struct _dhash_st;
 
 typedef void (*node_free_fn) (struct _node_st *);
 typedef int  (*node_cmp_fn)(struct _node_st *cur_node, 
@@ -38,12 +39,16 @@ typedef struct _dlist_st {
                            /* from the list. */
     node_cmp_fn   cmp_fn;  /* A pointer to a compare function to keep */
                            /* the list sorted. */
+    struct _dhash_st *index; /* A hash of the nodes by key, kept in */
+                           /* step with the list, if set. */
 } dlist_st;
 
 
 extern int dlist_ptr_cmp (node_st *cur_node, node_st *to_node);
 extern int dlist_enqueue (dlist_st *dlist, node_st *node);
+extern int dlist_enqueue_head (dlist_st *dlist, node_st *node);
 extern int dlist_dequeue (dlist_st *dlist, node_st *node);
+extern int dlist_dequeue_member (dlist_st *dlist, node_st *node);
 extern int dlist_find_and_dequeue (dlist_st *dlist, node_cmp_fn cmp, 
                                    node_st *to_node);
 extern node_st * dlist_dequeue_head (dlist_st *dlist);
@@ -52,5 +57,8 @@ extern node_st * dlist_find_node (dlist_st *dlist, node_cmp_fn cmp,
         node_st *to_node);
 extern int dlist_init (dlist_st **dlist, 
 		node_free_fn free_fn, node_cmp_fn cmp_fn );
+extern int dlist_set_index (dlist_st *dlist, struct _dhash_st *index);
+extern int dlist_sort (dlist_st *dlist, node_cmp_fn cmp);
+extern int dlist_merge (dlist_st *dlist, dlist_st *run);
 
 #endif
@@ -0,0 +1,438 @@
+#include <stdint.h>
+#include <pthread.h>
+
+#include "dlist_lf.h"
+
+#define  LF_MARK            ((uintptr_t) 1)
+#define  IS_MARKED(p)       (((uintptr_t) (p)) & LF_MARK)
+#define  MARKED(p)          ((node_st *) (((uintptr_t) (p)) | LF_MARK))
+#define  UNMARKED(p)        ((node_st *) (((uintptr_t) (p)) & ~LF_MARK))
+
+#define  LOAD(p)            __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+
+#define  LF_EPOCHS          3
+#define  LF_ACTIVE          ((uint64_t) 1)
+
+typedef struct _lf_retired_st {
+    node_st       *node;
+    node_free_fn   free_fn;
+} lf_retired_st;
+
+/*
+ * the nodes a thread retired during one epoch.
+ */
+typedef struct _lf_limbo_st {
+    lf_retired_st  *items;
+    uint            count;
+    uint            size;
+} lf_limbo_st;
+
+/*
+ * One per thread, never freed, a thread that exits leaves its
+ * record for the next one to pick up with whatever is in limbo.
+ * state is the epoch seen shifted left once, with LF_ACTIVE set
+ * while in a list operation.
+ */
+typedef struct _lf_thread_st {
+    uint64_t                state;
+    uint64_t                epoch;    /* last epoch this thread saw */
+    uint                    nesting;
+    uint                    in_use;
+    uint                    retires;
+    lf_limbo_st             limbo[LF_EPOCHS];
+    struct _lf_thread_st   *next;
+} __attribute__((aligned(64))) lf_thread_st;
+
+static uint64_t          lf_epoch_g;
+static lf_thread_st     *lf_threads_g;
+static __thread lf_thread_st  *lf_self;
+static pthread_key_t     lf_key_g;
+static pthread_once_t    lf_once_g = PTHREAD_ONCE_INIT;
+
+static inline boolean
+cas_next (node_st **link, node_st *expected, node_st *desired)
+{
+    return (__atomic_compare_exchange_n (link, &expected, desired, FALSE,
+                                         __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE));
+}
+
+static void
+limbo_free (lf_limbo_st *limbo)
+{
+    uint  i;
+
+    for (i = 0; i < limbo->count; i++) {
+        if (limbo->items[i].free_fn)
+            (*limbo->items[i].free_fn)(limbo->items[i].node);
+    }
+    limbo->count = 0;
+}
+
+/*
+ * thread_gone
+ *
+ * pthread key destructor, hands the record back.
+ */
+static void
+thread_gone (void *data)
+{
+    lf_thread_st  *self;
+
+    self = (lf_thread_st *) data;
+    __atomic_store_n (&self->state, 0, __ATOMIC_RELEASE);
+    self->nesting = 0;
+    __atomic_store_n (&self->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+make_key ()
+{
+    pthread_key_create (&lf_key_g, thread_gone);
+}
+
+/*
+ * get_self
+ *
+ * The calling thread's record, taking a free one or adding a new
+ * one the first time.
+ */
+static lf_thread_st *
+get_self ()
+{
+    lf_thread_st  *self, *head;
+    uint           unused;
+
+    if (lf_self)
+        return (lf_self);
+
+    pthread_once (&lf_once_g, make_key);
+    for (self = LOAD(&lf_threads_g); self; self = self->next) {
+        unused = 0;
+        if (__atomic_compare_exchange_n (&self->in_use, &unused, 1, FALSE,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+    }
+
+    if (!self) {
+        if (posix_memalign ((void **) &self, 64, sizeof (lf_thread_st)) != 0)
+            abort ();
+        memset (self, 0, sizeof (lf_thread_st));
+        self->in_use = 1;
+        self->epoch = LOAD(&lf_epoch_g);
+        head = LOAD(&lf_threads_g);
+        do {
+            self->next = head;
+        } while (!__atomic_compare_exchange_n (&lf_threads_g, &head, self,
+                                               FALSE, __ATOMIC_ACQ_REL,
+                                               __ATOMIC_ACQUIRE));
+    }
+
+    pthread_setspecific (lf_key_g, self);
+    lf_self = self;
+    return (self);
+}
+
+/*
+ * try_advance
+ *
+ * Moves the epoch on if every thread in a list operation has
+ * seen the current one.
+ */
+static void
+try_advance ()
+{
+    lf_thread_st  *t;
+    uint64_t       epoch, state;
+
+    epoch = __atomic_load_n (&lf_epoch_g, __ATOMIC_SEQ_CST);
+    for (t = LOAD(&lf_threads_g); t; t = t->next) {
+        state = __atomic_load_n (&t->state, __ATOMIC_SEQ_CST);
+        if ((state & LF_ACTIVE) && (state >> 1) != epoch)
+            return;
+    }
+    __atomic_compare_exchange_n (&lf_epoch_g, &epoch, epoch + 1, FALSE,
+                                 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * retire
+ *
+ * Puts an unlinked node in limbo for the current epoch.  If there
+ * is no memory for that the node is leaked rather than freed
+ * early.
+ */
+static void
+retire (dlist_lf_st *list, node_st *node)
+{
+    lf_thread_st   *self;
+    lf_limbo_st    *limbo;
+    lf_retired_st  *items;
+    uint            size;
+
+    self = get_self ();
+    limbo = &self->limbo[self->epoch % LF_EPOCHS];
+    if (limbo->count == limbo->size) {
+        size = limbo->size ? limbo->size * 2 : DLIST_LF_ADVANCE_EVERY;
+        items = (lf_retired_st *) realloc (limbo->items,
+                                           size * sizeof (lf_retired_st));
+        if (!items)
+            return;
+        limbo->items = items;
+        limbo->size = size;
+    }
+    limbo->items[limbo->count].node = node;
+    limbo->items[limbo->count].free_fn = list->free_fn;
+    limbo->count++;
+
+    if (++self->retires >= DLIST_LF_ADVANCE_EVERY) {
+        self->retires = 0;
+        try_advance ();
+    }
+}
+
+/*
+ * dlist_lf_enter
+ *
+ * Marks the calling thread as in a list operation, nothing it
+ * reaches from a list is freed until it leaves.  On a new epoch
+ * the nodes it retired three epochs back are freed.
+ */
+void
+dlist_lf_enter ()
+{
+    lf_thread_st  *self;
+    uint64_t       epoch;
+
+    self = get_self ();
+    if (self->nesting++)
+        return;
+
+    epoch = __atomic_load_n (&lf_epoch_g, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&self->state, (epoch << 1) | LF_ACTIVE,
+                      __ATOMIC_SEQ_CST);
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+    if (self->epoch != epoch) {
+        self->epoch = epoch;
+        limbo_free (&self->limbo[epoch % LF_EPOCHS]);
+    }
+}
+
+void
+dlist_lf_exit ()
+{
+    lf_thread_st  *self;
+
+    self = get_self ();
+    if (--self->nesting)
+        return;
+    __atomic_store_n (&self->state, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * dlist_lf_reclaim
+ *
+ * Frees everything every thread has retired.  Only for when no
+ * thread is in a list operation, at shutdown say.
+ */
+void
+dlist_lf_reclaim ()
+{
+    lf_thread_st  *t;
+    uint           i;
+
+    for (t = LOAD(&lf_threads_g); t; t = t->next) {
+        for (i = 0; i < LF_EPOCHS; i++)
+            limbo_free (&t->limbo[i]);
+    }
+}
+
+/*
+ * search
+ *
+ * Finds the first unmarked node not less than to_node and the
+ * node before it, unlinking the marked nodes in between.  Returns
+ * that node, NULL at the end of the list, with *pred set.
+ */
+static node_st *
+search (dlist_lf_st *list, node_st *to_node, node_st **pred)
+{
+    node_st  *prev, *cur, *next;
+
+retry:
+    prev = &list->head;
+    cur = UNMARKED(LOAD(&prev->next));
+    while (cur) {
+        next = LOAD(&cur->next);
+        if (IS_MARKED(next)) {
+            if (!cas_next (&prev->next, cur, UNMARKED(next)))
+                goto retry;
+            retire (list, cur);
+            cur = UNMARKED(next);
+            continue;
+        }
+        if (list->cmp_fn (cur, to_node) >= 0)
+            break;
+        prev = cur;
+        cur = next;
+    }
+    *pred = prev;
+    return (cur);
+}
+
+/*
+ * dlist_lf_init
+ *
+ * Init a new lock-free list, allocating it when *list is NULL.
+ */
+int
+dlist_lf_init (dlist_lf_st **list, node_free_fn free_fn, node_cmp_fn cmp_fn)
+{
+    if (!list || !cmp_fn)
+        return (-1);
+
+    if (*list == NULL)
+        *list = (dlist_lf_st *) malloc (sizeof (dlist_lf_st));
+    if (*list == NULL)
+        return (-1);
+
+    memset (*list, 0, sizeof (dlist_lf_st));
+    (*list)->free_fn = free_fn;
+    (*list)->cmp_fn = cmp_fn;
+    return (0);
+}
+
+/*
+ * dlist_lf_destroy
+ *
+ * Gives every node still linked to the free function.  No other
+ * thread may be using the list.  The list itself is left to the
+ * caller.
+ */
+void
+dlist_lf_destroy (dlist_lf_st *list)
+{
+    node_st  *node, *next;
+
+    if (!list)
+        return;
+
+    for (node = UNMARKED(list->head.next); node; node = next) {
+        next = UNMARKED(node->next);
+        if (list->free_fn)
+            (*list->free_fn)(node);
+    }
+    list->head.next = NULL;
+    list->count = 0;
+}
+
+/*
+ * dlist_lf_enqueue
+ *
+ * Inserts a node in order.  Fails if a node equal to it is in
+ * the list already.
+ */
+int
+dlist_lf_enqueue (dlist_lf_st *list, node_st *node)
+{
+    node_st  *pred, *cur;
+
+    if (!list || !node)
+        return (-1);
+
+    dlist_lf_enter ();
+    for (;;) {
+        cur = search (list, node, &pred);
+        if (cur && list->cmp_fn (cur, node) == 0) {
+            dlist_lf_exit ();
+            return (-1);
+        }
+        node->next = cur;
+        node->prev = NULL;
+        if (cas_next (&pred->next, cur, node))
+            break;
+    }
+    __atomic_add_fetch (&list->count, 1, __ATOMIC_RELAXED);
+    dlist_lf_exit ();
+    return (0);
+}
+
+/*
+ * dlist_lf_find_and_dequeue
+ *
+ * Deletes the node equal to to_node.  The node goes to the free
+ * function once no thread can be looking at it.
+ */
+int
+dlist_lf_find_and_dequeue (dlist_lf_st *list, node_st *to_node)
+{
+    node_st  *pred, *cur, *next;
+
+    if (!list || !to_node)
+        return (-1);
+
+    dlist_lf_enter ();
+    for (;;) {
+        cur = search (list, to_node, &pred);
+        if (!cur || list->cmp_fn (cur, to_node) != 0) {
+            dlist_lf_exit ();
+            return (-1);
+        }
+        next = LOAD(&cur->next);
+        if (IS_MARKED(next))
+            continue;
+        if (cas_next (&cur->next, next, MARKED(next)))
+            break;
+    }
+
+    if (cas_next (&pred->next, cur, next))
+        retire (list, cur);
+    else
+        search (list, to_node, &pred);
+    __atomic_sub_fetch (&list->count, 1, __ATOMIC_RELAXED);
+    dlist_lf_exit ();
+    return (0);
+}
+
+/*
+ * dlist_lf_find_node
+ *
+ * Finds the node equal to to_node without writing anything.  The
+ * caller must be between dlist_lf_enter() and dlist_lf_exit() for
+ * as long as it uses the node.
+ */
+node_st *
+dlist_lf_find_node (dlist_lf_st *list, node_st *to_node)
+{
+    node_st  *cur;
+    int       cmp_result;
+
+    if (!list || !to_node)
+        return (NULL);
+
+    dlist_lf_enter ();
+    cmp_result = -1;
+    cur = UNMARKED(LOAD(&list->head.next));
+    while (cur) {
+        cmp_result = list->cmp_fn (cur, to_node);
+        if (cmp_result >= 0)
+            break;
+        cur = UNMARKED(LOAD(&cur->next));
+    }
+    if (cur && (cmp_result != 0 || IS_MARKED(LOAD(&cur->next))))
+        cur = NULL;
+    dlist_lf_exit ();
+    return (cur);
+}
+
+/*
+ * dlist_lf_contains
+ *
+ * Whether a node equal to to_node is in the list.
+ */
+boolean
+dlist_lf_contains (dlist_lf_st *list, node_st *to_node)
+{
+    return (dlist_lf_find_node (list, to_node) != NULL);
+}
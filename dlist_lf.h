@@ -0,0 +1,57 @@
+#ifndef __DLIST_LF_H__
+#define __DLIST_LF_H__
+
+/*
+ * A lock-free sorted list of node_st's, Harris' list with Michael's
+ * way of unlinking.
+ * The list is a set ordered by its node_cmp_fn, linked through
+ * node->next alone.  The low bit of a node's next pointer marks the
+ * node deleted, so:
+ *
+ *   - an insert links a node in with one compare-and-swap on its
+ *     predecessor's next, which fails if the predecessor was
+ *     marked or got a new successor meanwhile.
+ *   - a delete first marks the node's own next, which is what
+ *     takes it out of the set, then swings the predecessor past
+ *     it.  Whoever walks over a marked node tries to unlink it too,
+ *     and whoever manages to unlink it retires it.
+ *   - a find only reads, so readers never hold up writers.
+ *
+ * A retired node is not given to the free function until every
+ * thread that was in a list operation at the time has left it.
+ * This is epoch based: a thread in an operation publishes the
+ * global epoch it saw, the epoch moves on once every such thread
+ * has seen it, and what was retired two epochs back is freed.
+ * node->prev is not used by the list.
+ *
+ * A thread that keeps a node found by dlist_lf_find_node() has to
+ * stay between dlist_lf_enter() and dlist_lf_exit() while it uses
+ * it.  The calls nest, and every list operation makes them itself.
+ */
+
+#include "dlist.h"
+
+/*
+ * a thread tries to move the epoch on after this many retires.
+ */
+#define  DLIST_LF_ADVANCE_EVERY   64
+
+typedef struct _dlist_lf_st {
+    node_st       head;     /* head.next is the first node */
+    uint          count;    /* nodes in the set, updated atomically */
+    node_free_fn  free_fn;  /* called on a node once it is safe to */
+    node_cmp_fn   cmp_fn;   /* orders the list, must not be NULL */
+} dlist_lf_st;
+
+extern int dlist_lf_init (dlist_lf_st **list, node_free_fn free_fn,
+                          node_cmp_fn cmp_fn);
+extern void dlist_lf_destroy (dlist_lf_st *list);
+extern int dlist_lf_enqueue (dlist_lf_st *list, node_st *node);
+extern int dlist_lf_find_and_dequeue (dlist_lf_st *list, node_st *to_node);
+extern node_st * dlist_lf_find_node (dlist_lf_st *list, node_st *to_node);
+extern boolean dlist_lf_contains (dlist_lf_st *list, node_st *to_node);
+extern void dlist_lf_enter (void);
+extern void dlist_lf_exit (void);
+extern void dlist_lf_reclaim (void);
+
+#endif
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "dlist_lf.h"
+
+/*
+ * Checks the lock-free list against a plain array from one thread,
+ * then hammers it from many threads and compares the throughput
+ * with a sorted dlist behind a mutex.
+ *
+ *   gcc -O2 -o dlist_lf_test dlist_lf_test.c dlist_lf.c dlist.c \
+ *       dhash.c -lpthread
+ *   ./dlist_lf_test [max_threads]
+ */
+
+#define  KEYS             1024
+#define  OPS_PER_THREAD   400000
+#define  FIND_PERCENT     80
+#define  NODE_MAGIC       0x5eedf00dU
+
+typedef struct _key_node_st {
+    struct _node_st    *next;
+    struct _node_st    *prev;
+    uint                key;
+    uint                magic;
+} key_node_st;
+
+typedef struct _test_ctxt_st {
+    pthread_t      thread_id;
+    unsigned int   seed;
+    int64_t        net[KEYS];    /* inserts - deletes by this thread */
+} test_ctxt_st;
+
+dlist_lf_st        *lf_list_g;
+dlist_st           *serial_list_g;
+pthread_mutex_t     serial_lock_g = PTHREAD_MUTEX_INITIALIZER;
+boolean             use_lf_g;
+uint64_t            freed_g;
+
+static int
+key_cmp (node_st *cur_node, node_st *to_node)
+{
+    uint  a, b;
+
+    a = ((key_node_st *) cur_node)->key;
+    b = ((key_node_st *) to_node)->key;
+    return (a < b ? -1 : a > b);
+}
+
+/*
+ * a freed node is poisoned, a reader that still had it would
+ * trip over the magic.
+ */
+static void
+key_free (node_st *node)
+{
+    ((key_node_st *) node)->magic = 0;
+    __atomic_add_fetch (&freed_g, 1, __ATOMIC_RELAXED);
+    free (node);
+}
+
+static key_node_st *
+new_key_node (uint key)
+{
+    key_node_st  *node;
+
+    node = (key_node_st *) malloc (sizeof (key_node_st));
+    node->next = node->prev = NULL;
+    node->key = key;
+    node->magic = NODE_MAGIC;
+    return (node);
+}
+
+static boolean
+test_insert (uint key)
+{
+    key_node_st  *node, probe;
+    boolean       done;
+
+    node = new_key_node (key);
+    if (use_lf_g) {
+        if (dlist_lf_enqueue (lf_list_g, (node_st *) node) == 0)
+            return (TRUE);
+        free (node);
+        return (FALSE);
+    }
+
+    probe.key = key;
+    pthread_mutex_lock (&serial_lock_g);
+    done = !dlist_find_node (serial_list_g, key_cmp, (node_st *) &probe);
+    if (done)
+        dlist_enqueue (serial_list_g, (node_st *) node);
+    pthread_mutex_unlock (&serial_lock_g);
+    if (!done)
+        free (node);
+    return (done);
+}
+
+static boolean
+test_delete (uint key)
+{
+    key_node_st  probe;
+    int          status;
+
+    probe.key = key;
+    if (use_lf_g)
+        return (dlist_lf_find_and_dequeue (lf_list_g, (node_st *) &probe) == 0);
+
+    pthread_mutex_lock (&serial_lock_g);
+    status = dlist_find_and_dequeue (serial_list_g, key_cmp,
+                                     (node_st *) &probe);
+    pthread_mutex_unlock (&serial_lock_g);
+    return (status == 0);
+}
+
+static boolean
+test_find (uint key)
+{
+    key_node_st  probe, *node;
+    boolean      found;
+
+    probe.key = key;
+    if (use_lf_g) {
+        dlist_lf_enter ();
+        node = (key_node_st *) dlist_lf_find_node (lf_list_g,
+                                                   (node_st *) &probe);
+        if (node)
+            assert (node->magic == NODE_MAGIC && node->key == key);
+        dlist_lf_exit ();
+        return (node != NULL);
+    }
+
+    pthread_mutex_lock (&serial_lock_g);
+    node = (key_node_st *) dlist_find_node (serial_list_g, key_cmp,
+                                            (node_st *) &probe);
+    found = (node != NULL);
+    pthread_mutex_unlock (&serial_lock_g);
+    return (found);
+}
+
+static void *
+thread_loop (void *data)
+{
+    test_ctxt_st  *ctxt;
+    uint           key, op;
+    int            i;
+
+    ctxt = (test_ctxt_st *) data;
+    for (i = 0; i < OPS_PER_THREAD; i++) {
+        key = rand_r (&ctxt->seed) % KEYS;
+        op = rand_r (&ctxt->seed) % 100;
+        if (op < FIND_PERCENT)
+            test_find (key);
+        else if (op % 2)
+            ctxt->net[key] += test_insert (key);
+        else
+            ctxt->net[key] -= test_delete (key);
+    }
+    return (NULL);
+}
+
+/*
+ * test_serial
+ *
+ * Runs random inserts and deletes from one thread against an
+ * array of what should be in the set, and checks the order.
+ */
+static void
+test_serial ()
+{
+    static boolean  in[KEYS];
+    key_node_st     probe, *node;
+    node_st        *cur;
+    unsigned int    seed;
+    uint            key, count, last;
+    int             i;
+
+    assert (dlist_lf_init (&lf_list_g, key_free, key_cmp) == 0);
+    seed = 1;
+    for (i = 0; i < 200000; i++) {
+        key = rand_r (&seed) % KEYS;
+        probe.key = key;
+        if (rand_r (&seed) % 2) {
+            node = new_key_node (key);
+            if (in[key]) {
+                assert (dlist_lf_enqueue (lf_list_g, (node_st *) node) != 0);
+                free (node);
+            } else {
+                assert (dlist_lf_enqueue (lf_list_g, (node_st *) node) == 0);
+            }
+            in[key] = TRUE;
+        } else {
+            assert ((dlist_lf_find_and_dequeue (lf_list_g,
+                                                (node_st *) &probe) == 0) ==
+                    in[key]);
+            in[key] = FALSE;
+        }
+        assert (dlist_lf_contains (lf_list_g, (node_st *) &probe) == in[key]);
+    }
+
+    count = 0;
+    last = 0;
+    for (cur = lf_list_g->head.next; cur; cur = cur->next) {
+        node = (key_node_st *) cur;
+        assert (in[node->key] && (count == 0 || node->key > last));
+        last = node->key;
+        count++;
+    }
+    for (key = 0; key < KEYS; key++)
+        count -= in[key];
+    assert (count == 0);
+
+    dlist_lf_destroy (lf_list_g);
+    dlist_lf_reclaim ();
+    printf ("serial: ok\n");
+}
+
+static double
+run_threads (int nthreads)
+{
+    test_ctxt_st     *ctxt;
+    struct timespec   t0, t1;
+    int64_t           net;
+    int               i, k;
+
+    ctxt = (test_ctxt_st *) calloc (nthreads, sizeof(test_ctxt_st));
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nthreads; i++) {
+        ctxt[i].seed = i + 1;
+        pthread_create (&ctxt[i].thread_id, NULL, thread_loop, &ctxt[i]);
+    }
+    for (i = 0; i < nthreads; i++)
+        pthread_join (ctxt[i].thread_id, NULL);
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+
+    /*
+     * every key is in the set as many times as it was inserted
+     * minus deleted, over all threads, which is 0 or 1.
+     */
+    for (k = 0; k < KEYS; k++) {
+        net = 0;
+        for (i = 0; i < nthreads; i++)
+            net += ctxt[i].net[k];
+        assert (net == 0 || net == 1);
+        assert (test_find (k) == (net == 1));
+        if (net)
+            assert (test_delete (k));
+    }
+    free (ctxt);
+
+    return ((double) nthreads * OPS_PER_THREAD /
+            ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9));
+}
+
+int
+main (int argc, char **argv)
+{
+    double  lf_ops, serial_ops;
+    int     max_threads, n;
+
+    max_threads = (argc > 1) ? atoi (argv[1]) : 32;
+
+    test_serial ();
+
+    dlist_init (&serial_list_g, key_free, key_cmp);
+    printf ("%8s %14s %14s\n", "threads", "lock-free/s", "mutex/s");
+    for (n = 1; n <= max_threads; n *= 2) {
+        use_lf_g = 1;
+        lf_ops = run_threads (n);
+        assert (lf_list_g->count == 0 && lf_list_g->head.next == NULL);
+
+        use_lf_g = 0;
+        serial_ops = run_threads (n);
+        assert (serial_list_g->count == 0);
+        printf ("%8d %14.0f %14.0f\n", n, lf_ops, serial_ops);
+    }
+    dlist_lf_reclaim ();
+    free (lf_list_g);
+    free (serial_list_g);
+    return (0);
+}
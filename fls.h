@@ -0,0 +1,74 @@
+#ifndef __FLS_H__
+#define __FLS_H__
+
+#include <stdint.h>
+
+/*
+ * Bit scan helpers used by the allocators.  Both return the
+ * bit position (0..31) or -1 when no bit is set.
+ */
+
+/**
+ * ffs - find first bit set
+ * @x: the word to search
+ *
+ * This is defined the same way as
+ * the libc and compiler builtin ffs routines, therefore
+ * differs in spirit from the above ffz (man ffs).
+ */
+static __inline__ int 
+TLSF_ffs (int x)
+{
+	int r;
+
+	__asm__("bsfl %1,%0\n\t"
+		"jnz 1f\n\t"
+		"movl $-1,%0\n"
+		"1:" : "=r" (r) : "rm" (x));
+	return r;
+}
+
+
+/**
+ * fls - find last bit set
+ * @x: the word to search
+ *
+ * This is defined the same way as
+ * the libc and compiler builtin ffs routines, therefore
+ * differs in spirit from the above ffz (man ffs).
+ */
+static __inline__ int 
+TLSF_fls (int x)
+{
+	int r;
+
+	__asm__("bsrl %1,%0\n\t"
+		"jnz 1f\n\t"
+		"movl $-1,%0\n"
+		"1:" : "=r" (r) : "rm" (x));
+	return r;
+}
+
+/**
+ * 64 bit versions, built from the 32 bit scans.
+ * @x: the word to search
+ */
+static __inline__ int
+TLSF_ffs64 (uint64_t x)
+{
+	if ((uint32_t) x)
+		return TLSF_ffs ((int) (uint32_t) x);
+	if (x >> 32)
+		return 32 + TLSF_ffs ((int) (uint32_t) (x >> 32));
+	return -1;
+}
+
+static __inline__ int
+TLSF_fls64 (uint64_t x)
+{
+	if (x >> 32)
+		return 32 + TLSF_fls ((int) (uint32_t) (x >> 32));
+	return TLSF_fls ((int) (uint32_t) x);
+}
+
+#endif
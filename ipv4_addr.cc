@@ -4,8 +4,42 @@
 #include <regex.h>        
 #include "ipv4_addr.h"
 #include "logger.h"
+#include "object_pool.h"
 
-patriciaTrieNode<address_t> *root = new patriciaTrieNode<address_t>();
+extern "C" {
+#include "lru_cache.h"
+}
+
+#define IP_CACHE_SIZE	4096	/* findIp results kept */
+
+/*
+ * The trie nodes, their keys and the addresses all come from object
+ * pools.  Keys that are only looked up live on the stack.
+ */
+typedef ObjectPool<patriciaTrieNode<address_t> > nodePool;
+typedef ObjectPool<patriciaTrieKey> keyPool;
+typedef ObjectPool<address_t> addressPool;
+
+patriciaTrieNode<address_t> *root = nodePool::instance().create();
+
+/*
+ * findIp() results by address, misses included.  Any insert or
+ * delete can move nodes around in the trie, so it invalidates the
+ * whole cache.
+ */
+static lru_cache_st *ipCache() {
+	static lru_cache_st cache;
+	static bool ready = (lru_cache_init(&cache, IP_CACHE_SIZE) == 0);
+
+	return ready ? &cache : NULL;
+}
+
+static inline void invalidateIpCache() {
+	lru_cache_st *cache = ipCache();
+
+	if (cache)
+		lru_cache_invalidate_all(cache);
+}
 
 inline unsigned int getValue(address_t *addr) {
 	unsigned int ip = 0;
@@ -18,89 +52,103 @@ inline unsigned int getValue(address_t *addr) {
 	return ip;
 }
 
-unsigned int parseAddress(char *ip, address_t *addr) {
-	const char *s = ".";
-	char *token;
-	int i = 0;
-
-	/* get the first token */
-	token = strtok(ip, s);
-	addr->bytes[i++] = (unsigned char) atoi(token);
-
-	/* walk through other tokens */
-	while (token != NULL) {
-		token = strtok(NULL, s);
-		if (i > 3 && token == NULL) {
-			break;
-		} else {
-			addr->bytes[i++] = (unsigned char) atoi(token);
-		}
+inline void setValue(address_t *addr, unsigned int ip) {
+	addr->bytes[0] = (ip >> 24) & 0xFF;
+	addr->bytes[1] = (ip >> 16) & 0xFF;
+	addr->bytes[2] = (ip >> 8) & 0xFF;
+	addr->bytes[3] = (ip & 0xFF);
+}
+
+/*
+ * Parses a dotted quad in place, without copying or allocating.
+ * Returns false unless it is exactly four numbers up to 255, *ip
+ * then has what was parsed up to the error.
+ */
+static bool parseIpv4(const char *s, unsigned int *ip) {
+	unsigned int octet;
+	int i, digits;
+
+	*ip = 0;
+	for (i = 0; i < 4; i++) {
+		if (i > 0 && *s++ != '.')
+			return false;
+		octet = 0;
+		for (digits = 0; *s >= '0' && *s <= '9' && digits < 3; digits++)
+			octet = octet * 10 + (*s++ - '0');
+		if (digits == 0 || octet > 255)
+			return false;
+		*ip = (*ip << 8) | octet;
 	}
-	return getValue(addr);
+	return *s == '\0';
 }
 
+unsigned int parseAddress(char *ip, address_t *addr) {
+	unsigned int key;
+
+	parseIpv4(ip, &key);
+	setValue(addr, key);
+	return key;
+}
+
+/*
+ * insertIp(), allocIp(), findIp() and deleteIp() return NULL for a
+ * string that is not a dotted quad, or a mask that is not 0..32,
+ * without touching the trie, the pools or the cache.
+ */
 address_t *insertIp(const char *ipstr) {
-	address_t *ip = (address_t *) malloc(sizeof(address_t));
-	char *ipstr_dup = strndup(ipstr, strlen(ipstr));
-	unsigned int key = parseAddress(ipstr_dup, ip);
-	free(ipstr_dup);
+	unsigned int key;
 
+	if (!parseIpv4(ipstr, &key))
+		return NULL;
+
+	address_t *ip = addressPool::instance().create();
+	setValue(ip, key);
+	invalidateIpCache();
 	log_info("###### insertIp for %s\n", ipstr);
-	patriciaTrieKey *ptk = new patriciaTrieKey((key & bitMask(32)), 32);
+	patriciaTrieKey *ptk = keyPool::instance().create((key & bitMask(32)), 32);
 	root->insertNode(ptk, ip);
         return ip;
 }
 
 address_t *allocIp(const char *subnet, int mask) {
-	address_t ip = { '0' };
-	char *subnet_dup = strndup(subnet, strlen(subnet));
-	unsigned int key = parseAddress(subnet_dup, &ip);
-	free(subnet_dup);
+	unsigned int key;
+
+	if (mask < 0 || mask > 32 || !parseIpv4(subnet, &key))
+		return NULL;
 
+	invalidateIpCache();
 	log_info("###### allocIp for %s\n", subnet);
-	patriciaTrieKey *ptk = new patriciaTrieKey((key & bitMask(mask)), mask);
-	patriciaTrieNode<address_t> *r = root->lookup(ptk);
+	patriciaTrieKey ptk((key & bitMask(mask)), mask);
+	patriciaTrieNode<address_t> *r = root->lookup(&ptk);
 	if (r != NULL) {
 		int i = 0;
 		while (true) {
 			i++;
 			unsigned int newIp = (key & bitMask(mask)) + i;
 			log_info("new Ip %d - %u\n", i, newIp);
-			patriciaTrieKey *child = new patriciaTrieKey(newIp,
+			patriciaTrieKey probe(newIp,
 					32 - r->GetKey()->getBitIdxBegin(),
 					r->GetKey()->getBitIdxBegin());
-			if (child != NULL) {
-				patriciaTrieNode<address_t> *found = r->lookup(child);
-				if (found != NULL) {
-					free(child);
-					child = NULL;
-				} else {
-					patriciaTrieKey *child = new patriciaTrieKey(newIp, 32);
-					address_t *ipv4 = (address_t *) malloc(sizeof(address_t));
-					ipv4->bytes[0] = (newIp >> 24) & 0xFF;
-					ipv4->bytes[1] = (newIp >> 16) & 0xFF;
-					ipv4->bytes[2] = (newIp >> 8) & 0xFF;
-					ipv4->bytes[3] = (newIp & 0xFF);
-					root->insertNode(child, ipv4);
-					log_info("inserted child\n");
-					child->print();
-					log_info("========== inserted child done =========== \n");
-					return ipv4;
-					break;
-				}
+			patriciaTrieNode<address_t> *found = r->lookup(&probe);
+			if (found == NULL) {
+				patriciaTrieKey *child = keyPool::instance().create(newIp, 32);
+				address_t *ipv4 = addressPool::instance().create();
+				setValue(ipv4, newIp);
+				root->insertNode(child, ipv4);
+				log_info("inserted child\n");
+				child->print();
+				log_info("========== inserted child done =========== \n");
+				return ipv4;
 			}
 		}
 	} else {
 		log_info("subnet %s not found!!\n", subnet);
 		int i = 1;
 		unsigned int newIp = (key & bitMask(mask)) + i;
-		patriciaTrieKey *child = new patriciaTrieKey(newIp, 32);
+		patriciaTrieKey *child = keyPool::instance().create(newIp, 32);
 		if (child != NULL) {
-			address_t *ipv4 = (address_t *) malloc(sizeof(address_t));
-			ipv4->bytes[0] = (newIp >> 24) & 0xFF;
-			ipv4->bytes[1] = (newIp >> 16) & 0xFF;
-			ipv4->bytes[2] = (newIp >> 8) & 0xFF;
-			ipv4->bytes[3] = (newIp & 0xFF);
+			address_t *ipv4 = addressPool::instance().create();
+			setValue(ipv4, newIp);
 			root->insertNode(child, ipv4);
 			return ipv4;
 		}
@@ -108,40 +156,72 @@ address_t *allocIp(const char *subnet, int mask) {
 	return NULL;
 }
 
+/*
+ * Repeated lookups of an address are answered from ipCache()
+ * without touching the trie.
+ */
 patriciaTrieNode<address_t> *
 findIp(const char *ipstr) {
-	address_t ip = { '0' };
-	char *ipdup = strndup(ipstr, strlen(ipstr));
-	unsigned int key = parseAddress(ipdup, &ip);
-	free(ipdup);
-
-	patriciaTrieKey *ptk = new patriciaTrieKey(key, 32);
-	patriciaTrieNode<address_t> *r = root->lookup(ptk);
-	delete ptk;
+	lru_cache_st *cache = ipCache();
+	unsigned int key;
+	void *cached;
+
+	if (!parseIpv4(ipstr, &key))
+		return NULL;
+	if (cache && lru_cache_get(cache, key, &cached))
+		return (patriciaTrieNode<address_t> *) cached;
+
+	patriciaTrieKey ptk(key, 32);
+	patriciaTrieNode<address_t> *r = root->lookup(&ptk);
+	if (cache)
+		lru_cache_put(cache, key, r);
 	return r;
 }
 
+/*
+ * The node returned is out of the trie, it goes back to the pool
+ * with nodePool::instance().destroy(), not delete.
+ */
 patriciaTrieNode<address_t> *
 deleteIp(const char *ipstr) {
-	address_t ip = { '0' };
-	char *ipdup = strndup(ipstr, strlen(ipstr));
-	unsigned int key = parseAddress(ipdup, &ip);
-	free(ipdup);
-
-	patriciaTrieKey *ptk = new patriciaTrieKey(key, 32);
-	patriciaTrieNode<address_t> *r = root->deleteNode(ptk);
-	delete ptk;
-	return r;
+	unsigned int key;
+
+	if (!parseIpv4(ipstr, &key))
+		return NULL;
+	invalidateIpCache();
+	patriciaTrieKey ptk(key, 32);
+	return root->deleteNode(&ptk);
 }
 
 patriciaTrieNode<address_t> *
 deleteIp(address_t *ip) {
         if (!ip) return NULL;
         unsigned int key = getValue(ip);
-	patriciaTrieKey *ptk = new patriciaTrieKey(key, 32);
-	patriciaTrieNode<address_t> *r = root->deleteNode(ptk);
-	delete ptk;
-	return r;
+	invalidateIpCache();
+	patriciaTrieKey ptk(key, 32);
+	return root->deleteNode(&ptk);
+}
+
+/*
+ * The findIp() cache counters, NULL if there is no cache.
+ */
+const lru_stats_st *ipCacheStats() {
+	lru_cache_st *cache = ipCache();
+
+	return cache ? &cache->stats : NULL;
+}
+
+void printIpCacheStats() {
+	const lru_stats_st *stats = ipCacheStats();
+
+	if (!stats)
+		return;
+	log_info("findIp cache: %llu hits %llu misses %llu evictions "
+		 "%llu invalidations\n",
+		 (unsigned long long) stats->hits,
+		 (unsigned long long) stats->misses,
+		 (unsigned long long) stats->evictions,
+		 (unsigned long long) stats->invalidations);
 }
 
 void printIpList() {
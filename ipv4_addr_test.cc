@@ -4,6 +4,7 @@
 #include <regex.h>
 #include "ipv4_addr.h"
 #include "logger.h"
+#include "object_pool.h"
 
 #include <iostream>
 #include <string>
@@ -11,6 +12,104 @@
 
 using namespace std;
 
+typedef ObjectPool<patriciaTrieNode<address_t> > nodePool;
+typedef ObjectPool<patriciaTrieKey> keyPool;
+
+struct lpmPrefix {
+	unsigned int key;
+	int len;
+	address_t addr;
+};
+
+/*
+ * The longest of the first n prefixes covering addr, by scanning
+ * them all.
+ */
+static lpmPrefix *lpmScan(vector<lpmPrefix> &prefixes, size_t n,
+		unsigned int addr) {
+	lpmPrefix *best = NULL;
+
+	for (size_t i = 0; i < n; i++) {
+		lpmPrefix *p = &prefixes[i];
+		if ((addr & bitMask(p->len)) == p->key
+				&& (best == NULL || p->len > best->len)) {
+			best = p;
+		}
+	}
+	return best;
+}
+
+static int lpmProbe(patriciaTrieNode<address_t> *trie,
+		vector<lpmPrefix> &prefixes, size_t n, unsigned int addr) {
+	lpmPrefix *want = lpmScan(prefixes, n, addr);
+	patriciaTrieNode<address_t> *got = trie->lpmLookup(addr);
+
+	if ((got ? got->GetData() : NULL) != (want ? &want->addr : NULL)) {
+		fprintf(stdout, "lpmLookup 0x%08x: got %s, want /%d\n", addr,
+				got ? "a node" : "NULL", want ? want->len : -1);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Checks lpmLookup() against lpmScan(): first the case of shorter
+ * prefixes inserted after a longer one, then random prefixes from
+ * /8 to /32 in random order.  Returns the number of mismatches.
+ */
+static int lpmCheck() {
+	static const int lens[] = { 8, 12, 16, 20, 24, 28, 32 };
+	static const unsigned int fixed[][2] = {
+		{ 0x0a010203, 32 }, { 0x0a010000, 16 }, { 0x0a000000, 8 } };
+	vector<lpmPrefix> prefixes;
+	int bad = 0;
+
+	prefixes.reserve(256);
+	for (int i = 0; i < 3; i++) {
+		lpmPrefix p = { fixed[i][0], (int) fixed[i][1] };
+		prefixes.push_back(p);
+	}
+	srand(1);
+	while (prefixes.size() < 256) {
+		lpmPrefix p;
+		p.len = lens[rand() % 7];
+		p.key = (0x0a000000 | (rand() & 0x0003ffff) << 6) & bitMask(p.len);
+		bool present = false;
+		for (size_t i = 0; i < prefixes.size(); i++) {
+			present |= prefixes[i].key == p.key && prefixes[i].len == p.len;
+		}
+		if (!present) {
+			prefixes.push_back(p);
+		}
+	}
+
+	patriciaTrieNode<address_t> *trie = nodePool::instance().create();
+	for (size_t i = 0; i < prefixes.size(); i++) {
+		trie->insertNode(
+				keyPool::instance().create(prefixes[i].key, prefixes[i].len),
+				&prefixes[i].addr);
+		if (i == 2) {
+			bad += lpmProbe(trie, prefixes, 3, 0x0a010203);
+			bad += lpmProbe(trie, prefixes, 3, 0x0a018304);
+			bad += lpmProbe(trie, prefixes, 3, 0x0b000001);
+		}
+	}
+
+	for (int i = 0; i < 200000; i++) {
+		unsigned int addr = (unsigned int) rand() << 16 ^ rand();
+		if (i % 2) {
+			lpmPrefix *p = &prefixes[rand() % prefixes.size()];
+			addr = p->key | (addr & ~bitMask(p->len));
+		}
+		bad += lpmProbe(trie, prefixes, prefixes.size(), addr);
+	}
+
+	nodePool::instance().destroy(trie);
+	fprintf(stdout, "lpmLookup: %zu prefixes, %d mismatches\n",
+			prefixes.size(), bad);
+	return bad;
+}
+
 int _main(int argc, char **argv) {
 
 	char addr1[] = "172.35.254.2";
@@ -49,12 +148,12 @@ int _main(int argc, char **argv) {
 	char _addr1[] = "172.25.25.8";
 	patriciaTrieNode<address_t> * p1 = deleteIp(_addr1);
 	if (p1)
-		delete p1;
+		ObjectPool<patriciaTrieNode<address_t> >::instance().destroy(p1);
 
 	char _addr2[] = "172.25.25.5";
 	patriciaTrieNode<address_t> * p2 = deleteIp(_addr2);
 	if (p2)
-		delete p2;
+		ObjectPool<patriciaTrieNode<address_t> >::instance().destroy(p2);
 
 	for (int i = 0; i < 10; i++) {
 		string ip = "172.25.25." + std::to_string(i);
@@ -70,4 +169,5 @@ int _main(int argc, char **argv) {
 */
 	printIpList();
 
+	return lpmCheck() == 0 ? 0 : 1;
 }
@@ -0,0 +1,180 @@
+#include <stddef.h>
+
+#include "lru_cache.h"
+
+static uint
+entry_hash (node_st *node)
+{
+    return (((lru_entry_st *) node)->key);
+}
+
+static int
+entry_cmp (node_st *cur_node, node_st *to_node)
+{
+    uint32_t  a, b;
+
+    a = ((lru_entry_st *) cur_node)->key;
+    b = ((lru_entry_st *) to_node)->key;
+    return (a < b ? -1 : a > b);
+}
+
+/*
+ * drop
+ *
+ * Takes an entry out of the index and the recency list, and puts
+ * it on the free list.
+ */
+static void
+drop (lru_cache_st *cache, lru_entry_st *entry)
+{
+    dhash_remove (cache->index, &entry->lru);
+    clist_unlink (&cache->lru, &entry->lru);
+    clist_push_head (&cache->free, &entry->lru);
+}
+
+static lru_entry_st *
+find (lru_cache_st *cache, uint32_t key)
+{
+    lru_entry_st  probe;
+
+    probe.key = key;
+    return ((lru_entry_st *) dhash_find (cache->index, &probe.lru));
+}
+
+/*
+ * lru_cache_init
+ *
+ * Sets up a cache of capacity entries.
+ */
+int
+lru_cache_init (lru_cache_st *cache, uint capacity)
+{
+    uint  i;
+
+    if (!cache || capacity == 0)
+        return (-1);
+
+    memset (cache, 0, sizeof (lru_cache_st));
+    clist_init (&cache->lru);
+    clist_init (&cache->free);
+    cache->entries = (lru_entry_st *) calloc (capacity, sizeof (lru_entry_st));
+    if (!cache->entries)
+        return (-1);
+    if (dhash_init (&cache->index, offsetof(lru_entry_st, link),
+                    entry_hash, entry_cmp) != 0) {
+        free (cache->entries);
+        cache->entries = NULL;
+        return (-1);
+    }
+
+    for (i = 0; i < capacity; i++)
+        clist_push_tail (&cache->free, &cache->entries[i].lru);
+    cache->capacity = capacity;
+    return (0);
+}
+
+void
+lru_cache_destroy (lru_cache_st *cache)
+{
+    if (!cache)
+        return;
+
+    dhash_destroy (cache->index);
+    free (cache->index);
+    free (cache->entries);
+    memset (cache, 0, sizeof (lru_cache_st));
+}
+
+/*
+ * lru_cache_get
+ *
+ * Looks a key up, and on a hit makes it the most recent entry.
+ */
+boolean
+lru_cache_get (lru_cache_st *cache, uint32_t key, void **value)
+{
+    lru_entry_st  *entry;
+
+    entry = find (cache, key);
+    if (entry && entry->generation != cache->generation) {
+        drop (cache, entry);
+        entry = NULL;
+    }
+    if (!entry) {
+        cache->stats.misses++;
+        return (FALSE);
+    }
+
+    if (cache->lru.sentinel.next != &entry->lru) {
+        clist_unlink (&cache->lru, &entry->lru);
+        clist_push_head (&cache->lru, &entry->lru);
+    }
+    cache->stats.hits++;
+    *value = entry->value;
+    return (TRUE);
+}
+
+/*
+ * lru_cache_put
+ *
+ * Caches a value for a key, taking a free entry or the least
+ * recently used one.
+ */
+void
+lru_cache_put (lru_cache_st *cache, uint32_t key, void *value)
+{
+    lru_entry_st  *entry;
+
+    entry = find (cache, key);
+    if (entry) {
+        clist_unlink (&cache->lru, &entry->lru);
+    } else {
+        entry = (lru_entry_st *) clist_pop_head (&cache->free);
+        if (!entry) {
+            entry = (lru_entry_st *) clist_pop_tail (&cache->lru);
+            dhash_remove (cache->index, &entry->lru);
+            if (entry->generation == cache->generation)
+                cache->stats.evictions++;
+        }
+        entry->key = key;
+        dhash_insert (cache->index, &entry->lru);
+    }
+
+    entry->generation = cache->generation;
+    entry->value = value;
+    clist_push_head (&cache->lru, &entry->lru);
+}
+
+/*
+ * lru_cache_invalidate
+ *
+ * Forgets one key.
+ */
+void
+lru_cache_invalidate (lru_cache_st *cache, uint32_t key)
+{
+    lru_entry_st  *entry;
+
+    entry = find (cache, key);
+    if (entry)
+        drop (cache, entry);
+}
+
+/*
+ * lru_cache_invalidate_all
+ *
+ * Forgets every key.  When the generation wraps the entries are
+ * freed for real, so an old one cannot come back to life.
+ */
+void
+lru_cache_invalidate_all (lru_cache_st *cache)
+{
+    node_st  *node;
+
+    cache->stats.invalidations++;
+    if (++cache->generation != 0)
+        return;
+
+    while ((node = clist_head (&cache->lru)) != NULL)
+        drop (cache, (lru_entry_st *) node);
+}
@@ -0,0 +1,52 @@
+#ifndef __LRU_CACHE_H__
+#define __LRU_CACHE_H__
+
+/*
+ * A bounded LRU cache from a 32 bit key to a pointer.
+ * The entries are allocated once, up front.  They sit on a clist
+ * in recency order, most recent at the head, and in a dhash by
+ * key.  A lookup is a hash find and a move to the head, a miss
+ * that fills the cache takes the entry at the tail.
+ *
+ * Invalidating everything is a bump of the cache's generation.
+ * An entry from an older generation is a miss, and is reused
+ * when it is found or reaches the tail.
+ */
+
+#include "clist.h"
+#include "dhash.h"
+
+typedef struct _lru_entry_st {
+    node_st      lru;        /* on the recency or the free list */
+    node_st      link;       /* on a dhash chain */
+    uint32_t     key;
+    uint         generation;
+    void        *value;
+} lru_entry_st;
+
+typedef struct _lru_stats_st {
+    uint64_t     hits;
+    uint64_t     misses;
+    uint64_t     evictions;
+    uint64_t     invalidations;
+} lru_stats_st;
+
+typedef struct _lru_cache_st {
+    clist_st         lru;       /* entries in use, most recent first */
+    clist_st         free;
+    dhash_st        *index;
+    lru_entry_st    *entries;
+    uint             capacity;
+    uint             generation;
+    lru_stats_st     stats;
+} lru_cache_st;
+
+extern int lru_cache_init (lru_cache_st *cache, uint capacity);
+extern void lru_cache_destroy (lru_cache_st *cache);
+extern boolean lru_cache_get (lru_cache_st *cache, uint32_t key,
+                              void **value);
+extern void lru_cache_put (lru_cache_st *cache, uint32_t key, void *value);
+extern void lru_cache_invalidate (lru_cache_st *cache, uint32_t key);
+extern void lru_cache_invalidate_all (lru_cache_st *cache);
+
+#endif
@@ -1,97 +1,818 @@
 #include <stdio.h>
-#include <malloc.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "mem_alloc.h"
+
+typedef unsigned char uchar;
+typedef short boolean;
 
 #define  HEADER_SIZE     (sizeof (struct _block_header_st))
-#define  FOOTER_SIZE     (sizeof (uint))       /* has the address to header */
-#define  OVERHEAD        HEADER + FOOTER 
-#define  ALIGN8(N)       (8 * ((N+7)/8)
+#define  FOOTER_SIZE     (sizeof (uintptr_t))  /* has the address to header */
+#define  OVERHEAD        (HEADER_SIZE + FOOTER_SIZE)
+
+/*
+ * Payloads are aligned to 16 bytes.  Blocks are a multiple of 16
+ * and start 8 bytes off a 16 byte boundary, so that the 24 byte
+ * header ends on one.
+ */
+#define  ALIGNMENT       16
+#define  ALIGN16(N)      (((N) + (ALIGNMENT - 1)) & ~((size_t) ALIGNMENT - 1))
+#define  MIN_BLOCK_SIZE  (OVERHEAD + ALIGNMENT)
+
+/*
+ * flags in the low bits of the header size.
+ */
+#define  SIZE_FREE       ((size_t) 0x1)
+#define  SIZE_MMAPPED    ((size_t) 0x2)
+#define  SIZE_FLAGS      (SIZE_FREE | SIZE_MMAPPED)
 
-#define  HEADER(p)      ((block_header_st *) (p - HEADER_SIZE))
-#define  TRAILER(p)     HEADER(p) + BLOCK_SIZE(p) - FOOTER_SIZE
+#define  HEADER(p)       ((block_header_st *) ((uchar *) (p) - HEADER_SIZE))
+#define  PAYLOAD(b)      ((void *) ((uchar *) (b) + HEADER_SIZE))
+#define  BLOCK_SIZE(b)   ((b)->size & ~SIZE_FLAGS)
+#define  TRAILER(b)      ((uchar *) (b) + BLOCK_SIZE(b) - FOOTER_SIZE)
 
-#define  PREV_BLOCK(p)  HEADER(p)->prev
-#define  NEXT_BLOCK(p)  HEADER(p)->next
-#define  BLOCK_SIZE(p)  HEADER(p)->size
+#define  NEXT_BLOCK(b)   ((block_header_st *) ((uchar *) (b) + BLOCK_SIZE(b)))
+#define  PREV_TRAILER(b) ((uchar *) (b) - FOOTER_SIZE)
 
-#define  GET(p)         (*(uint *)(p))
-#define  PUT(p, val)    (*(uint *)(p) = (val))
+#define  GET(p)          (*(uintptr_t *)(p))
+#define  PUT(p, val)     (*(uintptr_t *)(p) = (val))
 
-#define  SET_FREE(p)    PUT(TRAILER(p), ((uint)HEADER(p) | 0x1))
-#define  SET_USED(p)    PUT(TRAILER(p), ((uint)HEADER(p) & ~0x1))
+#define  SET_FREE(b)     ((b)->size |= SIZE_FREE, \
+                          PUT(TRAILER(b), ((uintptr_t) (b) | 0x1)))
+#define  SET_USED(b)     ((b)->size &= ~SIZE_FREE, \
+                          PUT(TRAILER(b), ((uintptr_t) (b) & ~0x1)))
+#define  IS_FREE(b)      (((b)->size & SIZE_FREE) != 0)
 
-typedef unsigned char uchar;
-typedef short boolean;
+/*
+ * Free lists.  Blocks up to SMALL_MAX bytes have a list per 16 byte
+ * size, so any block on a list fits.  Larger ones are kept in an AVL
+ * tree by size for best fit, see free_tree_st.
+ */
+#define  SMALL_MAX       1024
+#define  SMALL_CLASSES   (SMALL_MAX / ALIGNMENT + 1)
+#define  NUM_CLASSES     SMALL_CLASSES
+#define  CLASS_MAP_WORDS ((NUM_CLASSES + 63) / 64)
+
+/*
+ * Heap memory is grabbed from the system CHUNK_SIZE bytes at a time,
+ * requests of MMAP_THRESHOLD bytes or more get a mapping of their own.
+ */
+#define  CHUNK_SIZE      (1024 * 1024)
+#define  MMAP_THRESHOLD  (256 * 1024)
 
 /*
  * prologue block.
- * What is there at the front of the allocated 
+ * What is there at the front of the allocated
  * memory.
  */
 typedef struct  _block_header_st {
     struct _block_header_st *next;
     struct _block_header_st *prev;
-    uint                     size; /* size in bytes, which can also */
+    size_t                   size; /* size in bytes, which can also */
                                    /* tell us if the block is free or used */
 } block_header_st;
 
+/*
+ * A free block larger than SMALL_MAX.  There is one tree node per
+ * size, the other free blocks of that size hang off its next link
+ * with height 0, so most removals do not touch the tree.
+ */
+typedef struct  _free_tree_st {
+    struct _block_header_st     header;
+    struct _free_tree_st       *left;
+    struct _free_tree_st       *right;
+    struct _free_tree_st       *parent;
+    int                         height;  /* 0 for a block off a node */
+} free_tree_st;
+
+#define  TREE(b)         ((free_tree_st *) (b))
+
 typedef struct  _mem_manager_st {
-    struct _block_header_st    *free_list;
-    struct _block_header_st    *used_list;
+    struct _block_header_st    *free_lists[NUM_CLASSES];
+    struct _free_tree_st       *free_tree;
+    uint64_t                    class_map[CLASS_MAP_WORDS];
+    pthread_mutex_t             lock;
+    size_t                      page_size;
+    size_t                      mapped;    /* bytes we got from mmap */
 } mem_manager_st;
 
-mem_manager_st    mem_manager_g;
+mem_manager_st    mem_manager_g = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*
+ * size_class
+ *
+ * The free list a block of at most SMALL_MAX bytes lives on.
+ */
+static inline int
+size_class (size_t size)
+{
+    return (size / ALIGNMENT);
+}
+
+/*
+ * request_size
+ *
+ * The block size that holds a payload of size bytes.
+ */
+static inline size_t
+request_size (size_t size)
+{
+    size_t  bsize;
+
+    if (size > SIZE_MAX - OVERHEAD - ALIGNMENT)
+        return (0);
+
+    bsize = ALIGN16(size + OVERHEAD);
+    if (bsize < MIN_BLOCK_SIZE)
+        bsize = MIN_BLOCK_SIZE;
+    return (bsize);
+}
+
+static inline int
+tree_height (free_tree_st *t)
+{
+    return (t ? t->height : 0);
+}
+
+static inline void
+tree_update (free_tree_st *t)
+{
+    int  l, r;
+
+    l = tree_height (t->left);
+    r = tree_height (t->right);
+    t->height = 1 + (l > r ? l : r);
+}
+
+/*
+ * tree_replace
+ *
+ * Hangs new where old was under parent.
+ */
+static inline void
+tree_replace (free_tree_st *parent, free_tree_st *old, free_tree_st *new)
+{
+    if (!parent)
+        mem_manager_g.free_tree = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+static free_tree_st *
+tree_rotate_left (free_tree_st *x)
+{
+    free_tree_st  *y;
+
+    y = x->right;
+    x->right = y->left;
+    if (y->left)
+        y->left->parent = x;
+    y->parent = x->parent;
+    tree_replace (x->parent, x, y);
+    y->left = x;
+    x->parent = y;
+    tree_update (x);
+    tree_update (y);
+    return (y);
+}
+
+static free_tree_st *
+tree_rotate_right (free_tree_st *x)
+{
+    free_tree_st  *y;
+
+    y = x->left;
+    x->left = y->right;
+    if (y->right)
+        y->right->parent = x;
+    y->parent = x->parent;
+    tree_replace (x->parent, x, y);
+    y->right = x;
+    x->parent = y;
+    tree_update (x);
+    tree_update (y);
+    return (y);
+}
+
+/*
+ * tree_rebalance
+ *
+ * Walks up from t to the root fixing the heights, and rotates
+ * wherever the two sides differ by more than one.
+ */
+static void
+tree_rebalance (free_tree_st *t)
+{
+    int  balance;
+
+    for (; t; t = t->parent) {
+        tree_update (t);
+        balance = tree_height (t->left) - tree_height (t->right);
+        if (balance > 1) {
+            if (tree_height (t->left->left) < tree_height (t->left->right))
+                tree_rotate_left (t->left);
+            t = tree_rotate_right (t);
+        } else if (balance < -1) {
+            if (tree_height (t->right->right) < tree_height (t->right->left))
+                tree_rotate_right (t->right);
+            t = tree_rotate_left (t);
+        }
+    }
+}
+
+/*
+ * tree_insert
+ *
+ * Adds a free block to the tree, or behind the node of its size.
+ */
+static void
+tree_insert (block_header_st *block)
+{
+    free_tree_st  *t, *parent, **link;
+    size_t         size;
+
+    t = TREE(block);
+    size = BLOCK_SIZE(block);
+    parent = NULL;
+    link = &mem_manager_g.free_tree;
+    while (*link) {
+        parent = *link;
+        if (size == BLOCK_SIZE(&parent->header)) {
+            block->prev = &parent->header;
+            block->next = parent->header.next;
+            if (block->next)
+                block->next->prev = block;
+            parent->header.next = block;
+            t->height = 0;
+            return;
+        }
+        link = (size < BLOCK_SIZE(&parent->header)) ? &parent->left :
+                                                      &parent->right;
+    }
+
+    block->next = block->prev = NULL;
+    t->left = t->right = NULL;
+    t->parent = parent;
+    t->height = 1;
+    *link = t;
+    tree_rebalance (parent);
+}
+
+/*
+ * tree_remove
+ *
+ * Takes a free block out of the tree.  A node with blocks of the
+ * same size behind it is replaced by the first of them.
+ */
+static void
+tree_remove (block_header_st *block)
+{
+    free_tree_st  *z, *y, *x, *start;
+
+    z = TREE(block);
+    if (z->height == 0) {
+        block->prev->next = block->next;
+        if (block->next)
+            block->next->prev = block->prev;
+        return;
+    }
+
+    if (block->next) {
+        y = TREE(block->next);
+        y->header.prev = NULL;
+        y->left = z->left;
+        y->right = z->right;
+        y->parent = z->parent;
+        y->height = z->height;
+        if (y->left)
+            y->left->parent = y;
+        if (y->right)
+            y->right->parent = y;
+        tree_replace (z->parent, z, y);
+        return;
+    }
+
+    if (z->left && z->right) {
+
+        /*
+         * the next larger node, which has no left child, takes
+         * the place of z.
+         */
+        for (y = z->right; y->left; y = y->left)
+            ;
+        start = y;
+        if (y->parent != z) {
+            start = y->parent;
+            x = y->right;
+            start->left = x;
+            if (x)
+                x->parent = start;
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        y->left = z->left;
+        y->left->parent = y;
+        y->parent = z->parent;
+        y->height = z->height;
+        tree_replace (z->parent, z, y);
+        tree_rebalance (start);
+        return;
+    }
+
+    x = z->left ? z->left : z->right;
+    if (x)
+        x->parent = z->parent;
+    tree_replace (z->parent, z, x);
+    tree_rebalance (z->parent);
+}
+
+/*
+ * tree_best_fit
+ *
+ * The smallest free block of at least size bytes, NULL if none.
+ * Blocks behind a node go first, they leave the tree as it is.
+ */
+static block_header_st *
+tree_best_fit (size_t size)
+{
+    free_tree_st  *t, *best;
+
+    best = NULL;
+    for (t = mem_manager_g.free_tree; t; ) {
+        if (BLOCK_SIZE(&t->header) < size) {
+            t = t->right;
+        } else {
+            best = t;
+            if (BLOCK_SIZE(&t->header) == size)
+                break;
+            t = t->left;
+        }
+    }
+    if (!best)
+        return (NULL);
+    return (best->header.next ? best->header.next : &best->header);
+}
+
+static void
+free_list_insert (block_header_st *block)
+{
+    int  c;
+
+    if (BLOCK_SIZE(block) > SMALL_MAX) {
+        tree_insert (block);
+        return;
+    }
+
+    c = size_class (BLOCK_SIZE(block));
+    block->prev = NULL;
+    block->next = mem_manager_g.free_lists[c];
+    if (block->next)
+        block->next->prev = block;
+    mem_manager_g.free_lists[c] = block;
+    mem_manager_g.class_map[c / 64] |= ((uint64_t) 1 << (c % 64));
+}
+
+static void
+free_list_remove (block_header_st *block)
+{
+    int  c;
+
+    if (BLOCK_SIZE(block) > SMALL_MAX) {
+        tree_remove (block);
+        return;
+    }
+
+    c = size_class (BLOCK_SIZE(block));
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        mem_manager_g.free_lists[c] = block->next;
+    if (block->next)
+        block->next->prev = block->prev;
+
+    if (!mem_manager_g.free_lists[c])
+        mem_manager_g.class_map[c / 64] &= ~((uint64_t) 1 << (c % 64));
+}
+
+/*
+ * next_class
+ *
+ * The first non-empty class >= c, -1 if there is none.
+ */
+static int
+next_class (int c)
+{
+    uint64_t  word;
+    int       w;
+
+    for (w = c / 64; w < CLASS_MAP_WORDS; w++) {
+        word = mem_manager_g.class_map[w];
+        if (w == c / 64)
+            word &= ~(((uint64_t) 1 << (c % 64)) - 1);
+        if (word)
+            return (w * 64 + __builtin_ctzll (word));
+    }
+    return (-1);
+}
 
+/*
+ * init_mem_block
+ *
+ * Write the header and the trailer of a block.
+ */
 void
 init_mem_block (block_header_st *block_p, block_header_st *next, block_header_st *prev,
-        uint size, boolean is_free)
+        size_t size, boolean is_free)
 {
     block_p->next = next;
     block_p->prev = prev;
     block_p->size = size;
 
-    /* 
-     * put the address of the header in the trailer block. 
-     * The LSB is used to mark it free or used 
-     */ 
-     
+    /*
+     * put the address of the header in the trailer block.
+     * The LSB is used to mark it free or used
+     */
+
     if (is_free)
-       SET_FREE(block_p + HEADER_SIZE);
-    else 
-       SET_USED(block_p + HEADER_SIZE);
+       SET_FREE(block_p);
+    else
+       SET_USED(block_p);
+}
+
+/*
+ * alloc_chunk
+ *
+ * Grab a chunk of at least chunk_size bytes from the system and put
+ * it on the free lists as one block.  The chunk starts with a used
+ * trailer and ends with a zero sized used header, so coalescing
+ * never walks out of it.
+ */
+static block_header_st *
+alloc_chunk (size_t chunk_size)
+{
+    uchar            *base;
+    block_header_st  *block, *epilogue;
+    size_t            len;
+
+    len = chunk_size + FOOTER_SIZE + HEADER_SIZE;
+    len = (len + mem_manager_g.page_size - 1) & ~(mem_manager_g.page_size - 1);
+
+    base = (uchar *) mmap (NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return (NULL);
+    __sync_fetch_and_add (&mem_manager_g.mapped, len);
+
+    PUT(base, 0);
+
+    block = (block_header_st *) (base + FOOTER_SIZE);
+    init_mem_block (block, NULL, NULL, len - FOOTER_SIZE - HEADER_SIZE, 1);
+
+    epilogue = NEXT_BLOCK(block);
+    epilogue->size = 0;
+
+    free_list_insert (block);
+    return (block);
+}
+
+/*
+ * find_fit
+ *
+ * Find and unlink a free block of at least size bytes.
+ * A small request takes the head of the first non-empty class
+ * from its own up, everything else is best fit from the tree.
+ */
+static block_header_st *
+find_fit (size_t size)
+{
+    block_header_st  *block;
+    int               c;
+
+    block = NULL;
+    if (size <= SMALL_MAX) {
+        c = next_class (size_class (size));
+        if (c >= 0)
+            block = mem_manager_g.free_lists[c];
+    }
+    if (!block)
+        block = tree_best_fit (size);
+    if (block)
+        free_list_remove (block);
+    return (block);
+}
+
+/*
+ * coalesce
+ *
+ * Merge a free block, not on any list, with its free neighbours
+ * through the boundary tags.
+ */
+static block_header_st *
+coalesce (block_header_st *block)
+{
+    block_header_st  *next, *prev;
+    uintptr_t         trailer;
+    size_t            size;
+
+    size = BLOCK_SIZE(block);
+
+    next = NEXT_BLOCK(block);
+    if (IS_FREE(next)) {
+        free_list_remove (next);
+        size += BLOCK_SIZE(next);
+    }
+
+    trailer = GET(PREV_TRAILER(block));
+    if (trailer & 0x1) {
+        prev = (block_header_st *) (trailer & ~0x1);
+        free_list_remove (prev);
+        size += BLOCK_SIZE(prev);
+        block = prev;
+    }
+
+    init_mem_block (block, NULL, NULL, size, 1);
+    return (block);
+}
+
+/*
+ * split_block
+ *
+ * Cut a block down to size bytes and free the rest, if the rest
+ * is large enough to be a block.
+ */
+static void
+split_block (block_header_st *block, size_t size)
+{
+    block_header_st  *rest;
+    size_t            rest_size;
+
+    rest_size = BLOCK_SIZE(block) - size;
+    if (rest_size < MIN_BLOCK_SIZE)
+        return;
+
+    init_mem_block (block, NULL, NULL, size, 0);
+    rest = NEXT_BLOCK(block);
+    init_mem_block (rest, NULL, NULL, rest_size, 1);
+    free_list_insert (coalesce (rest));
+}
+
+/*
+ * alloc_mmapped
+ *
+ * Large requests get their own mapping.
+ */
+static void *
+alloc_mmapped (size_t size)
+{
+    uchar            *base;
+    block_header_st  *block;
+    size_t            len;
+
+    len = size + FOOTER_SIZE;
+    len = (len + mem_manager_g.page_size - 1) & ~(mem_manager_g.page_size - 1);
+    base = (uchar *) mmap (NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return (NULL);
+    __sync_fetch_and_add (&mem_manager_g.mapped, len);
+
+    block = (block_header_st *) (base + FOOTER_SIZE);
+    block->next = block->prev = NULL;
+    block->size = (len - FOOTER_SIZE) | SIZE_MMAPPED;
+    return (PAYLOAD(block));
+}
+
+static void
+free_mmapped (block_header_st *block)
+{
+    __sync_fetch_and_sub (&mem_manager_g.mapped,
+                          BLOCK_SIZE(block) + FOOTER_SIZE);
+    munmap ((uchar *) block - FOOTER_SIZE, BLOCK_SIZE(block) + FOOTER_SIZE);
+}
+
+/*
+ * malloc_locked
+ *
+ * Allocate a block of size bytes, the lock is held.
+ */
+static block_header_st *
+malloc_locked (size_t size)
+{
+    block_header_st  *block;
+
+    if (!mem_manager_g.page_size)
+        mem_manager_g.page_size = sysconf (_SC_PAGESIZE);
+
+    block = find_fit (size);
+    if (!block) {
+        if (!alloc_chunk (size > CHUNK_SIZE ? size : CHUNK_SIZE))
+            return (NULL);
+        block = find_fit (size);
+    }
+
+    SET_USED(block);
+    split_block (block, size);
+    return (block);
+}
+
+void *
+mem_malloc (size_t size)
+{
+    block_header_st  *block;
+    size_t            bsize;
+
+    bsize = request_size (size);
+    if (!bsize)
+        return (NULL);
+
+    if (bsize >= MMAP_THRESHOLD) {
+        if (!mem_manager_g.page_size)
+            mem_manager_g.page_size = sysconf (_SC_PAGESIZE);
+        return (alloc_mmapped (bsize));
+    }
+
+    pthread_mutex_lock (&mem_manager_g.lock);
+    block = malloc_locked (bsize);
+    pthread_mutex_unlock (&mem_manager_g.lock);
+
+    return (block ? PAYLOAD(block) : NULL);
+}
+
+void
+mem_free (void *ptr)
+{
+    block_header_st  *block;
+
+    if (!ptr)
+        return;
+
+    block = HEADER(ptr);
+    if (block->size & SIZE_MMAPPED) {
+        free_mmapped (block);
+        return;
+    }
+
+    pthread_mutex_lock (&mem_manager_g.lock);
+    SET_FREE(block);
+    free_list_insert (coalesce (block));
+    pthread_mutex_unlock (&mem_manager_g.lock);
+}
 
-    printf ("header addr = 0x%x, trailer addr = 0x%x, trailer = %d\n", 
-            block_p, TRAILER(block_p + HEADER_SIZE),
-            GET(TRAILER(block_p + HEADER_SIZE))); 
+void *
+mem_calloc (size_t nmemb, size_t size)
+{
+    void    *ptr;
+    size_t   total;
+
+    if (size && nmemb > SIZE_MAX / size)
+        return (NULL);
+    total = nmemb * size;
+
+    ptr = mem_malloc (total);
+    if (ptr && !(HEADER(ptr)->size & SIZE_MMAPPED))
+        memset (ptr, 0, total);
+    return (ptr);
 }
 
-int 
-alloc_chunk (int chunk_size)
+/*
+ * mem_realloc
+ *
+ * Shrinks in place, grows in place into a free next block,
+ * otherwise moves the data to a new block.
+ */
+void *
+mem_realloc (void *ptr, size_t size)
 {
-    uint      overhead, size_required;
-    
-    overhead = HEADER_SIZE + FOOTER_SIZE;
-    size_required = chunk_size + overhead;
+    block_header_st  *block, *next;
+    size_t            bsize, cursize;
+    void             *p;
+
+    if (!ptr)
+        return (mem_malloc (size));
+    if (size == 0) {
+        mem_free (ptr);
+        return (NULL);
+    }
 
-    /* allocate the free list */
-    mem_manager_g.free_list = (block_header_st *) 
-        malloc(sizeof(uchar) * size_required);
-    if (!mem_manager_g.free_list) return (-1);
+    bsize = request_size (size);
+    if (!bsize)
+        return (NULL);
 
-    init_mem_block ((block_header_st *) mem_manager_g.free_list, NULL, NULL, 
-            size_required, 1);
+    block = HEADER(ptr);
+    cursize = BLOCK_SIZE(block);
+
+    if (!(block->size & SIZE_MMAPPED)) {
+        pthread_mutex_lock (&mem_manager_g.lock);
+        if (bsize <= cursize) {
+            split_block (block, bsize);
+            pthread_mutex_unlock (&mem_manager_g.lock);
+            return (ptr);
+        }
+
+        next = NEXT_BLOCK(block);
+        if (IS_FREE(next) && cursize + BLOCK_SIZE(next) >= bsize) {
+            free_list_remove (next);
+            init_mem_block (block, NULL, NULL, cursize + BLOCK_SIZE(next), 0);
+            split_block (block, bsize);
+            pthread_mutex_unlock (&mem_manager_g.lock);
+            return (ptr);
+        }
+        pthread_mutex_unlock (&mem_manager_g.lock);
+    } else if (bsize <= cursize && bsize > cursize / 2) {
+        return (ptr);
+    }
+
+    p = mem_malloc (size);
+    if (!p)
+        return (NULL);
+    cursize = mem_usable_size (ptr);
+    memcpy (p, ptr, cursize < size ? cursize : size);
+    mem_free (ptr);
+    return (p);
 }
 
-int 
-main (int argc, char **argv)
+/*
+ * mem_memalign
+ *
+ * Allocates a bigger block, frees the unaligned head and
+ * trims the tail.
+ */
+void *
+mem_memalign (size_t align, size_t size)
 {
-    int        chunk_size;
+    block_header_st  *block, *aligned;
+    uchar            *p;
+    size_t            bsize, gap;
+
+    if (align <= ALIGNMENT)
+        return (mem_malloc (size));
+    if (align & (align - 1))
+        return (NULL);
 
-    chunk_size = 1024;
-    alloc_chunk (chunk_size);
+    bsize = request_size (size);
+    if (!bsize || bsize > SIZE_MAX - 2 * align - MIN_BLOCK_SIZE)
+        return (NULL);
 
-    exit (0);
+    pthread_mutex_lock (&mem_manager_g.lock);
+    block = malloc_locked (bsize + 2 * align + MIN_BLOCK_SIZE);
+    if (!block) {
+        pthread_mutex_unlock (&mem_manager_g.lock);
+        return (NULL);
+    }
+
+    p = (uchar *) PAYLOAD(block);
+    if ((uintptr_t) p & (align - 1)) {
+
+        /*
+         * the head has to be big enough to be a free block.
+         */
+        p = (uchar *) (((uintptr_t) p + align - 1) & ~(align - 1));
+        gap = p - (uchar *) PAYLOAD(block);
+        if (gap < MIN_BLOCK_SIZE) {
+            p += align;
+            gap += align;
+        }
+
+        aligned = HEADER(p);
+        init_mem_block (aligned, NULL, NULL, BLOCK_SIZE(block) - gap, 0);
+        init_mem_block (block, NULL, NULL, gap, 1);
+        free_list_insert (coalesce (block));
+        block = aligned;
+    }
+
+    split_block (block, bsize);
+    pthread_mutex_unlock (&mem_manager_g.lock);
+    return (PAYLOAD(block));
 }
 
+size_t
+mem_usable_size (void *ptr)
+{
+    block_header_st  *block;
+
+    if (!ptr)
+        return (0);
 
+    block = HEADER(ptr);
+    if (block->size & SIZE_MMAPPED)
+        return (BLOCK_SIZE(block) - HEADER_SIZE);
+    return (BLOCK_SIZE(block) - OVERHEAD);
+}
+
+/*
+ * mem_mapped_bytes
+ *
+ * How much memory the allocator holds from the system.
+ */
+size_t
+mem_mapped_bytes ()
+{
+    return (mem_manager_g.mapped);
+}
@@ -0,0 +1,31 @@
+#ifndef __MEM_ALLOC_H__
+#define __MEM_ALLOC_H__
+
+/*
+ * A general purpose allocator with boundary tags.
+ * Every block has a header with its size and a trailer with
+ * the address of its header, the LSB of the trailer tells if the
+ * block is free.  A freed block is coalesced immediately with its
+ * free neighbours.  Small free blocks are kept on exact size lists,
+ * larger ones in a balanced tree by size, so a best fit lookup is
+ * O(log n) however many free blocks there are.
+ *
+ * mem_alloc_preload.c wraps these as malloc/free/..., to run an
+ * existing binary on this allocator:
+ *
+ *   gcc -O2 -shared -fPIC -o libmem_alloc.so mem_alloc.c \
+ *       mem_alloc_preload.c alloc_trace.c -lpthread
+ *   LD_PRELOAD=./libmem_alloc.so ./a.out
+ */
+
+#include <stddef.h>
+
+void *mem_malloc (size_t size);
+void mem_free (void *ptr);
+void *mem_realloc (void *ptr, size_t size);
+void *mem_calloc (size_t nmemb, size_t size);
+void *mem_memalign (size_t align, size_t size);
+size_t mem_usable_size (void *ptr);
+size_t mem_mapped_bytes ();
+
+#endif
@@ -0,0 +1,120 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mem_alloc.h"
+#include "alloc_trace.h"
+
+/*
+ * LD_PRELOAD shim, routes the libc allocation calls to mem_alloc.c.
+ * See mem_alloc.h for how to build and use it.
+ *
+ * When MEM_ALLOC_TRACE names a file, every call is also recorded
+ * there for alloc_bench to replay (link alloc_trace.c in as well).
+ */
+
+static void __attribute__((constructor))
+preload_init ()
+{
+    char  *path;
+
+    path = getenv ("MEM_ALLOC_TRACE");
+    if (path && *path)
+        alloc_trace_open (path);
+}
+
+static void __attribute__((destructor))
+preload_fini ()
+{
+    alloc_trace_close ();
+}
+
+void *
+malloc (size_t size)
+{
+    void  *p;
+
+    p = mem_malloc (size);
+    alloc_trace_record (ALLOC_TRACE_ALLOC, size, p, NULL);
+    return (p);
+}
+
+void
+free (void *ptr)
+{
+    if (ptr)
+        alloc_trace_record (ALLOC_TRACE_FREE, 0, ptr, NULL);
+    mem_free (ptr);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+    void  *p;
+
+    p = mem_calloc (nmemb, size);
+    alloc_trace_record (ALLOC_TRACE_ALLOC, nmemb * size, p, NULL);
+    return (p);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    void  *p;
+
+    p = mem_realloc (ptr, size);
+    alloc_trace_record (ALLOC_TRACE_REALLOC, size, p, ptr);
+    return (p);
+}
+
+void *
+memalign (size_t align, size_t size)
+{
+    void  *p;
+
+    p = mem_memalign (align, size);
+    alloc_trace_record (ALLOC_TRACE_ALLOC, size, p, NULL);
+    return (p);
+}
+
+void *
+aligned_alloc (size_t align, size_t size)
+{
+    return (memalign (align, size));
+}
+
+int
+posix_memalign (void **memptr, size_t align, size_t size)
+{
+    void  *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)))
+        return (EINVAL);
+
+    p = memalign (align, size);
+    if (!p)
+        return (ENOMEM);
+    *memptr = p;
+    return (0);
+}
+
+void *
+valloc (size_t size)
+{
+    return (memalign (sysconf (_SC_PAGESIZE), size));
+}
+
+void *
+pvalloc (size_t size)
+{
+    size_t  page;
+
+    page = sysconf (_SC_PAGESIZE);
+    return (memalign (page, (size + page - 1) & ~(page - 1)));
+}
+
+size_t
+malloc_usable_size (void *ptr)
+{
+    return (mem_usable_size (ptr));
+}
@@ -0,0 +1,261 @@
+#ifndef __OBJECT_POOL_H__
+#define __OBJECT_POOL_H__
+
+/*
+ * A typed object pool.
+ * Objects of type T are carved out of chunks of OBJECT_POOL_CHUNK
+ * slots, so the nodes of a structure built from one pool sit next
+ * to each other in memory.  A freed slot goes on a free list and is
+ * handed out again before a new chunk is taken; chunks are never
+ * given back while the pool lives.
+ *
+ * create() constructs an object in a slot with placement new and
+ * destroy() runs the destructor and frees the slot.  An object from
+ * create() must not be deleted, nor a new'd one destroyed.
+ *
+ * With ThreadCache set, each thread keeps up to 2 * OBJECT_POOL_BATCH
+ * free slots of its own and only takes the pool lock to move a batch
+ * of them to or from the shared free list.
+ *
+ *   patriciaTrieKey *k = ObjectPool<patriciaTrieKey>::instance().create(ip, 32);
+ *   ...
+ *   ObjectPool<patriciaTrieKey>::instance().destroy(k);
+ */
+
+extern "C" {
+#include <stdlib.h>
+#include <pthread.h>
+}
+
+#include <new>
+#include <utility>
+
+#define OBJECT_POOL_CHUNK	256	/* slots per chunk */
+#define OBJECT_POOL_BATCH	32	/* slots moved to/from a thread cache */
+
+template<typename T, bool ThreadCache = false>
+class ObjectPool {
+public:
+	/*
+	 * The pool of T.  It is never destroyed, so objects may still be
+	 * given back from static destructors at exit.
+	 */
+	static ObjectPool &instance() {
+		static ObjectPool *pool = new ObjectPool();
+		return *pool;
+	}
+
+	template<typename ... Args>
+	T *create(Args&&... args) {
+		void *p = allocate();
+		if (p == NULL) {
+			return NULL;
+		}
+		return new (p) T(std::forward<Args>(args)...);
+	}
+
+	void destroy(T *obj) {
+		if (obj == NULL) {
+			return;
+		}
+		obj->~T();
+		deallocate(obj);
+	}
+
+	/*
+	 * A raw slot for a T, NULL when out of memory.
+	 */
+	void *allocate() {
+		slot *s;
+
+		if (ThreadCache) {
+			frontCache &fc = cache;
+			if (fc.head == NULL) {
+				refill(fc);
+			}
+			s = fc.head;
+			if (s != NULL) {
+				fc.head = s->next;
+				fc.count--;
+			}
+			return s;
+		}
+
+		pthread_mutex_lock(&lock);
+		s = take();
+		pthread_mutex_unlock(&lock);
+		return s;
+	}
+
+	void deallocate(void *p) {
+		slot *s = static_cast<slot *>(p);
+
+		if (ThreadCache) {
+			frontCache &fc = cache;
+			s->next = fc.head;
+			fc.head = s;
+			if (++fc.count >= 2 * OBJECT_POOL_BATCH) {
+				flush(fc, OBJECT_POOL_BATCH);
+			}
+			return;
+		}
+
+		pthread_mutex_lock(&lock);
+		s->next = freeList;
+		freeList = s;
+		inUse--;
+		pthread_mutex_unlock(&lock);
+	}
+
+	/*
+	 * Slots handed out, including those sitting in thread caches.
+	 */
+	size_t allocated() {
+		return inUse;
+	}
+
+	size_t capacity() {
+		return chunks * OBJECT_POOL_CHUNK;
+	}
+
+private:
+	union slot {
+		slot *next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	struct chunk {
+		chunk *next;
+		slot slots[OBJECT_POOL_CHUNK];
+	};
+
+	/*
+	 * A thread's own free slots, given back to the pool when the
+	 * thread exits.
+	 */
+	struct frontCache {
+		slot *head;
+		unsigned int count;
+
+		frontCache() :
+				head(NULL), count(0) {
+		}
+
+		~frontCache() {
+			if (count) {
+				instance().flush(*this, count);
+			}
+		}
+	};
+
+	static thread_local frontCache cache;
+
+	pthread_mutex_t lock;
+	slot *freeList;
+	chunk *chunkList;
+	size_t chunks;
+	size_t inUse;
+
+	ObjectPool() :
+			freeList(NULL), chunkList(NULL), chunks(0), inUse(0) {
+		pthread_mutex_init(&lock, NULL);
+	}
+
+	ObjectPool(const ObjectPool &);
+	ObjectPool &operator=(const ObjectPool &);
+
+	/*
+	 * Threads the slots of a new chunk onto the free list, the
+	 * lock is held.
+	 */
+	bool grow() {
+		chunk *c = static_cast<chunk *>(malloc(sizeof(chunk)));
+		if (c == NULL) {
+			return false;
+		}
+		c->next = chunkList;
+		chunkList = c;
+		chunks++;
+		for (int i = OBJECT_POOL_CHUNK - 1; i >= 0; i--) {
+			c->slots[i].next = freeList;
+			freeList = &c->slots[i];
+		}
+		return true;
+	}
+
+	/*
+	 * A slot off the free list, the lock is held.
+	 */
+	slot *take() {
+		slot *s;
+
+		if (freeList == NULL && !grow()) {
+			return NULL;
+		}
+		s = freeList;
+		freeList = s->next;
+		inUse++;
+		return s;
+	}
+
+	void refill(frontCache &fc) {
+		slot *s;
+
+		pthread_mutex_lock(&lock);
+		while (fc.count < OBJECT_POOL_BATCH && (s = take()) != NULL) {
+			s->next = fc.head;
+			fc.head = s;
+			fc.count++;
+		}
+		pthread_mutex_unlock(&lock);
+	}
+
+	void flush(frontCache &fc, unsigned int n) {
+		slot *s;
+
+		pthread_mutex_lock(&lock);
+		while (n-- && (s = fc.head) != NULL) {
+			fc.head = s->next;
+			fc.count--;
+			s->next = freeList;
+			freeList = s;
+			inUse--;
+		}
+		pthread_mutex_unlock(&lock);
+	}
+};
+
+template<typename T, bool ThreadCache>
+thread_local typename ObjectPool<T, ThreadCache>::frontCache
+ObjectPool<T, ThreadCache>::cache;
+
+/*
+ * Class operator new/delete that go through ObjectPool<T>, for a
+ * class declaration that wants plain new and delete to be pooled:
+ *
+ *   class patriciaTrieKey {
+ *   public:
+ *       OBJECT_POOL_OPERATORS(patriciaTrieKey)
+ *       ...
+ */
+#define OBJECT_POOL_OPERATORS(T) \
+	static void *operator new(size_t size) { \
+		void *p = (size == sizeof(T)) ? \
+				ObjectPool<T>::instance().allocate() : malloc(size); \
+		if (p == NULL) { \
+			throw std::bad_alloc(); \
+		} \
+		return p; \
+	} \
+	static void operator delete(void *p, size_t size) { \
+		if (p == NULL) { \
+			return; \
+		} \
+		if (size == sizeof(T)) { \
+			ObjectPool<T>::instance().deallocate(p); \
+		} else { \
+			free(p); \
+		} \
+	}
+
+#endif
@@ -26,15 +26,34 @@ unsigned int bit_i(unsigned int key, int i) {
 	return key & mask(i);
 }
 
+/*
+ * prefixMask[n] has the n bits from the MSB set.
+ */
+static const unsigned int prefixMask[33] = {
+	0x00000000, 0x80000000, 0xc0000000, 0xe0000000,
+	0xf0000000, 0xf8000000, 0xfc000000, 0xfe000000,
+	0xff000000, 0xff800000, 0xffc00000, 0xffe00000,
+	0xfff00000, 0xfff80000, 0xfffc0000, 0xfffe0000,
+	0xffff0000, 0xffff8000, 0xffffc000, 0xffffe000,
+	0xfffff000, 0xfffff800, 0xfffffc00, 0xfffffe00,
+	0xffffff00, 0xffffff80, 0xffffffc0, 0xffffffe0,
+	0xfffffff0, 0xfffffff8, 0xfffffffc, 0xfffffffe,
+	0xffffffff
+};
+
 /**
  * Returns a bitmask of all 1's from the MSB.
  */
 unsigned int bitMask(unsigned int bits) {
-	unsigned int bmask = 0;
-	for (int i = 0; i < bits; i++) {
-		bmask |= mask(i);
-	}
-	return bmask;
+	return prefixMask[bits];
+}
+
+/*
+ * The bits [begin, begin + len) from the MSB, the span a key
+ * covers.
+ */
+static inline unsigned int spanMask(int begin, int len) {
+	return prefixMask[begin + len] & ~prefixMask[begin];
 }
 
 char *address_to_str(address_t *addr, char *addr_str)
@@ -69,26 +88,16 @@ int patriciaTrieKey::bitIndex(unsigned int otherKey) {
 		return NULL_BIT_KEY ;
 	}
 
-	if (key != otherKey) {
-		unsigned int xorValue = key ^ otherKey;
-		for (int i = bitIdxBegin; i < bitIdxBegin + bitLen; i++) {
-			if ((xorValue & mask(i)) != 0) {
-				return i;
-			}
-		}
+	unsigned int xorValue = (key ^ otherKey) & spanMask(bitIdxBegin, bitLen);
+	if (xorValue != 0) {
+		return __builtin_clz(xorValue);
 	}
 
 	return EQUAL_BIT_KEY ;
 }
 
 unsigned int patriciaTrieKey::prefix(unsigned int maskLen) {
-
-	unsigned int bmask = 0;
-	for (int i = bitIdxBegin; i < bitIdxBegin + maskLen; i++) {
-		bmask |= bit_i(key, i);
-	}
-
-	return bmask;
+	return key & spanMask(bitIdxBegin, maskLen);
 }
 
 unsigned int patriciaTrieKey::longestPrefixBitLen(patriciaTrieKey *otherKey) {
@@ -114,15 +123,9 @@ unsigned int patriciaTrieKey::longestPrefixBitLen(patriciaTrieKey *otherKey) {
 }
 
 int patriciaTrieKey::trimPrefix(int prefix_len, patriciaTrieKey *pkey) {
-	unsigned int pkey_val = 0;
-	int i;
-
-	pkey_val = prefix(prefix_len);
-
-	unsigned int newKey = 0;
-	for (i = bitIdxBegin + prefix_len; i < bitLen + bitIdxBegin; i++) {
-		newKey |= bit_i(key, i);
-	}
+	unsigned int pkey_val = prefix(prefix_len);
+	unsigned int newKey = key
+			& spanMask(bitIdxBegin + prefix_len, bitLen - prefix_len);
 
 	// new prefix
 	if (pkey != NULL) {
@@ -141,13 +144,9 @@ int patriciaTrieKey::trimPrefix(int prefix_len, patriciaTrieKey *pkey) {
 
 patriciaTrieKey *
 patriciaTrieKey::mergeKey(patriciaTrieKey *child) {
-	unsigned int newKey = key;
-	int begin = child->bitIdxBegin;
-	int end = child->bitLen + child->bitIdxBegin;
+	unsigned int newKey = key
+			| (child->key & spanMask(child->bitIdxBegin, child->bitLen));
 
-	for (int i = begin; i < end; i++) {
-		newKey |= bit_i(child->key, i);
-	}
 	this->bitLen += child->bitLen;
 	this->key = newKey;
 
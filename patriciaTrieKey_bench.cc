@@ -0,0 +1,258 @@
+#include "patriciaTrie.h"
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+}
+
+/*
+ * Per-call cost of the patriciaTrieKey bit operations, against the
+ * bit-at-a-time loops they replaced, which are kept here as the
+ * reference.  Every result is checked against the reference first.
+ *
+ *   g++ -O2 -o patriciaTrieKey_bench patriciaTrieKey_bench.cc \
+ *       patriciaTrieKey.cc
+ *   ./patriciaTrieKey_bench [iterations]
+ */
+
+#define BENCH_KEYS	4096	/* random keys cycled through */
+
+struct benchKey {
+	unsigned int key;
+	unsigned int other;
+	int bitIdxBegin;
+	int bitLen;
+	int prefixLen;
+};
+
+static benchKey keys[BENCH_KEYS];
+static volatile unsigned int sink;
+
+static unsigned int loopBitMask(unsigned int bits) {
+	unsigned int bmask = 0;
+	for (int i = 0; i < bits; i++) {
+		bmask |= mask(i);
+	}
+	return bmask;
+}
+
+static int loopBitIndex(const benchKey *k) {
+	if (k->bitLen == 0) {
+		return NULL_BIT_KEY ;
+	}
+	if (k->key != k->other) {
+		unsigned int xorValue = k->key ^ k->other;
+		for (int i = k->bitIdxBegin; i < k->bitIdxBegin + k->bitLen; i++) {
+			if ((xorValue & mask(i)) != 0) {
+				return i;
+			}
+		}
+	}
+	return EQUAL_BIT_KEY ;
+}
+
+static unsigned int loopPrefix(const benchKey *k) {
+	unsigned int bmask = 0;
+	for (int i = k->bitIdxBegin; i < k->bitIdxBegin + k->prefixLen; i++) {
+		bmask |= bit_i(k->key, i);
+	}
+	return bmask;
+}
+
+/* the key left after trimPrefix() */
+static unsigned int loopTrim(const benchKey *k) {
+	unsigned int newKey = 0;
+	for (int i = k->bitIdxBegin + k->prefixLen;
+			i < k->bitIdxBegin + k->bitLen; i++) {
+		newKey |= bit_i(k->key, i);
+	}
+	return newKey;
+}
+
+/* other's span merged into key, as mergeKey() does */
+static unsigned int loopMerge(const benchKey *k) {
+	unsigned int newKey = k->key;
+	for (int i = k->bitIdxBegin; i < k->bitIdxBegin + k->bitLen; i++) {
+		newKey |= bit_i(k->other, i);
+	}
+	return newKey;
+}
+
+static uint64_t nowNs() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Random keys that only hold bits of their span, as the keys in a
+ * trie do.  Half the other keys share a long prefix with the key.
+ */
+static void makeKeys() {
+	srand(1);
+	for (int i = 0; i < BENCH_KEYS; i++) {
+		benchKey *k = &keys[i];
+		unsigned int r = (unsigned int) rand() << 16 ^ rand();
+
+		k->bitIdxBegin = rand() % 32;
+		k->bitLen = 1 + rand() % (32 - k->bitIdxBegin);
+		k->prefixLen = rand() % (k->bitLen + 1);
+		unsigned int span = loopBitMask(k->bitIdxBegin + k->bitLen)
+				& ~loopBitMask(k->bitIdxBegin);
+		k->key = r & span;
+		k->other = (i % 2) ? (k->key ^ (1u << (rand() % 32))) & span
+				: ((unsigned int) rand() << 16 ^ rand()) & span;
+	}
+}
+
+static bool check() {
+	for (int i = 0; i < BENCH_KEYS; i++) {
+		benchKey *k = &keys[i];
+		patriciaTrieKey key(k->key, k->bitLen, k->bitIdxBegin);
+		patriciaTrieKey trimmed(k->key, k->bitLen, k->bitIdxBegin);
+		patriciaTrieKey prefixKey;
+		patriciaTrieKey merged(k->key, 0, 0);
+		patriciaTrieKey child(k->other, k->bitLen, k->bitIdxBegin);
+
+		trimmed.trimPrefix(k->prefixLen, &prefixKey);
+		merged.mergeKey(&child);
+		if (bitMask(i % 33) != loopBitMask(i % 33)
+				|| key.bitIndex(k->other) != loopBitIndex(k)
+				|| key.prefix(k->prefixLen) != loopPrefix(k)
+				|| prefixKey.getKey() != loopPrefix(k)
+				|| trimmed.getKey() != loopTrim(k)
+				|| merged.getKey() != loopMerge(k)) {
+			fprintf(stderr, "mismatch: key 0x%x other 0x%x begin %d "
+					"len %d prefix %d\n", k->key, k->other,
+					k->bitIdxBegin, k->bitLen, k->prefixLen);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void report(const char *name, uint64_t loopNs, uint64_t newNs,
+		long iterations) {
+	fprintf(stdout, "%-12s %10.2f %10.2f %8.1fx\n", name,
+			(double) loopNs / iterations, (double) newNs / iterations,
+			newNs ? (double) loopNs / newNs : 0.0);
+}
+
+int main(int argc, char **argv) {
+	long iterations = (argc > 1) ? atol(argv[1]) : 10000000;
+	uint64_t t0, t1, t2;
+	unsigned int acc;
+
+	makeKeys();
+	if (!check()) {
+		return 1;
+	}
+
+	fprintf(stdout, "%-12s %10s %10s %9s\n", "ns/call", "loop", "now",
+			"speedup");
+
+	acc = 0;
+	t0 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		acc += loopBitMask(keys[n % BENCH_KEYS].bitLen);
+	}
+	t1 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		acc += bitMask(keys[n % BENCH_KEYS].bitLen);
+	}
+	t2 = nowNs();
+	sink = acc;
+	report("bitMask", t1 - t0, t2 - t1, iterations);
+
+	acc = 0;
+	t0 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		acc += loopBitIndex(&keys[n % BENCH_KEYS]);
+	}
+	t1 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		patriciaTrieKey key(k->key, k->bitLen, k->bitIdxBegin);
+		acc += key.bitIndex(k->other);
+	}
+	t2 = nowNs();
+	sink = acc;
+	report("bitIndex", t1 - t0, t2 - t1, iterations);
+
+	acc = 0;
+	t0 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		acc += loopPrefix(&keys[n % BENCH_KEYS]);
+	}
+	t1 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		patriciaTrieKey key(k->key, k->bitLen, k->bitIdxBegin);
+		acc += key.prefix(k->prefixLen);
+	}
+	t2 = nowNs();
+	sink = acc;
+	report("prefix", t1 - t0, t2 - t1, iterations);
+
+	acc = 0;
+	t0 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		acc += loopPrefix(k) + loopTrim(k);
+	}
+	t1 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		patriciaTrieKey key(k->key, k->bitLen, k->bitIdxBegin);
+		patriciaTrieKey prefixKey;
+		key.trimPrefix(k->prefixLen, &prefixKey);
+		acc += prefixKey.getKey() + key.getKey();
+	}
+	t2 = nowNs();
+	sink = acc;
+	report("trimPrefix", t1 - t0, t2 - t1, iterations);
+
+	acc = 0;
+	t0 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		acc += loopMerge(&keys[n % BENCH_KEYS]);
+	}
+	t1 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		patriciaTrieKey key(k->key, 0, 0);
+		patriciaTrieKey child(k->other, k->bitLen, k->bitIdxBegin);
+		acc += key.mergeKey(&child)->getKey();
+	}
+	t2 = nowNs();
+	sink = acc;
+	report("mergeKey", t1 - t0, t2 - t1, iterations);
+
+	/*
+	 * one step of insertNode() or lookup(): how much of the key
+	 * matches, then the matched part trimmed off.
+	 */
+	acc = 0;
+	t0 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		int index = loopBitIndex(k);
+		acc += index + loopPrefix(k) + loopTrim(k);
+	}
+	t1 = nowNs();
+	for (long n = 0; n < iterations; n++) {
+		benchKey *k = &keys[n % BENCH_KEYS];
+		patriciaTrieKey key(k->key, k->bitLen, k->bitIdxBegin);
+		patriciaTrieKey other(k->other, k->bitLen, k->bitIdxBegin);
+		acc += key.longestPrefixBitLen(&other);
+		acc += key.trimPrefix(k->prefixLen, NULL) + key.getKey();
+	}
+	t2 = nowNs();
+	sink = acc;
+	report("trie step", t1 - t0, t2 - t1, iterations);
+
+	return 0;
+}
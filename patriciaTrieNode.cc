@@ -4,10 +4,32 @@ extern "C" {
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <regex.h>        
 }
 
 #include "logger.h"
+#include "object_pool.h"
+
+/*
+ * Nodes and keys are carved from their pools, see object_pool.h.
+ * A node owns its key, and insertNode() takes over the key it is
+ * given.  A node from deleteNode() goes back with destroyNode().
+ */
+template<typename T> static inline patriciaTrieNode<T> *
+newNode(patriciaTrieKey *ptk, T *data, patriciaTrieNode<T> *left,
+		patriciaTrieNode<T> *right) {
+	return ObjectPool<patriciaTrieNode<T> >::instance().create(ptk, data,
+			left, right);
+}
+
+template<typename T> void destroyNode(patriciaTrieNode<T> *node) {
+	ObjectPool<patriciaTrieNode<T> >::instance().destroy(node);
+}
+
+static inline void destroyKey(patriciaTrieKey *key) {
+	ObjectPool<patriciaTrieKey>::instance().destroy(key);
+}
 
 
 template<typename T>
@@ -24,11 +46,12 @@ patriciaTrieNode<T>::patriciaTrieNode(patriciaTrieKey *ptk, T* data,
 template<typename T>
 patriciaTrieNode<T>::~patriciaTrieNode() {
 	if (left) {
-		delete left;
+		destroyNode(left);
 	}
 	if (right) {
-		delete right;
+		destroyNode(right);
 	}
+	destroyKey(key);
 }
 
 template<typename T> T*
@@ -70,14 +93,14 @@ template<typename T> void patriciaTrieNode<T>::insertNode(patriciaTrieKey *pkey,
 				right->insertNode(pkey, addr);
 				return;
 			}
-			right = new patriciaTrieNode<T>(pkey, addr, NULL, NULL);
+			right = newNode<T>(pkey, addr, NULL, NULL);
 			return;
 		} else {
 			if (left != NULL) {
 				left->insertNode(pkey, addr);
 				return;
 			}
-			left = new patriciaTrieNode<T>(pkey, addr, NULL, NULL);
+			left = newNode<T>(pkey, addr, NULL, NULL);
 			return;
 		}
 	}
@@ -86,7 +109,8 @@ template<typename T> void patriciaTrieNode<T>::insertNode(patriciaTrieKey *pkey,
 
 	if (prefixBitLen > 0) {
 		if (prefixBitLen < key->getBitLen()) {
-			patriciaTrieKey *root_key_new = new patriciaTrieKey();
+			patriciaTrieKey *root_key_new =
+					ObjectPool<patriciaTrieKey>::instance().create();
 
 			// Break down this node into two nodes - parent and child.
 			// trim the prefix from both the keys
@@ -104,29 +128,42 @@ template<typename T> void patriciaTrieNode<T>::insertNode(patriciaTrieKey *pkey,
 			patriciaTrieNode<T> *grand_child_right = right;
 			patriciaTrieNode<T> *grand_child_left = left;
 
+			patriciaTrieNode<T> *child1 = newNode<T>(child_key1,
+					child_key1_data, grand_child_left, grand_child_right);
 			unsigned int bit = bit_i(child_key1->getKey(),
 					child_key1->getBitIdxBegin());
+			left = right = NULL;
 			if (bit >= 1) {
-				right = new patriciaTrieNode<T>(child_key1, child_key1_data,
-						grand_child_left, grand_child_right);
+				right = child1;
 			} else {
-				left = new patriciaTrieNode<T>(child_key1, child_key1_data,
-						grand_child_left, grand_child_right);
+				left = child1;
+			}
+
+			// the new key ends here, this node holds it.
+			if (child_key2->getBitLen() == 0) {
+				data = addr;
+				destroyKey(child_key2);
+				return;
 			}
 
 			bit = bit_i(child_key2->getKey(), child_key2->getBitIdxBegin());
 			if (bit >= 1) {
-				right = new patriciaTrieNode<T>(child_key2, addr, NULL, NULL);
+				right = newNode<T>(child_key2, addr, NULL, NULL);
 			} else {
-				left = new patriciaTrieNode<T>(child_key2, addr, NULL, NULL);
+				left = newNode<T>(child_key2, addr, NULL, NULL);
 			}
 
 		} else {
 			pkey->trimPrefix(prefixBitLen, NULL);
 			patriciaTrieKey *child_key2 = pkey; // modified key  after dropping prefix
 
-			// node is already present.
+			// the key ends here.  A split node without data takes
+			// it, otherwise it is already present.
 			if (pkey->getBitLen() == 0) {
+				if (data == NULL) {
+					data = addr;
+				}
+				destroyKey(pkey);
 				return;
 			}
 
@@ -136,14 +173,14 @@ template<typename T> void patriciaTrieNode<T>::insertNode(patriciaTrieKey *pkey,
 				if (right != NULL) {
 					right->insertNode(child_key2, addr);
 				} else {
-					right = new patriciaTrieNode<T>(child_key2, addr, NULL,
+					right = newNode<T>(child_key2, addr, NULL,
 							NULL);
 				}
 			} else {
 				if (left != NULL) {
 					left->insertNode(child_key2, addr);
 				} else {
-					left = new patriciaTrieNode<T>(child_key2, addr, NULL,
+					left = newNode<T>(child_key2, addr, NULL,
 							NULL);
 				}
 			}
@@ -219,11 +256,17 @@ patriciaTrieNode<T>::deleteNode(patriciaTrieKey *pkey) {
 		child = parent->left;
 	}
 
-	if (child != NULL) {
+	// a parent that holds a prefix of its own, or the root, keeps
+	// its remaining child as it is.
+	if (child != NULL && parent->data == NULL && parent->key != NULL) {
 		parent->data = child->data;
 		parent->left = child->left;
 		parent->right = child->right;
 		parent->key->mergeKey(child->key);
+
+		// the child's subtree moved up, only the child itself goes.
+		child->left = child->right = NULL;
+		destroyNode(child);
 	}
 
 	return target;
@@ -271,6 +314,40 @@ patriciaTrieNode<T>::lookup(patriciaTrieKey *pkey) {
 	return NULL;
 }
 
+/*
+ * Longest prefix match: the deepest node on addr's path that holds
+ * data, NULL if no stored prefix covers addr.  Unlike lookup() the
+ * walk only reads the keys, it neither trims nor allocates one.
+ */
+template<typename T> patriciaTrieNode<T> *
+patriciaTrieNode<T>::lpmLookup(uint32_t addr) {
+	patriciaTrieNode<T> *node = this;
+	patriciaTrieNode<T> *best = NULL;
+	int depth = 0;
+
+	while (node != NULL) {
+		patriciaTrieKey *k = node->key;
+		if (k != NULL) {
+			int begin = k->getBitIdxBegin();
+			int end = begin + k->getBitLen();
+			unsigned int span = bitMask(end) & ~bitMask(begin);
+
+			if (((addr ^ k->getKey()) & span) != 0) {
+				break;
+			}
+			depth = end;
+			if (node->data != NULL) {
+				best = node;
+			}
+		}
+		if (depth >= 32) {
+			break;
+		}
+		node = bit_i(addr, depth) ? node->right : node->left;
+	}
+	return best;
+}
+
 static void printLevel(int level) {
 	for (int i = 0; i < level; i++) {
 		fprintf(stdout, "\t");
@@ -0,0 +1,428 @@
+#include <stdint.h>
+
+#include "skiplist.h"
+
+/*
+ * random_height
+ *
+ * How many levels above 0 a new node gets, each one with
+ * probability 1/4.
+ */
+static uint
+random_height (skiplist_st *list)
+{
+    uint  x, h;
+
+    x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    list->seed = x;
+
+    for (h = 0; h < SKIPLIST_MAX_LEVEL && (x & 3) == 0; h++)
+        x >>= 2;
+    return (h);
+}
+
+/*
+ * find_path
+ *
+ * Walks down the levels to the last node before to_node, and to
+ * the last node not greater than it when after_equal is set.
+ * links[l] is left pointing at the level l + 1 link to follow
+ * from there.  Returns the level 0 node, NULL for the head.
+ */
+static node_st *
+find_path (skiplist_st *list, node_cmp_fn cmp, node_st *to_node,
+           boolean after_equal, skiplist_tower_st ***links)
+{
+    skiplist_tower_st   *pred, **link;
+    node_st             *node, *next;
+    int                  l, cmp_result;
+
+    pred = NULL;
+    for (l = (int) list->level - 1; l >= 0; l--) {
+        link = pred ? &pred->next[l] : &list->heads[l];
+        while (*link) {
+            cmp_result = cmp ((*link)->node, to_node);
+            if (cmp_result > 0 || (cmp_result == 0 && !after_equal))
+                break;
+            pred = *link;
+            link = &pred->next[l];
+        }
+        if (links)
+            links[l] = link;
+    }
+
+    node = pred ? pred->node : NULL;
+    for (next = node ? node->next : list->head; next; next = next->next) {
+        cmp_result = cmp (next, to_node);
+        if (cmp_result > 0 || (cmp_result == 0 && !after_equal))
+            break;
+        node = next;
+    }
+    return (node);
+}
+
+/*
+ * link_after
+ *
+ * Puts node on level 0 after pred, or first when pred is NULL.
+ */
+static void
+link_after (skiplist_st *list, node_st *pred, node_st *node)
+{
+    node->prev = pred;
+    node->next = pred ? pred->next : list->head;
+    if (node->next)
+        node->next->prev = node;
+    else
+        list->tail = node;
+    if (pred)
+        pred->next = node;
+    else
+        list->head = node;
+    list->count++;
+}
+
+/*
+ * unlink_node
+ *
+ * Takes a node off level 0 and gives it to the free function.
+ */
+static int
+unlink_node (skiplist_st *list, node_st *node)
+{
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        list->head = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    else
+        list->tail = node->prev;
+    list->count--;
+
+    if (list->free_fn)
+        (*list->free_fn)(node);
+    return (0);
+}
+
+/*
+ * unlink_towers
+ *
+ * Takes the tower of node, if it has one, off the levels above 0.
+ * links come from find_path() without after_equal, so they stop
+ * at the first node equal to node on each level.
+ */
+static void
+unlink_towers (skiplist_st *list, node_st *node, node_cmp_fn cmp,
+               skiplist_tower_st ***links)
+{
+    skiplist_tower_st   *tower, **link;
+    int                  l;
+
+    tower = NULL;
+    for (l = (int) list->level - 1; l >= 0; l--) {
+        for (link = links[l]; *link && (*link)->node != node;
+             link = &(*link)->next[l]) {
+            if (cmp ((*link)->node, node) != 0)
+                break;
+        }
+        if (*link && (*link)->node == node) {
+            tower = *link;
+            *link = tower->next[l];
+        }
+    }
+    free (tower);
+
+    while (list->level && !list->heads[list->level - 1])
+        list->level--;
+}
+
+/*
+ * dequeue_sorted
+ *
+ * Dequeues a node of a sorted list.  The node is looked for among
+ * those equal to it, unless the caller knows it is a member.
+ */
+static int
+dequeue_sorted (skiplist_st *list, node_st *node, boolean is_a_member)
+{
+    skiplist_tower_st  **links[SKIPLIST_MAX_LEVEL];
+    node_st             *cur_node;
+
+    cur_node = find_path (list, list->cmp_fn, node, FALSE, links);
+    if (!is_a_member) {
+        cur_node = cur_node ? cur_node->next : list->head;
+        while (cur_node && cur_node != node &&
+               list->cmp_fn (cur_node, node) == 0)
+            cur_node = cur_node->next;
+        if (cur_node != node)
+            return (-1);
+    }
+
+    unlink_towers (list, node, list->cmp_fn, links);
+    return (unlink_node (list, node));
+}
+
+/*
+ * skiplist_init
+ *
+ * Init a new skip list, allocating it when *list is NULL.
+ */
+int
+skiplist_init (skiplist_st **list, node_free_fn free_fn, node_cmp_fn cmp_fn)
+{
+    if (!list)
+        return (-1);
+
+    if (*list == NULL)
+        *list = (skiplist_st *) malloc (sizeof (skiplist_st));
+    if (*list == NULL)
+        return (-1);
+
+    memset (*list, 0, sizeof (skiplist_st));
+    (*list)->free_fn = free_fn;
+    (*list)->cmp_fn = cmp_fn;
+    (*list)->seed = 0x9e3779b9 ^ (uint) (uintptr_t) *list;
+    if ((*list)->seed == 0)
+        (*list)->seed = 1;
+    return (0);
+}
+
+/*
+ * skiplist_destroy
+ *
+ * Dequeues every node, calling the free function on it, and
+ * frees the towers.  The list itself is left to the caller.
+ */
+void
+skiplist_destroy (skiplist_st *list)
+{
+    skiplist_tower_st  *tower, *next;
+    node_st            *node;
+
+    if (!list)
+        return;
+
+    for (tower = list->level ? list->heads[0] : NULL; tower; tower = next) {
+        next = tower->next[0];
+        free (tower);
+    }
+    memset (list->heads, 0, sizeof (list->heads));
+    list->level = 0;
+
+    while ((node = list->head) != NULL)
+        unlink_node (list, node);
+}
+
+/*
+ * skiplist_enqueue
+ *
+ * Inserts a node in order, after the nodes equal to it, or at
+ * the tail of an unsorted list.
+ */
+int
+skiplist_enqueue (skiplist_st *list, node_st *node)
+{
+    skiplist_tower_st  **links[SKIPLIST_MAX_LEVEL], *tower;
+    node_st             *pred;
+    uint                 h, l;
+
+    if (!list || !node)
+        return (-1);
+
+    if (!list->cmp_fn) {
+        link_after (list, list->tail, node);
+        return (0);
+    }
+
+    pred = find_path (list, list->cmp_fn, node, TRUE, links);
+    link_after (list, pred, node);
+
+    h = random_height (list);
+    if (h == 0)
+        return (0);
+
+    /*
+     * no tower is not an error, the node is just only on level 0.
+     */
+    tower = (skiplist_tower_st *) malloc (sizeof (skiplist_tower_st) +
+                                          (h - 1) * sizeof (tower->next[0]));
+    if (!tower)
+        return (0);
+    tower->node = node;
+    tower->height = h;
+
+    for (l = list->level; l < h; l++)
+        links[l] = &list->heads[l];
+    if (h > list->level)
+        list->level = h;
+
+    for (l = 0; l < h; l++) {
+        tower->next[l] = *links[l];
+        *links[l] = tower;
+    }
+    return (0);
+}
+
+/*
+ * skiplist_enqueue_head
+ *
+ * Pushes a node on the head of an unsorted list.
+ */
+int
+skiplist_enqueue_head (skiplist_st *list, node_st *node)
+{
+    if (!list || !node || list->cmp_fn)
+        return (-1);
+
+    link_after (list, NULL, node);
+    return (0);
+}
+
+/*
+ * skiplist_dequeue
+ *
+ * Dequeues a node, which has to be a member of this list.
+ */
+int
+skiplist_dequeue (skiplist_st *list, node_st *node)
+{
+    node_st  *cur_node;
+
+    if (!list || !node)
+        return (-1);
+
+    if (list->cmp_fn)
+        return (dequeue_sorted (list, node, FALSE));
+
+    for (cur_node = list->head; cur_node && cur_node != node;
+         cur_node = cur_node->next)
+        ;
+    if (!cur_node)
+        return (-1);
+    return (unlink_node (list, node));
+}
+
+/*
+ * skiplist_dequeue_member
+ *
+ * Dequeues a node the caller knows is a member of this list.
+ */
+int
+skiplist_dequeue_member (skiplist_st *list, node_st *node)
+{
+    if (!list || !node)
+        return (-1);
+
+    if (list->cmp_fn)
+        return (dequeue_sorted (list, node, TRUE));
+    return (unlink_node (list, node));
+}
+
+/*
+ * skiplist_dequeue_head
+ *
+ * Dequeues the first node.  Its tower, if any, is the first on
+ * each of its levels.
+ */
+node_st *
+skiplist_dequeue_head (skiplist_st *list)
+{
+    skiplist_tower_st  *tower;
+    node_st            *node;
+    uint                l;
+
+    node = list->head;
+    if (!node)
+        return (NULL);
+
+    tower = NULL;
+    for (l = 0; l < list->level; l++) {
+        if (list->heads[l] && list->heads[l]->node == node) {
+            tower = list->heads[l];
+            list->heads[l] = tower->next[l];
+        }
+    }
+    free (tower);
+    while (list->level && !list->heads[list->level - 1])
+        list->level--;
+
+    unlink_node (list, node);
+    return (node);
+}
+
+/*
+ * skiplist_dequeue_node_n
+ *
+ * Dequeues the n'th node, counting from 1 like dlist does.
+ */
+node_st *
+skiplist_dequeue_node_n (skiplist_st *list, uint n)
+{
+    node_st  *node;
+    uint      i;
+
+    node = list->head;
+    for (i = 1; node && i < n; i++)
+        node = node->next;
+    if (!node)
+        return (NULL);
+
+    if (node == list->head)
+        return (skiplist_dequeue_head (list));
+    if (skiplist_dequeue_member (list, node) != 0)
+        return (NULL);
+    return (node);
+}
+
+/*
+ * skiplist_find_node
+ *
+ * Finds the first node equal to to_node.  On a sorted list cmp has
+ * to order the nodes the same way as the list's compare function.
+ */
+node_st *
+skiplist_find_node (skiplist_st *list, node_cmp_fn cmp, node_st *to_node)
+{
+    node_st  *node;
+
+    if (!list || !list->head || !cmp)
+        return (NULL);
+
+    if (!list->cmp_fn) {
+        for (node = list->head; node; node = node->next) {
+            if (cmp (node, to_node) == 0)
+                return (node);
+        }
+        return (NULL);
+    }
+
+    node = find_path (list, cmp, to_node, FALSE, NULL);
+    node = node ? node->next : list->head;
+    if (node && cmp (node, to_node) == 0)
+        return (node);
+    return (NULL);
+}
+
+/*
+ * skiplist_find_and_dequeue
+ *
+ * Finds a node with a compare method and dequeues it.
+ */
+int
+skiplist_find_and_dequeue (skiplist_st *list, node_cmp_fn cmp,
+                           node_st *to_node)
+{
+    node_st  *node;
+
+    if (!list || !cmp || !to_node)
+        return (-1);
+
+    node = skiplist_find_node (list, cmp, to_node);
+    if (!node)
+        return (-1);
+    return (skiplist_dequeue_member (list, node));
+}
@@ -0,0 +1,76 @@
+#ifndef __SKIPLIST_H__
+#define __SKIPLIST_H__
+
+/*
+ * A sorted list of node_st's with a skip list over it.
+ * Level 0 is the node_st next/prev list itself, exactly what a
+ * dlist_st holds, so walking a skiplist from its head is the same
+ * as walking a dlist.  The levels above live in towers allocated
+ * on the side, a node gets one with probability 1/4 per level, so
+ * the nodes need no extra room and a sorted insert, find or
+ * dequeue is O(log n) comparisons.
+ *
+ * Without a compare function the list is kept in insertion order
+ * and has no towers, like an unsorted dlist.
+ *
+ * A dlist user switches over by including this header instead of
+ * dlist.h with SKIPLIST_AS_DLIST defined, which maps the dlist_st
+ * type and calls onto the skiplist ones.  dlist_dequeue_node_n()
+ * still walks level 0.
+ */
+
+#include "dlist.h"
+
+#define  SKIPLIST_MAX_LEVEL   16   /* levels above 0, for ~4^16 nodes */
+
+/*
+ * the links of a node on levels 1 .. height, next[l] is level l + 1.
+ */
+typedef struct _skiplist_tower_st {
+    node_st                     *node;
+    uint                         height;
+    struct _skiplist_tower_st   *next[1];
+} skiplist_tower_st;
+
+/*
+ * The first four members are those of a dlist_st.
+ */
+typedef struct _skiplist_st {
+    node_st             *head;     /* level 0, sorted by cmp_fn */
+    uint                 count;
+    node_free_fn         free_fn;  /* called on a node when dequeued */
+    node_cmp_fn          cmp_fn;   /* NULL keeps insertion order */
+    node_st             *tail;
+    uint                 level;    /* levels in use above 0 */
+    uint                 seed;
+    skiplist_tower_st   *heads[SKIPLIST_MAX_LEVEL];
+} skiplist_st;
+
+extern int skiplist_init (skiplist_st **list,
+                          node_free_fn free_fn, node_cmp_fn cmp_fn);
+extern void skiplist_destroy (skiplist_st *list);
+extern int skiplist_enqueue (skiplist_st *list, node_st *node);
+extern int skiplist_enqueue_head (skiplist_st *list, node_st *node);
+extern int skiplist_dequeue (skiplist_st *list, node_st *node);
+extern int skiplist_dequeue_member (skiplist_st *list, node_st *node);
+extern int skiplist_find_and_dequeue (skiplist_st *list, node_cmp_fn cmp,
+                                      node_st *to_node);
+extern node_st * skiplist_dequeue_head (skiplist_st *list);
+extern node_st * skiplist_dequeue_node_n (skiplist_st *list, uint n);
+extern node_st * skiplist_find_node (skiplist_st *list, node_cmp_fn cmp,
+                                     node_st *to_node);
+
+#ifdef SKIPLIST_AS_DLIST
+#define  dlist_st                skiplist_st
+#define  dlist_init              skiplist_init
+#define  dlist_enqueue           skiplist_enqueue
+#define  dlist_enqueue_head      skiplist_enqueue_head
+#define  dlist_dequeue           skiplist_dequeue
+#define  dlist_dequeue_member    skiplist_dequeue_member
+#define  dlist_find_and_dequeue  skiplist_find_and_dequeue
+#define  dlist_dequeue_head      skiplist_dequeue_head
+#define  dlist_dequeue_node_n    skiplist_dequeue_node_n
+#define  dlist_find_node         skiplist_find_node
+#endif
+
+#endif
@@ -0,0 +1,262 @@
+
+#include "slab_alloc.h"
+
+#define  SLAB_ALIGN(N)     (((N) + 7) & ~7)
+
+/*
+ * slab_list
+ *
+ * The cache list a slab in this state lives on.
+ */
+static inline dlist_st *
+slab_list (slab_cache_st *cache, slab_state_e state)
+{
+    switch (state) {
+    case SLAB_EMPTY:
+        return (&cache->empty);
+    case SLAB_PARTIAL:
+        return (&cache->partial);
+    default:
+        return (&cache->full);
+    }
+}
+
+/*
+ * slab_move
+ *
+ * Moves a slab to the list of its new state.
+ */
+static inline void
+slab_move (slab_cache_st *cache, slab_st *slab, slab_state_e state)
+{
+    if (slab->state == state)
+        return;
+    dlist_dequeue_member (slab_list (cache, slab->state), (node_st *) slab);
+    slab->state = state;
+    dlist_enqueue_head (slab_list (cache, state), (node_st *) slab);
+}
+
+/*
+ * slab_of
+ *
+ * Finds the slab an object was carved from, NULL if the object is
+ * not in the arena at all.
+ */
+static inline slab_st *
+slab_of (slab_cache_st *cache, void *obj)
+{
+    buddy_arena_st  *arena;
+
+    arena = buddy_cache_arena ();
+    if (!arena || (uchar *) obj < arena->base ||
+        (uint64_t) ((uchar *) obj - arena->base) >= arena->size)
+        return (NULL);
+
+    return ((slab_st *) buddy_arena_block_of (arena, (uchar *) obj,
+                                              cache->slab_order));
+}
+
+/*
+ * slab_grow
+ *
+ * Gets a new slab from buddy and puts it on the empty list.
+ */
+static slab_st *
+slab_grow (slab_cache_st *cache)
+{
+    slab_st  *slab;
+
+    slab = (slab_st *) buddy_cache_alloc (BLOCKSIZE(cache->slab_order));
+    if (!slab)
+        return (NULL);
+
+    slab->cache = cache;
+    slab->free_list = NULL;
+    slab->inuse = 0;
+    slab->carved = 0;
+    slab->state = SLAB_EMPTY;
+    dlist_enqueue_head (&cache->empty, (node_st *) slab);
+    return (slab);
+}
+
+/*
+ * slab_release
+ *
+ * Gives an empty slab back to buddy.
+ */
+static void
+slab_release (slab_cache_st *cache, slab_st *slab)
+{
+    dlist_dequeue_member (slab_list (cache, slab->state), (node_st *) slab);
+    buddy_cache_dealloc ((uchar *) slab, BLOCKSIZE(cache->slab_order));
+}
+
+/*
+ * slab_cache_create
+ *
+ * Creates a cache of obj_size objects.  The slab is the smallest
+ * power of 2, at least a page, that holds SLAB_MIN_OBJECTS of them.
+ * buddy_cache_init has to be called before.
+ */
+slab_cache_st *
+slab_cache_create (const char *name, uint obj_size)
+{
+    slab_cache_st  *cache;
+    dlist_st       *dlist;
+    uint            order;
+
+    if (obj_size == 0)
+        return (NULL);
+
+    cache = (slab_cache_st *) calloc (1, sizeof(slab_cache_st));
+    if (!cache)
+        return (NULL);
+
+    if (name)
+        strncpy (cache->name, name, SLAB_NAME_LEN - 1);
+
+    /*
+     * a free object holds the free list link.
+     */
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    cache->obj_size = SLAB_ALIGN(obj_size);
+    cache->obj_offset = SLAB_ALIGN(sizeof(slab_st));
+
+    order = buddy_get_order (cache->obj_offset +
+                             SLAB_MIN_OBJECTS * cache->obj_size);
+    if (order < SLAB_MIN_ORDER)
+        order = SLAB_MIN_ORDER;
+    cache->slab_order = order;
+    cache->objs_per_slab = (BLOCKSIZE(order) - cache->obj_offset) /
+                           cache->obj_size;
+
+    pthread_mutex_init (&cache->lock, NULL);
+    dlist = &cache->empty;
+    dlist_init (&dlist, NULL, NULL);
+    dlist = &cache->partial;
+    dlist_init (&dlist, NULL, NULL);
+    dlist = &cache->full;
+    dlist_init (&dlist, NULL, NULL);
+    return (cache);
+}
+
+/*
+ * slab_cache_destroy
+ *
+ * Gives all the slabs back to buddy, objects still in use
+ * become invalid.
+ */
+void
+slab_cache_destroy (slab_cache_st *cache)
+{
+    dlist_st  *lists[3];
+    slab_st   *slab;
+    int        i;
+
+    if (!cache)
+        return;
+
+    lists[0] = &cache->empty;
+    lists[1] = &cache->partial;
+    lists[2] = &cache->full;
+
+    pthread_mutex_lock (&cache->lock);
+    for (i = 0; i < 3; i++) {
+        while ((slab = (slab_st *) lists[i]->head) != NULL) {
+            slab_release (cache, slab);
+        }
+    }
+    pthread_mutex_unlock (&cache->lock);
+
+    pthread_mutex_destroy (&cache->lock);
+    free (cache);
+}
+
+void *
+slab_alloc (slab_cache_st *cache)
+{
+    slab_st  *slab;
+    void     *obj;
+
+    pthread_mutex_lock (&cache->lock);
+
+    slab = (slab_st *) cache->partial.head;
+    if (!slab)
+        slab = (slab_st *) cache->empty.head;
+    if (!slab)
+        slab = slab_grow (cache);
+    if (!slab) {
+        pthread_mutex_unlock (&cache->lock);
+        return (NULL);
+    }
+
+    if (slab->free_list) {
+        obj = slab->free_list;
+        slab->free_list = *(void **) obj;
+    } else {
+
+        /*
+         * never used objects are carved in order.
+         */
+        obj = (uchar *) slab + cache->obj_offset +
+              slab->carved * cache->obj_size;
+        slab->carved++;
+    }
+
+    slab->inuse++;
+    slab_move (cache, slab, slab->inuse == cache->objs_per_slab ?
+                            SLAB_FULL : SLAB_PARTIAL);
+
+    pthread_mutex_unlock (&cache->lock);
+    return (obj);
+}
+
+int
+slab_free (slab_cache_st *cache, void *obj)
+{
+    slab_st  *slab;
+
+    if (!cache || !obj)
+        return (-1);
+
+    slab = slab_of (cache, obj);
+    if (!slab || slab->cache != cache)
+        return (-1);
+
+    pthread_mutex_lock (&cache->lock);
+
+    *(void **) obj = slab->free_list;
+    slab->free_list = obj;
+    slab->inuse--;
+
+    if (slab->inuse) {
+        slab_move (cache, slab, SLAB_PARTIAL);
+    } else if (cache->empty.count < SLAB_MAX_EMPTY) {
+        slab_move (cache, slab, SLAB_EMPTY);
+    } else {
+        slab_release (cache, slab);
+    }
+
+    pthread_mutex_unlock (&cache->lock);
+    return (0);
+}
+
+/*
+ * slab_cache_reap
+ *
+ * Gives all the empty slabs back to buddy, returns how many.
+ */
+uint
+slab_cache_reap (slab_cache_st *cache)
+{
+    slab_st  *slab;
+    uint      n;
+
+    pthread_mutex_lock (&cache->lock);
+    for (n = 0; (slab = (slab_st *) cache->empty.head) != NULL; n++) {
+        slab_release (cache, slab);
+    }
+    pthread_mutex_unlock (&cache->lock);
+    return (n);
+}
@@ -0,0 +1,69 @@
+#ifndef __SLAB_ALLOC_H__
+#define __SLAB_ALLOC_H__
+
+/*
+ * Slab allocator for small fixed size objects.
+ * A cache hands out objects of one size.  The objects are packed
+ * in slabs, blocks of 2^k bytes carved from the buddy allocator
+ * with the slab header at the front, so an object has no header of
+ * its own and its slab is found by masking its offset in the arena.
+ * Free objects of a slab are chained through their first word.
+ */
+
+#include <pthread.h>
+
+#include "buddy_cache.h"
+
+/*
+ * smallest slab, and the least number of objects in one.
+ */
+#define  SLAB_MIN_ORDER          12
+#define  SLAB_MIN_OBJECTS        8
+
+/*
+ * empty slabs kept around before they go back to buddy.
+ */
+#define  SLAB_MAX_EMPTY          2
+
+#define  SLAB_NAME_LEN           32
+
+struct _slab_cache_st;
+
+typedef enum {
+    SLAB_EMPTY,
+    SLAB_PARTIAL,
+    SLAB_FULL
+} slab_state_e;
+
+/*
+ * The header at the front of every slab.
+ */
+typedef struct _slab_st {
+    struct _node_st         *next;       /* linkage on the cache's */
+    struct _node_st         *prev;       /* empty/partial/full list */
+    struct _slab_cache_st   *cache;
+    void                    *free_list;  /* freed objects */
+    uint                     inuse;      /* objects handed out */
+    uint                     carved;     /* objects ever handed out */
+    slab_state_e             state;
+} slab_st;
+
+typedef struct _slab_cache_st {
+    char             name[SLAB_NAME_LEN];
+    uint             obj_size;
+    uint             slab_order;
+    uint             objs_per_slab;
+    uint             obj_offset;         /* of the first object */
+    pthread_mutex_t  lock;
+    dlist_st         empty;
+    dlist_st         partial;
+    dlist_st         full;
+} slab_cache_st;
+
+slab_cache_st *slab_cache_create (const char *name, uint obj_size);
+void slab_cache_destroy (slab_cache_st *cache);
+void *slab_alloc (slab_cache_st *cache);
+int slab_free (slab_cache_st *cache, void *obj);
+uint slab_cache_reap (slab_cache_st *cache);
+
+#endif
@@ -0,0 +1,621 @@
+
+#include "tlsf_alloc.h"
+#include "fls.h"
+
+/*
+ * The free/prev_free bits live in the low bits of the size.
+ */
+#define  BLOCK_FREE_BIT          ((size_t) 0x1)
+#define  BLOCK_PREV_FREE_BIT     ((size_t) 0x2)
+#define  BLOCK_FLAG_BITS         (BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT)
+
+/*
+ * The only overhead of a used block is its size word, prev_phys
+ * lives in the tail of the previous block.
+ */
+#define  BLOCK_OVERHEAD          (sizeof (size_t))
+#define  BLOCK_START_OFFSET      (offsetof (tlsf_block_st, size) + \
+                                  sizeof (size_t))
+
+/*
+ * A free block has to hold the free list pointers, and sizes
+ * have to be representable in the first level bitmap.
+ */
+#define  BLOCK_SIZE_MIN          (sizeof (tlsf_block_st) - \
+                                  sizeof (tlsf_block_st *))
+#define  BLOCK_SIZE_MAX          ((size_t) 1 << TLSF_FL_INDEX_MAX)
+
+#define  ALIGN_UP(N, A)          (((N) + ((A) - 1)) & ~((size_t) (A) - 1))
+#define  ALIGN_DOWN(N, A)        ((N) & ~((size_t) (A) - 1))
+
+#define  OFFSET_TO_BLOCK(p, o)   ((tlsf_block_st *) ((uchar *) (p) + (o)))
+
+/*
+ * global memory manager data
+ */
+tlsf_ctrl_st     *tlsf_ctrl_g;
+
+/*
+ * tlsf_fls_size
+ *
+ * fls over a size_t, TLSF_fls only scans 32 bits.
+ */
+static __inline__ int
+tlsf_fls_size (size_t size)
+{
+#if SIZE_MAX > 0xFFFFFFFF
+    uint  high;
+
+    high = (uint) (size >> 32);
+    if (high)
+        return (32 + TLSF_fls ((int) high));
+#endif
+    return (TLSF_fls ((int) size));
+}
+
+static __inline__ size_t
+block_size (tlsf_block_st *block)
+{
+    return (block->size & ~BLOCK_FLAG_BITS);
+}
+
+static __inline__ void
+block_set_size (tlsf_block_st *block, size_t size)
+{
+    block->size = size | (block->size & BLOCK_FLAG_BITS);
+}
+
+static __inline__ int
+block_is_last (tlsf_block_st *block)
+{
+    return (block_size (block) == 0);
+}
+
+static __inline__ int
+block_is_free (tlsf_block_st *block)
+{
+    return ((block->size & BLOCK_FREE_BIT) != 0);
+}
+
+static __inline__ int
+block_is_prev_free (tlsf_block_st *block)
+{
+    return ((block->size & BLOCK_PREV_FREE_BIT) != 0);
+}
+
+static __inline__ uchar *
+block_to_ptr (tlsf_block_st *block)
+{
+    return ((uchar *) block + BLOCK_START_OFFSET);
+}
+
+static __inline__ tlsf_block_st *
+block_from_ptr (uchar *ptr)
+{
+    return ((tlsf_block_st *) (ptr - BLOCK_START_OFFSET));
+}
+
+/*
+ * block_next
+ *
+ * Returns the physically next block.
+ */
+static __inline__ tlsf_block_st *
+block_next (tlsf_block_st *block)
+{
+    return (OFFSET_TO_BLOCK (block_to_ptr (block),
+                block_size (block) - BLOCK_OVERHEAD));
+}
+
+/*
+ * block_link_next
+ *
+ * Points the next block back at this one and returns it.
+ */
+static __inline__ tlsf_block_st *
+block_link_next (tlsf_block_st *block)
+{
+    tlsf_block_st  *next;
+
+    next = block_next (block);
+    next->prev_phys = block;
+    return (next);
+}
+
+static __inline__ void
+block_mark_as_free (tlsf_block_st *block)
+{
+    tlsf_block_st  *next;
+
+    next = block_link_next (block);
+    next->size |= BLOCK_PREV_FREE_BIT;
+    block->size |= BLOCK_FREE_BIT;
+}
+
+static __inline__ void
+block_mark_as_used (tlsf_block_st *block)
+{
+    tlsf_block_st  *next;
+
+    next = block_next (block);
+    next->size &= ~BLOCK_PREV_FREE_BIT;
+    block->size &= ~BLOCK_FREE_BIT;
+}
+
+/*
+ * mapping_insert
+ *
+ * Computes the first and second level index of the list
+ * a block of this size belongs to.
+ */
+static __inline__ void
+mapping_insert (size_t size, int *fli, int *sli)
+{
+    int  fl, sl;
+
+    if (size < TLSF_SMALL_BLOCK_SIZE) {
+
+        /*
+         * small blocks are all kept in the first class.
+         */
+        fl = 0;
+        sl = (int) size / (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_INDEX_COUNT);
+    } else {
+        fl = tlsf_fls_size (size);
+        sl = (int) (size >> (fl - TLSF_SL_INDEX_COUNT_LOG2)) ^
+             (1 << TLSF_SL_INDEX_COUNT_LOG2);
+        fl -= (TLSF_FL_INDEX_SHIFT - 1);
+    }
+    *fli = fl;
+    *sli = sl;
+}
+
+/*
+ * mapping_search
+ *
+ * Like mapping_insert, but rounds the size up to the next
+ * list so that any block found there is big enough.
+ */
+static __inline__ void
+mapping_search (size_t size, int *fli, int *sli)
+{
+    size_t  round;
+
+    if (size >= TLSF_SMALL_BLOCK_SIZE) {
+        round = ((size_t) 1 << (tlsf_fls_size (size) -
+                    TLSF_SL_INDEX_COUNT_LOG2)) - 1;
+        size += round;
+    }
+    mapping_insert (size, fli, sli);
+}
+
+/*
+ * search_suitable_block
+ *
+ * Uses the bitmaps to find the first non-empty list at or
+ * above (fl, sl).  Updates fl/sl to the list it came from.
+ */
+static tlsf_block_st *
+search_suitable_block (tlsf_ctrl_st *ctrl, int *fli, int *sli)
+{
+    int       fl, sl;
+    uint32_t  sl_map, fl_map;
+
+    fl = *fli;
+    sl = *sli;
+
+    sl_map = ctrl->sl_bitmap[fl] & (~0U << sl);
+    if (!sl_map) {
+
+        /*
+         * nothing left in this class, go to the next non-empty one.
+         */
+        fl_map = ctrl->fl_bitmap & (~0U << (fl + 1));
+        if (!fl_map)
+            return (NULL);
+
+        fl = TLSF_ffs ((int) fl_map);
+        *fli = fl;
+        sl_map = ctrl->sl_bitmap[fl];
+    }
+    sl = TLSF_ffs ((int) sl_map);
+    *sli = sl;
+
+    return (ctrl->blocks[fl][sl]);
+}
+
+/*
+ * remove_free_block
+ *
+ * Unlinks a block from the free list (fl, sl) and clears
+ * the bitmaps when the list runs empty.
+ */
+static void
+remove_free_block (tlsf_ctrl_st *ctrl, tlsf_block_st *block, int fl, int sl)
+{
+    tlsf_block_st  *prev, *next;
+
+    prev = block->prev_free;
+    next = block->next_free;
+    next->prev_free = prev;
+    prev->next_free = next;
+
+    if (ctrl->blocks[fl][sl] == block) {
+        ctrl->blocks[fl][sl] = next;
+
+        if (next == &ctrl->block_null) {
+            ctrl->sl_bitmap[fl] &= ~(1U << sl);
+            if (!ctrl->sl_bitmap[fl]) {
+                ctrl->fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+}
+
+/*
+ * insert_free_block
+ *
+ * Pushes a block on the head of the free list (fl, sl).
+ */
+static void
+insert_free_block (tlsf_ctrl_st *ctrl, tlsf_block_st *block, int fl, int sl)
+{
+    tlsf_block_st  *current;
+
+    current = ctrl->blocks[fl][sl];
+    block->next_free = current;
+    block->prev_free = &ctrl->block_null;
+    current->prev_free = block;
+
+    ctrl->blocks[fl][sl] = block;
+    ctrl->fl_bitmap |= (1U << fl);
+    ctrl->sl_bitmap[fl] |= (1U << sl);
+}
+
+static void
+block_remove (tlsf_ctrl_st *ctrl, tlsf_block_st *block)
+{
+    int  fl, sl;
+
+    mapping_insert (block_size (block), &fl, &sl);
+    remove_free_block (ctrl, block, fl, sl);
+}
+
+static void
+block_insert (tlsf_ctrl_st *ctrl, tlsf_block_st *block)
+{
+    int  fl, sl;
+
+    mapping_insert (block_size (block), &fl, &sl);
+    insert_free_block (ctrl, block, fl, sl);
+}
+
+static __inline__ int
+block_can_split (tlsf_block_st *block, size_t size)
+{
+    return (block_size (block) >= sizeof (tlsf_block_st) + size);
+}
+
+/*
+ * block_split
+ *
+ * Splits the block at size bytes and returns the free remainder.
+ */
+static tlsf_block_st *
+block_split (tlsf_block_st *block, size_t size)
+{
+    tlsf_block_st  *remaining;
+    size_t          remain_size;
+
+    remaining = OFFSET_TO_BLOCK (block_to_ptr (block), size - BLOCK_OVERHEAD);
+    remain_size = block_size (block) - (size + BLOCK_OVERHEAD);
+
+    remaining->size = 0;
+    block_set_size (remaining, remain_size);
+    block_set_size (block, size);
+    block_mark_as_free (remaining);
+
+    return (remaining);
+}
+
+/*
+ * block_absorb
+ *
+ * Joins a block into its physically previous block.
+ */
+static tlsf_block_st *
+block_absorb (tlsf_block_st *prev, tlsf_block_st *block)
+{
+    prev->size += block_size (block) + BLOCK_OVERHEAD;
+    block_link_next (prev);
+    return (prev);
+}
+
+/*
+ * block_merge_prev
+ *
+ * Coalesces with the previous block if it is free.
+ */
+static tlsf_block_st *
+block_merge_prev (tlsf_ctrl_st *ctrl, tlsf_block_st *block)
+{
+    tlsf_block_st  *prev;
+
+    if (block_is_prev_free (block)) {
+        prev = block->prev_phys;
+        block_remove (ctrl, prev);
+        block = block_absorb (prev, block);
+    }
+    return (block);
+}
+
+/*
+ * block_merge_next
+ *
+ * Coalesces with the next block if it is free.
+ */
+static tlsf_block_st *
+block_merge_next (tlsf_ctrl_st *ctrl, tlsf_block_st *block)
+{
+    tlsf_block_st  *next;
+
+    next = block_next (block);
+    if (block_is_free (next)) {
+        block_remove (ctrl, next);
+        block = block_absorb (block, next);
+    }
+    return (block);
+}
+
+/*
+ * block_trim_free
+ *
+ * Gives back the tail of a free block we are about to use.
+ */
+static void
+block_trim_free (tlsf_ctrl_st *ctrl, tlsf_block_st *block, size_t size)
+{
+    tlsf_block_st  *remaining;
+
+    if (block_can_split (block, size)) {
+        remaining = block_split (block, size);
+        block_link_next (block);
+        remaining->size |= BLOCK_PREV_FREE_BIT;
+        block_insert (ctrl, remaining);
+    }
+}
+
+/*
+ * block_trim_used
+ *
+ * Gives back the tail of a used block, it is coalesced with
+ * the next block if that one is free.
+ */
+static void
+block_trim_used (tlsf_ctrl_st *ctrl, tlsf_block_st *block, size_t size)
+{
+    tlsf_block_st  *remaining;
+
+    if (block_can_split (block, size)) {
+        remaining = block_split (block, size);
+        remaining->size &= ~BLOCK_PREV_FREE_BIT;
+        remaining = block_merge_next (ctrl, remaining);
+        block_insert (ctrl, remaining);
+    }
+}
+
+/*
+ * adjust_request_size
+ *
+ * Adjusts the size of the request to the alignment and the
+ * minimum block size.  Returns 0 if it can never be satisfied.
+ */
+static size_t
+adjust_request_size (size_t size)
+{
+    size_t  aligned;
+
+    if (size == 0 || size >= BLOCK_SIZE_MAX)
+        return (0);
+
+    aligned = ALIGN_UP (size, TLSF_ALIGN_SIZE);
+    if (aligned >= BLOCK_SIZE_MAX)
+        return (0);
+    if (aligned < BLOCK_SIZE_MIN)
+        aligned = BLOCK_SIZE_MIN;
+    return (aligned);
+}
+
+/*
+ * locate_free
+ *
+ * Finds and unlinks a free block big enough for size.
+ */
+static tlsf_block_st *
+locate_free (tlsf_ctrl_st *ctrl, size_t size)
+{
+    tlsf_block_st  *block;
+    int             fl, sl;
+
+    mapping_search (size, &fl, &sl);
+    if (fl >= TLSF_FL_INDEX_COUNT)
+        return (NULL);
+
+    block = search_suitable_block (ctrl, &fl, &sl);
+    if (!block || block == &ctrl->block_null)
+        return (NULL);
+
+    remove_free_block (ctrl, block, fl, sl);
+    return (block);
+}
+
+/*
+ * tlsf_alloc_init
+ *
+ * Initialize the allocator over a caller supplied region.  The
+ * control structure is carved from the head of the region and the
+ * rest becomes one big free block followed by a zero sized sentinel.
+ */
+int
+tlsf_alloc_init (void *mem, size_t bytes)
+{
+    tlsf_ctrl_st   *ctrl;
+    tlsf_block_st  *block, *next;
+    uchar          *pool;
+    size_t          ctrl_size, pool_bytes;
+    int             i, j;
+
+    if (!mem)
+        return (-1);
+
+    ctrl_size = ALIGN_UP (sizeof (tlsf_ctrl_st), TLSF_ALIGN_SIZE);
+    pool = (uchar *) ALIGN_UP ((uintptr_t) mem, TLSF_ALIGN_SIZE);
+    if (bytes < (size_t) (pool - (uchar *) mem) + ctrl_size +
+            2 * BLOCK_OVERHEAD + BLOCK_SIZE_MIN) {
+        return (-1);
+    }
+    bytes -= (pool - (uchar *) mem);
+
+    ctrl = (tlsf_ctrl_st *) pool;
+    ctrl->block_null.next_free = &ctrl->block_null;
+    ctrl->block_null.prev_free = &ctrl->block_null;
+    ctrl->fl_bitmap = 0;
+    for (i = 0; i < TLSF_FL_INDEX_COUNT; i++) {
+        ctrl->sl_bitmap[i] = 0;
+        for (j = 0; j < TLSF_SL_INDEX_COUNT; j++) {
+            ctrl->blocks[i][j] = &ctrl->block_null;
+        }
+    }
+
+    pool += ctrl_size;
+    pool_bytes = ALIGN_DOWN (bytes - ctrl_size - 2 * BLOCK_OVERHEAD,
+            TLSF_ALIGN_SIZE);
+    if (pool_bytes >= BLOCK_SIZE_MAX)
+        pool_bytes = ALIGN_DOWN (BLOCK_SIZE_MAX - 1, TLSF_ALIGN_SIZE);
+
+    /*
+     * the first block's prev_phys sits before the pool, it is
+     * never touched since the previous block is never free.
+     */
+    block = OFFSET_TO_BLOCK (pool, -(ptrdiff_t) BLOCK_OVERHEAD);
+    block->size = 0;
+    block_set_size (block, pool_bytes);
+    block->size |= BLOCK_FREE_BIT;
+    block->size &= ~BLOCK_PREV_FREE_BIT;
+    block_insert (ctrl, block);
+
+    /*
+     * the sentinel, zero sized and used.
+     */
+    next = block_link_next (block);
+    next->size = BLOCK_PREV_FREE_BIT;
+
+    tlsf_ctrl_g = ctrl;
+    return (0);
+}
+
+unsigned char *
+tlsf_alloc (size_t size)
+{
+    tlsf_block_st  *block;
+    size_t          adjust;
+
+    if (!tlsf_ctrl_g)
+        return (NULL);
+
+    adjust = adjust_request_size (size);
+    if (!adjust)
+        return (NULL);
+
+    block = locate_free (tlsf_ctrl_g, adjust);
+    if (!block)
+        return (NULL);
+
+    block_trim_free (tlsf_ctrl_g, block, adjust);
+    block_mark_as_used (block);
+    return (block_to_ptr (block));
+}
+
+/*
+ * De-allocating a block of memory.
+ * Coalesce with the physical neighbours
+ * Return to the appropriate free list.
+ */
+int
+tlsf_dealloc (uchar *ptr)
+{
+    tlsf_block_st  *block;
+
+    if (!tlsf_ctrl_g || !ptr)
+        return (-1);
+
+    block = block_from_ptr (ptr);
+    if (block_is_free (block))
+        return (-1);
+
+    block_mark_as_free (block);
+    block = block_merge_prev (tlsf_ctrl_g, block);
+    block = block_merge_next (tlsf_ctrl_g, block);
+    block_insert (tlsf_ctrl_g, block);
+    return (0);
+}
+
+/*
+ * tlsf_realloc
+ *
+ * Grows in place when the next block is free and big enough,
+ * shrinks in place by trimming, otherwise allocates and copies.
+ */
+unsigned char *
+tlsf_realloc (uchar *ptr, size_t size)
+{
+    tlsf_block_st  *block, *next;
+    uchar          *p;
+    size_t          cursize, combined, adjust;
+
+    if (ptr && size == 0) {
+        tlsf_dealloc (ptr);
+        return (NULL);
+    }
+    if (!ptr)
+        return (tlsf_alloc (size));
+
+    block = block_from_ptr (ptr);
+    next = block_next (block);
+
+    cursize = block_size (block);
+    combined = cursize + block_size (next) + BLOCK_OVERHEAD;
+    adjust = adjust_request_size (size);
+    if (!adjust)
+        return (NULL);
+
+    if (adjust > cursize && (!block_is_free (next) || adjust > combined)) {
+        p = tlsf_alloc (size);
+        if (p) {
+            memcpy (p, ptr, cursize < size ? cursize : size);
+            tlsf_dealloc (ptr);
+        }
+        return (p);
+    }
+
+    if (adjust > cursize) {
+        block_merge_next (tlsf_ctrl_g, block);
+        block_mark_as_used (block);
+    }
+
+    block_trim_used (tlsf_ctrl_g, block, adjust);
+    return (ptr);
+}
+
+/*
+ * tlsf_block_size
+ *
+ * Usable size of an allocated block.
+ */
+size_t
+tlsf_block_size (uchar *ptr)
+{
+    if (!ptr)
+        return (0);
+    return (block_size (block_from_ptr (ptr)));
+}
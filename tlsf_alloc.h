@@ -0,0 +1,79 @@
+#ifndef __TLSF_ALLOC_H__
+#define __TLSF_ALLOC_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * Two-Level Segregated Fit allocator ...
+ * Free blocks are kept on segregated lists indexed by two levels.
+ * The first level splits the sizes in power of 2 classes
+ * (fl = fls(size)), the second level splits every first level
+ * class linearly into 2^SL_INDEX_COUNT_LOG2 lists.  A bitmap per
+ * level tells which lists are non-empty, so finding a suitable
+ * block is a couple of ffs/fls instructions and every malloc/free
+ * runs in constant time.
+ *
+ * Every block carries a header with its size and a pointer to
+ * the physically previous block, which is used to coalesce
+ * a freed block with both of its neighbours immediately.
+ */
+
+#include "common.h"
+
+/*
+ * log2 of the number of second level lists per first level class.
+ */
+#define  TLSF_SL_INDEX_COUNT_LOG2   5
+
+/*
+ * All blocks are aligned to 8 bytes.
+ */
+#define  TLSF_ALIGN_SIZE_LOG2       3
+#define  TLSF_ALIGN_SIZE            (1 << TLSF_ALIGN_SIZE_LOG2)
+
+/*
+ * Largest block is 2 pow TLSF_FL_INDEX_MAX
+ */
+#define  TLSF_FL_INDEX_MAX          32
+
+#define  TLSF_SL_INDEX_COUNT        (1 << TLSF_SL_INDEX_COUNT_LOG2)
+#define  TLSF_FL_INDEX_SHIFT        (TLSF_SL_INDEX_COUNT_LOG2 + \
+                                     TLSF_ALIGN_SIZE_LOG2)
+#define  TLSF_FL_INDEX_COUNT        (TLSF_FL_INDEX_MAX - \
+                                     TLSF_FL_INDEX_SHIFT + 1)
+#define  TLSF_SMALL_BLOCK_SIZE      (1 << TLSF_FL_INDEX_SHIFT)
+
+/*
+ * A block header.  prev_phys is only valid when the previous
+ * block is free, and it physically lives in the last word of the
+ * previous block.  next_free/prev_free are only valid when this
+ * block is free, and they live in the payload.
+ */
+typedef struct _tlsf_block_st {
+    struct _tlsf_block_st *prev_phys;
+    size_t                 size;      /* size in bytes, the 2 LSB's */
+                                      /* tell if this and the previous */
+                                      /* block are free */
+    struct _tlsf_block_st *next_free;
+    struct _tlsf_block_st *prev_free;
+} tlsf_block_st;
+
+/*
+ * The allocator state, carved from the head of the pool.
+ */
+typedef struct _tlsf_ctrl_st {
+    tlsf_block_st   block_null;       /* empty lists point here */
+    uint32_t        fl_bitmap;
+    uint32_t        sl_bitmap[TLSF_FL_INDEX_COUNT];
+    tlsf_block_st  *blocks[TLSF_FL_INDEX_COUNT][TLSF_SL_INDEX_COUNT];
+} tlsf_ctrl_st;
+
+int tlsf_alloc_init (void *mem, size_t bytes);
+unsigned char* tlsf_alloc (size_t size);
+unsigned char* tlsf_realloc (uchar *ptr, size_t size);
+int tlsf_dealloc (uchar *ptr);
+size_t tlsf_block_size (uchar *ptr);
+
+#endif
+
@@ -0,0 +1,449 @@
+#include "ulist.h"
+
+/*
+ * new_chunk
+ *
+ * Links an empty chunk in after prev, or first when prev is NULL.
+ */
+static ulist_chunk_st *
+new_chunk (ulist_st *list, ulist_chunk_st *prev)
+{
+    ulist_chunk_st  *chunk;
+
+    if (posix_memalign ((void **) &chunk, ULIST_CACHE_LINE,
+                        sizeof (ulist_chunk_st)) != 0)
+        return (NULL);
+
+    chunk->count = 0;
+    chunk->prev = prev;
+    chunk->next = prev ? prev->next : list->head;
+    if (chunk->next)
+        chunk->next->prev = chunk;
+    else
+        list->tail = chunk;
+    if (prev)
+        prev->next = chunk;
+    else
+        list->head = chunk;
+    list->chunks++;
+    return (chunk);
+}
+
+static void
+free_chunk (ulist_st *list, ulist_chunk_st *chunk)
+{
+    if (chunk->prev)
+        chunk->prev->next = chunk->next;
+    else
+        list->head = chunk->next;
+    if (chunk->next)
+        chunk->next->prev = chunk->prev;
+    else
+        list->tail = chunk->prev;
+    list->chunks--;
+    free (chunk);
+}
+
+/*
+ * move_slots
+ *
+ * Moves n slots, keys and elements, from one place to another,
+ * which may overlap.
+ */
+static inline void
+move_slots (ulist_chunk_st *to, uint to_pos, ulist_chunk_st *from,
+            uint from_pos, uint n)
+{
+    memmove (&to->keys[to_pos], &from->keys[from_pos], n * sizeof (uint64_t));
+    memmove (&to->elems[to_pos], &from->elems[from_pos], n * sizeof (void *));
+}
+
+/*
+ * slot_cmp
+ *
+ * Compares slot i of chunk with elem, by cmp when it is given and
+ * by key otherwise.
+ */
+static inline int
+slot_cmp (ulist_chunk_st *chunk, uint i, ulist_cmp_fn cmp,
+          void *elem, uint64_t key)
+{
+    if (cmp)
+        return (cmp (chunk->elems[i], elem));
+    return (chunk->keys[i] < key ? -1 : chunk->keys[i] > key);
+}
+
+/*
+ * find_slot
+ *
+ * Finds, in a sorted list, the first slot greater than elem, or
+ * not less than it unless after_equal is set.  A chunk is skipped
+ * on its last slot alone.  Returns the chunk with *pos set, or the
+ * tail with *pos at its end when every slot is before elem, NULL
+ * for an empty list.
+ */
+static ulist_chunk_st *
+find_slot (ulist_st *list, ulist_cmp_fn cmp, void *elem, uint64_t key,
+           boolean after_equal, uint *pos)
+{
+    ulist_chunk_st  *chunk;
+    uint             i;
+    int              r;
+
+    /*
+     * appending in order does not walk the list.
+     */
+    chunk = list->tail;
+    if (chunk) {
+        r = slot_cmp (chunk, chunk->count - 1, cmp, elem, key);
+        if (r < 0 || (r == 0 && after_equal)) {
+            *pos = chunk->count;
+            return (chunk);
+        }
+    }
+
+    for (chunk = list->head; chunk; chunk = chunk->next) {
+        r = slot_cmp (chunk, chunk->count - 1, cmp, elem, key);
+        if (r < 0 || (r == 0 && after_equal))
+            continue;
+
+        for (i = 0; i < chunk->count; i++) {
+            r = slot_cmp (chunk, i, cmp, elem, key);
+            if (r > 0 || (r == 0 && !after_equal))
+                break;
+        }
+        *pos = i;
+        return (chunk);
+    }
+
+    *pos = list->tail ? list->tail->count : 0;
+    return (list->tail);
+}
+
+/*
+ * insert_slot
+ *
+ * Puts elem at pos in chunk.  A full chunk is split in two, unless
+ * elem goes past the end of the tail, in which case it starts a
+ * new chunk so appending in order leaves the chunks full.
+ */
+static int
+insert_slot (ulist_st *list, ulist_chunk_st *chunk, uint pos,
+             void *elem, uint64_t key)
+{
+    ulist_chunk_st  *split;
+    uint             half;
+
+    if (!chunk) {
+        chunk = new_chunk (list, NULL);
+        if (!chunk)
+            return (-1);
+        pos = 0;
+    } else if (chunk->count == ULIST_CHUNK_SLOTS) {
+        split = new_chunk (list, chunk);
+        if (!split)
+            return (-1);
+        if (pos == ULIST_CHUNK_SLOTS && !split->next) {
+            chunk = split;
+            pos = 0;
+        } else {
+            half = ULIST_CHUNK_SLOTS / 2;
+            move_slots (split, 0, chunk, half, ULIST_CHUNK_SLOTS - half);
+            split->count = ULIST_CHUNK_SLOTS - half;
+            chunk->count = half;
+            if (pos > half) {
+                chunk = split;
+                pos -= half;
+            }
+        }
+    }
+
+    move_slots (chunk, pos + 1, chunk, pos, chunk->count - pos);
+    chunk->keys[pos] = key;
+    chunk->elems[pos] = elem;
+    chunk->count++;
+    list->count++;
+    return (0);
+}
+
+/*
+ * remove_slot
+ *
+ * Takes slot pos out of chunk and gives the element to the free
+ * function.  An empty chunk is freed, and one that is down to a
+ * quarter pulls in the next chunk when they fit in one.
+ */
+static void
+remove_slot (ulist_st *list, ulist_chunk_st *chunk, uint pos)
+{
+    ulist_chunk_st  *next;
+    void            *elem;
+
+    elem = chunk->elems[pos];
+    chunk->count--;
+    move_slots (chunk, pos, chunk, pos + 1, chunk->count - pos);
+    list->count--;
+
+    next = chunk->next;
+    if (chunk->count == 0) {
+        free_chunk (list, chunk);
+    } else if (chunk->count < ULIST_CHUNK_SLOTS / 4 && next &&
+               chunk->count + next->count <= ULIST_CHUNK_SLOTS) {
+        move_slots (chunk, chunk->count, next, 0, next->count);
+        chunk->count += next->count;
+        free_chunk (list, next);
+    }
+
+    if (list->free_fn)
+        (*list->free_fn)(elem);
+}
+
+/*
+ * find_elem
+ *
+ * Finds the slot holding elem itself.  In a sorted list only the
+ * slots equal to it are looked at.
+ */
+static ulist_chunk_st *
+find_elem (ulist_st *list, void *elem, uint *pos)
+{
+    ulist_chunk_st  *chunk;
+    ulist_cmp_fn     cmp;
+    uint64_t         key;
+    uint             i;
+
+    if (!list->key_fn && !list->cmp_fn) {
+        for (chunk = list->head; chunk; chunk = chunk->next) {
+            for (i = 0; i < chunk->count; i++) {
+                if (chunk->elems[i] == elem) {
+                    *pos = i;
+                    return (chunk);
+                }
+            }
+        }
+        return (NULL);
+    }
+
+    cmp = list->key_fn ? NULL : list->cmp_fn;
+    key = list->key_fn ? list->key_fn (elem) : 0;
+    chunk = find_slot (list, cmp, elem, key, FALSE, &i);
+    for (; chunk; chunk = chunk->next, i = 0) {
+        for (; i < chunk->count; i++) {
+            if (chunk->elems[i] == elem) {
+                *pos = i;
+                return (chunk);
+            }
+            if (slot_cmp (chunk, i, cmp, elem, key) != 0)
+                return (NULL);
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * ulist_init
+ *
+ * Init a new unrolled list, allocating it when *list is NULL.
+ * With a key function the list is sorted by key, else with a
+ * compare function by it, else it keeps insertion order.
+ */
+int
+ulist_init (ulist_st **list, ulist_free_fn free_fn, ulist_cmp_fn cmp_fn,
+            ulist_key_fn key_fn)
+{
+    if (!list)
+        return (-1);
+
+    if (*list == NULL)
+        *list = (ulist_st *) malloc (sizeof (ulist_st));
+    if (*list == NULL)
+        return (-1);
+
+    memset (*list, 0, sizeof (ulist_st));
+    (*list)->free_fn = free_fn;
+    (*list)->cmp_fn = cmp_fn;
+    (*list)->key_fn = key_fn;
+    return (0);
+}
+
+/*
+ * ulist_destroy
+ *
+ * Gives every element to the free function and frees the chunks.
+ * The list itself is left to the caller.
+ */
+void
+ulist_destroy (ulist_st *list)
+{
+    ulist_chunk_st  *chunk;
+    uint             i;
+
+    if (!list)
+        return;
+
+    while ((chunk = list->head) != NULL) {
+        if (list->free_fn) {
+            for (i = 0; i < chunk->count; i++)
+                (*list->free_fn)(chunk->elems[i]);
+        }
+        list->count -= chunk->count;
+        free_chunk (list, chunk);
+    }
+}
+
+/*
+ * ulist_enqueue
+ *
+ * Inserts an element in order, after the elements equal to it, or
+ * at the tail of an unsorted list.
+ */
+int
+ulist_enqueue (ulist_st *list, void *elem)
+{
+    ulist_chunk_st  *chunk;
+    uint64_t         key;
+    uint             pos;
+
+    if (!list)
+        return (-1);
+
+    key = list->key_fn ? list->key_fn (elem) : 0;
+    if (list->key_fn || list->cmp_fn) {
+        chunk = find_slot (list, list->key_fn ? NULL : list->cmp_fn,
+                           elem, key, TRUE, &pos);
+    } else {
+        chunk = list->tail;
+        pos = chunk ? chunk->count : 0;
+    }
+    return (insert_slot (list, chunk, pos, elem, key));
+}
+
+/*
+ * ulist_enqueue_head
+ *
+ * Pushes an element on the head of an unsorted list.
+ */
+int
+ulist_enqueue_head (ulist_st *list, void *elem)
+{
+    ulist_chunk_st  *chunk;
+
+    if (!list || list->key_fn || list->cmp_fn)
+        return (-1);
+
+    chunk = list->head;
+    if (chunk && chunk->count == ULIST_CHUNK_SLOTS) {
+        chunk = new_chunk (list, NULL);
+        if (!chunk)
+            return (-1);
+    }
+    return (insert_slot (list, chunk, 0, elem, 0));
+}
+
+/*
+ * ulist_dequeue
+ *
+ * Dequeues an element, which has to be on this list.
+ */
+int
+ulist_dequeue (ulist_st *list, void *elem)
+{
+    ulist_chunk_st  *chunk;
+    uint             pos;
+
+    if (!list)
+        return (-1);
+
+    chunk = find_elem (list, elem, &pos);
+    if (!chunk)
+        return (-1);
+    remove_slot (list, chunk, pos);
+    return (0);
+}
+
+/*
+ * ulist_dequeue_head
+ *
+ * Dequeues the first element.
+ */
+void *
+ulist_dequeue_head (ulist_st *list)
+{
+    void  *elem;
+
+    if (!list || !list->head)
+        return (NULL);
+
+    elem = list->head->elems[0];
+    remove_slot (list, list->head, 0);
+    return (elem);
+}
+
+/*
+ * ulist_find
+ *
+ * Finds the first element cmp says is equal to to_elem.  On a list
+ * sorted by its compare function, cmp has to order the elements
+ * the same way, and whole chunks are skipped.
+ */
+void *
+ulist_find (ulist_st *list, ulist_cmp_fn cmp, void *to_elem)
+{
+    ulist_chunk_st  *chunk;
+    uint             i;
+
+    if (!list || !cmp)
+        return (NULL);
+
+    if (list->cmp_fn && !list->key_fn) {
+        chunk = find_slot (list, cmp, to_elem, 0, FALSE, &i);
+        if (chunk && i < chunk->count && cmp (chunk->elems[i], to_elem) == 0)
+            return (chunk->elems[i]);
+        return (NULL);
+    }
+
+    for (chunk = list->head; chunk; chunk = chunk->next) {
+        for (i = 0; i < chunk->count; i++) {
+            if (cmp (chunk->elems[i], to_elem) == 0)
+                return (chunk->elems[i]);
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * ulist_find_key
+ *
+ * Finds the first element with a key, on a list with a key
+ * function.  Only the inline keys are read.
+ */
+void *
+ulist_find_key (ulist_st *list, uint64_t key)
+{
+    ulist_chunk_st  *chunk;
+    uint             i;
+
+    if (!list || !list->key_fn)
+        return (NULL);
+
+    chunk = find_slot (list, NULL, NULL, key, FALSE, &i);
+    if (chunk && i < chunk->count && chunk->keys[i] == key)
+        return (chunk->elems[i]);
+    return (NULL);
+}
+
+/*
+ * ulist_find_and_dequeue
+ *
+ * Finds an element with a compare method and dequeues it.
+ */
+int
+ulist_find_and_dequeue (ulist_st *list, ulist_cmp_fn cmp, void *to_elem)
+{
+    void  *elem;
+
+    elem = ulist_find (list, cmp, to_elem);
+    if (!elem)
+        return (-1);
+    return (ulist_dequeue (list, elem));
+}
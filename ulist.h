@@ -0,0 +1,73 @@
+#ifndef __ULIST_H__
+#define __ULIST_H__
+
+/*
+ * An unrolled list.
+ * Instead of a node per element, the list links chunks that each
+ * hold up to ULIST_CHUNK_SLOTS element pointers in an array, so a
+ * scan reads the pointers of a whole chunk from a couple of cache
+ * lines and takes one pointer chase per chunk, not per element.
+ *
+ * A list can be given a key function.  The key of every element
+ * is then kept inline next to its pointer, a sorted list is
+ * ordered by key and ulist_find_key() never touches the elements.
+ * Without one a sorted list is ordered by its compare function,
+ * and without either it keeps insertion order like a dlist.
+ *
+ * The elements are the caller's, the list only holds pointers to
+ * them, so they need no links.
+ */
+
+#include "common.h"
+
+#define  ULIST_CHUNK_SLOTS   16
+#define  ULIST_CACHE_LINE    64
+
+typedef int      (*ulist_cmp_fn) (void *cur_elem, void *to_elem);
+typedef void     (*ulist_free_fn) (void *elem);
+typedef uint64_t (*ulist_key_fn) (void *elem);
+
+/*
+ * keys[] and elems[] each fill two whole cache lines, the links
+ * come after them.
+ */
+typedef struct _ulist_chunk_st {
+    uint64_t                  keys[ULIST_CHUNK_SLOTS];
+    void                     *elems[ULIST_CHUNK_SLOTS];
+    struct _ulist_chunk_st   *next;
+    struct _ulist_chunk_st   *prev;
+    uint                      count;
+} __attribute__((aligned(ULIST_CACHE_LINE))) ulist_chunk_st;
+
+typedef struct _ulist_st {
+    ulist_chunk_st  *head;
+    ulist_chunk_st  *tail;
+    uint             count;    /* elements, not chunks */
+    uint             chunks;
+    ulist_free_fn    free_fn;  /* called on an element when dequeued */
+    ulist_cmp_fn     cmp_fn;   /* orders a sorted list without keys */
+    ulist_key_fn     key_fn;   /* orders a sorted list by an inline key */
+} ulist_st;
+
+/*
+ * walks every element, elem is set to each in turn.  A break only
+ * leaves the inner loop, and the list must not change meanwhile.
+ */
+#define  ULIST_FOREACH(list, chunk, i, elem) \
+    for ((chunk) = (list)->head; (chunk); (chunk) = (chunk)->next) \
+        for ((i) = 0; (i) < (chunk)->count && \
+             ((elem) = (chunk)->elems[(i)], 1); (i)++)
+
+extern int ulist_init (ulist_st **list, ulist_free_fn free_fn,
+                       ulist_cmp_fn cmp_fn, ulist_key_fn key_fn);
+extern void ulist_destroy (ulist_st *list);
+extern int ulist_enqueue (ulist_st *list, void *elem);
+extern int ulist_enqueue_head (ulist_st *list, void *elem);
+extern int ulist_dequeue (ulist_st *list, void *elem);
+extern void * ulist_dequeue_head (ulist_st *list);
+extern void * ulist_find (ulist_st *list, ulist_cmp_fn cmp, void *to_elem);
+extern void * ulist_find_key (ulist_st *list, uint64_t key);
+extern int ulist_find_and_dequeue (ulist_st *list, ulist_cmp_fn cmp,
+                                   void *to_elem);
+
+#endif
@@ -4,10 +4,18 @@
 #include <unistd.h>
 #include <pthread.h>
 
+#include "slab_alloc.h"
+#include "clist.h"
+
 const pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 const pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 const int MAX_WORKERS = 5;
 
+/*
+ * memory for the job and worker channel queue elements.
+ */
+#define WORKER_POOL_ARENA_SIZE (4 * 1024 * 1024)
+
 typedef void * job_t;
 
 /**
@@ -26,8 +34,8 @@ typedef struct worker_channel_st {
  * A worker add's it channel into this queue when it is free
  */
 typedef struct worker_pool_queue_st {
+    node_st node;               /* links on the dispatcher's queue */
     worker_channel_t *channel;
-    struct worker_pool_queue_st *next;
 } worker_pool_queue_t, worker_pool_queue_element_t;
 
 /**
@@ -35,8 +43,8 @@ typedef struct worker_pool_queue_st {
  * until a worker channel becomes available.
  */
 typedef struct job_queue_element_st {
+    node_st node;               /* links on the dispatcher's queue */
     job_t *job;
-    struct job_queue_element_st *next;
 } job_queue_t, job_queue_element_t;
 
 /**
@@ -59,6 +67,8 @@ typedef struct worker_st {
  * A dispatcher queues up the job in the job queue when
  * all workers are busy. When a worker becomes available,
  * job is dequeued from the job queue and given to the worker.
+ * Both queues are FIFO clists, so adding at the tail and taking
+ * the head is O(1) however many jobs are pending.
  */
 typedef struct dispatcher_st {
     pthread_t thread_id;
@@ -66,8 +76,8 @@ typedef struct dispatcher_st {
     pthread_cond_t cond;
 
     struct worker_st **workers;
-    worker_pool_queue_t *worker_pool_root;
-    job_queue_t *job_root;
+    clist_st worker_pool_queue;
+    clist_st job_queue;
     int num_workers;
     int job_pending_cnt;
     short stop;
@@ -77,6 +87,13 @@ typedef struct dispatcher_st {
 
 void* dispatch_thread_start(void *arg);
 
+/**
+ * slab caches for the queue elements, they are small and
+ * allocated and freed for every job.
+ */
+slab_cache_st *job_cache_g;
+slab_cache_st *channel_cache_g;
+
 
 /**
  * func: new_worker_pool_queue_element
@@ -89,8 +106,10 @@ void* dispatch_thread_start(void *arg);
 worker_pool_queue_element_t *
 new_worker_pool_queue_element(worker_channel_t *channel) {
     worker_pool_queue_element_t *node =
-            (worker_pool_queue_element_t *) malloc(
-                    sizeof(worker_pool_queue_element_t));
+            (worker_pool_queue_element_t *) slab_alloc(channel_cache_g);
+    if (node == NULL) {
+        return NULL;
+    }
     memset(node, 0, sizeof(worker_pool_queue_element_t));
     node->channel = channel;
     return node;
@@ -99,60 +118,36 @@ new_worker_pool_queue_element(worker_channel_t *channel) {
 /**
  * func: add_worker_channel
  *
- * Add's the worker channel into a worker channel queue
+ * Add's the worker channel at the tail of a worker channel queue
  * 
- * arg1: worker_pool_queue_t **root
+ * arg1: clist_st *queue
  * arg2: worker_channel_t *channel
  */
-void add_worker_channel(worker_pool_queue_t **root, worker_channel_t *channel) {
-    worker_pool_queue_element_t *prev;
-
-    if (root == NULL) {
+void add_worker_channel(clist_st *queue, worker_channel_t *channel) {
+    if (queue == NULL) {
         return;
     }
 
     worker_pool_queue_element_t *node = new_worker_pool_queue_element(channel);
 
     if (node != NULL) {
-        if (*root == NULL) {
-            *root = node;
-            return;
-        } else {
-            for (prev = *root; prev->next != NULL; prev = prev->next) {
-                ;
-            }
-            prev->next = node;
-            return;
-        }
+        clist_push_tail(queue, &node->node);
     }
 }
 
 /**
  * func: remove_worker_channel
  *
- * Remove's the matching worker channel from the worker channel queue
+ * Take's the worker channel element off the worker channel queue
  * 
- * arg1: worker_pool_queue_t **root
- * arg2: worker_channel_t *channel
+ * arg1: clist_st *queue
+ * arg2: worker_pool_queue_element_t *node
  */
-void remove_worker_channel(worker_pool_queue_t **root, worker_channel_t *channel) {
-    worker_pool_queue_element_t *prev = NULL, *cur = NULL;
-
-    if (root == NULL || *root == NULL) {
+void remove_worker_channel(clist_st *queue, worker_pool_queue_element_t *node) {
+    if (queue == NULL || node == NULL) {
         return;
     }
-    for (cur = *root; cur != NULL; cur = cur->next) {
-        if (cur->channel == channel) {
-            if (cur == *root) {
-                *root = cur->next;
-            } else {
-                prev->next = cur->next;
-            }
-            return;
-        }
-        prev = cur;
-    }
-    return;
+    clist_unlink(queue, &node->node);
 }
 
 /**
@@ -164,7 +159,10 @@ void remove_worker_channel(worker_pool_queue_t **root, worker_channel_t *channel
  * arg1: worker_channel_t *
  */
 job_queue_t *new_job_element(job_t *job) {
-    job_queue_t *node = (job_queue_t *) malloc(sizeof(job_queue_t));
+    job_queue_t *node = (job_queue_t *) slab_alloc(job_cache_g);
+    if (node == NULL) {
+        return NULL;
+    }
     memset(node, 0, sizeof(job_queue_t));
     node->job = job;
     return node;
@@ -173,55 +171,31 @@ job_queue_t *new_job_element(job_t *job) {
 /**
  * func: add_job
  *
- * Add's the job into a job queue
+ * Add's the job at the tail of a job queue
  * 
- * arg1: job_queue_t **root
+ * arg1: clist_st *queue
  * arg2: job_t *job
  */
-void add_job(job_queue_t **root, job_t *job) {
-    job_queue_t *prev;
-
-    if (root == NULL) return;
+void add_job(clist_st *queue, job_t *job) {
+    if (queue == NULL) return;
     job_queue_element_t *node = new_job_element(job);
     if (node != NULL) {
-        if (*root == NULL) {
-            *root = node;
-            return;
-        } else {
-            for (prev = *root; prev->next != NULL; prev = prev->next) {
-                ;
-            }
-            prev->next = node;
-            return;
-        }
+        clist_push_tail(queue, &node->node);
     }
 }
 
 /**
  * func: remove_job
  *
- * Remove's the matching job from the job queue
+ * Take's the job element off the job queue
  * 
- * arg1: job_queue_t **root
- * arg2: job_t *job
+ * arg1: clist_st *queue
+ * arg2: job_queue_element_t *node
  */
-void remove_job(job_queue_t **root, job_t *job) {
-    job_queue_element_t *prev = NULL, *cur = NULL;
-
-    if (root == NULL || *root == NULL)
+void remove_job(clist_st *queue, job_queue_element_t *node) {
+    if (queue == NULL || node == NULL)
         return;
-    for (cur = *root; cur != NULL; cur = cur->next) {
-        if (cur->job == job) {
-            if (cur == *root) {
-                *root = cur->next;
-            } else {
-                prev->next = cur->next;
-            }
-            return;
-        }
-        prev = cur;
-    }
-    return;
+    clist_unlink(queue, &node->node);
 }
 
 /**
@@ -257,7 +231,7 @@ void worker_signal_channel_ready(dispatcher_t *d,
         pthread_mutex_unlock(&d->lock);
         return;
     }
-    add_worker_channel(&d->worker_pool_root, worker_channel);
+    add_worker_channel(&d->worker_pool_queue, worker_channel);
     if (d->dispatcher_thread_waiting) {
         pthread_cond_signal(&d->cond);
     }
@@ -348,13 +322,13 @@ void worker_pool_stop(dispatcher_t *d) {
     pthread_mutex_lock(&d->lock);
     d->stop = 1;
     while (1) {
-        job_queue_t *cur = d->job_root;
+        job_queue_t *cur = (job_queue_t *) clist_head(&d->job_queue);
         if (cur == NULL) {
             break;
         }
         d->job_pending_cnt--;
-        remove_job(&d->job_root, cur->job);
-        free(cur);
+        remove_job(&d->job_queue, cur);
+        slab_free(job_cache_g, cur);
     }
     pthread_mutex_unlock(&d->lock);
 
@@ -381,22 +355,23 @@ void worker_pool_stop(dispatcher_t *d) {
 short dispatch_job(dispatcher_t *d, job_t *job) {
     worker_pool_queue_t *worker_channel_top;
     pthread_mutex_lock(&d->lock);
-    worker_channel_top = d->worker_pool_root;
+    worker_channel_top =
+            (worker_pool_queue_t *) clist_head(&d->worker_pool_queue);
     if (worker_channel_top == NULL) { // no free worker channels
         d->job_pending_cnt++;
-        add_job(&d->job_root, job); // queue up the job
+        add_job(&d->job_queue, job); // queue up the job
         pthread_mutex_unlock(&d->lock);
         return 0;
     }
 
-    remove_worker_channel(&d->worker_pool_root, worker_channel_top->channel);
+    remove_worker_channel(&d->worker_pool_queue, worker_channel_top);
     pthread_mutex_unlock(&d->lock);
 
     worker_channel_top->channel->job = job;
     pthread_mutex_lock(&worker_channel_top->channel->lock);
     pthread_cond_signal(&worker_channel_top->channel->cond);
     pthread_mutex_unlock(&worker_channel_top->channel->lock);
-    free(worker_channel_top);
+    slab_free(channel_cache_g, worker_channel_top);
     return 1;
 }
 
@@ -411,7 +386,7 @@ short dispatch_job(dispatcher_t *d, job_t *job) {
 void dispatch_all_pending_jobs(dispatcher_t *d) {
     while (1) {
         pthread_mutex_lock(&d->lock);
-        job_queue_t *cur = d->job_root;
+        job_queue_t *cur = (job_queue_t *) clist_head(&d->job_queue);
         if (cur == NULL) {
             pthread_mutex_unlock(&d->lock);
             break;
@@ -422,20 +397,20 @@ void dispatch_all_pending_jobs(dispatcher_t *d) {
             break; 
         }
  
-        if (d->worker_pool_root == NULL) {
+        if (clist_empty(&d->worker_pool_queue)) {
             pthread_mutex_unlock(&d->lock);
             break;
         }
  
         d->job_pending_cnt--;
-        remove_job(&d->job_root, cur->job);
+        remove_job(&d->job_queue, cur);
         pthread_mutex_unlock(&d->lock);
  
         if (!dispatch_job(d, cur->job)) {
-            free(cur);
+            slab_free(job_cache_g, cur);
             break;
         }
-        free(cur);
+        slab_free(job_cache_g, cur);
     }
 }
   
@@ -454,7 +429,7 @@ void* dispatch_thread_start(void *arg) {
             break; // exit the thread
         }
 
-        if (d->job_pending_cnt == 0 || d->worker_pool_root == NULL) {
+        if (d->job_pending_cnt == 0 || clist_empty(&d->worker_pool_queue)) {
             d->dispatcher_thread_waiting = 1;
             pthread_cond_wait(&d->cond, &d->lock);
             d->dispatcher_thread_waiting = 0;
@@ -464,7 +439,7 @@ void* dispatch_thread_start(void *arg) {
                 break; // exit the thread
             }
 
-            if (d->job_pending_cnt == 0 || d->worker_pool_root == NULL) {
+            if (d->job_pending_cnt == 0 || clist_empty(&d->worker_pool_queue)) {
                 pthread_mutex_unlock(&d->lock);
                 continue;
             }
@@ -480,7 +455,8 @@ void* dispatch_thread_start(void *arg) {
  * func: new_dispatcher 
  *    Creates a new dispatcher instance initialized with the num workers
  * under service for this dispatcher. Also creates a thread to dispatch job to
- * workers asynchronously.
+ * workers asynchronously. Returns NULL if the slab caches for the jobs
+ * and worker channels cannot be created.
  * 
  * arg1: num_workers
  */
@@ -495,8 +471,22 @@ new_dispatcher(int num_workers) {
         perror("pthread_attr_init");
     }
 
+    if (job_cache_g == NULL) {
+        job_cache_g = slab_cache_create("job", sizeof(job_queue_t));
+    }
+    if (channel_cache_g == NULL) {
+        channel_cache_g = slab_cache_create("worker channel",
+                sizeof(worker_pool_queue_element_t));
+    }
+    if (job_cache_g == NULL || channel_cache_g == NULL) {
+        fprintf(stderr, "new_dispatcher: no slab caches\n");
+        return NULL;
+    }
+
     dispatcher_t *d = (dispatcher_t *) malloc(sizeof(dispatcher_t));
     memset(d, 0, sizeof(dispatcher_t));
+    clist_init(&d->worker_pool_queue);
+    clist_init(&d->job_queue);
 
     d->num_workers = num_workers;
     d->lock = lock; // initialize
@@ -516,7 +506,17 @@ int main(int argc, char **argv) {
     char *j5 = "five";
     char *j6 = "six";
 
+    buddy_alloc_init();
+    if (buddy_alloc_arena(WORKER_POOL_ARENA_SIZE, 0) != 0 ||
+        buddy_cache_init(NULL) != 0) {
+        fprintf(stderr, "unable to initialize the allocator\n");
+        return 1;
+    }
+
     dispatcher_t *d = new_dispatcher(MAX_WORKERS);
+    if (d == NULL) {
+        return 1;
+    }
     dispatch_job(d, (job_t *) j1);
     dispatch_job(d, (job_t *) j2);
 